@@ -42,6 +42,8 @@
  */
 moore_t* ma_create_full(size_t n, size_t m, size_t s, transition_function_t t,
                         output_function_t y, uint64_t const* q) {
+    STATS_SCOPE(MA_API_CREATE_FULL);
+
     moore_t* a = (moore_t*)malloc(sizeof(moore_t));
     if (!a) {
         errno = ENOMEM;
@@ -75,6 +77,8 @@ moore_t* ma_create_full(size_t n, size_t m, size_t s, transition_function_t t,
  * or a memory allocation error occurred. In such cases, it sets errno to EINVAL or ENOMEM, respectively.
  */
 moore_t* ma_create_simple(size_t n, size_t m, transition_function_t t) {
+    STATS_SCOPE(MA_API_CREATE_SIMPLE);
+
     moore_t* a = (moore_t*)malloc(sizeof(moore_t));
     if (!a) {
         errno = ENOMEM;
@@ -96,11 +100,17 @@ moore_t* ma_create_simple(size_t n, size_t m, transition_function_t t) {
 
 /*
  * The function deletes the specified automaton, first clearing its connections and freeing the memory it uses.
- * It does nothing if called with a NULL pointer.
+ * It does nothing if called with a NULL pointer. An automaton belonging to a pool is only disconnected, its memory is
+ * released by ma_pool_delete.
  */
 void ma_delete(moore_t* a) {
+    STATS_SCOPE(MA_API_DELETE);
+
     if (a) {
+        profile_forget(a);
         clear_the_connections(a);
+        leave_component(a);
+        forget_linear(a);
         free_automaton(a);
     }
 }
@@ -112,18 +122,29 @@ void ma_delete(moore_t* a) {
  *
  * The function returns 0 if the signals were successfully connected. If any pointer is NULL, the parameter 'num' is 0,
  * the specified range of input or output numbers is invalid, or a memory allocation error occurred, the function
- * returns -1 and sets errno to EINVAL or ENOMEM.
+ * returns -1 and sets errno to EINVAL or ENOMEM. In such cases, no connection is changed.
  */
 int ma_connect(moore_t* a_in, size_t in, moore_t* a_out, size_t out, size_t num) {
+    STATS_SCOPE(MA_API_CONNECT);
+
     if (!a_in || !a_out || num == 0 || in + num > a_in->input_signals_num || out + num > a_out->output_signals_num) {
         errno = EINVAL;
         return -1;
     }
 
+    // everything which may fail is done first, so a failed call changes nothing
+    // (the reserved nodes stay with 'a_out' if joining the components fails)
+    if (!reserve_outgoing(a_out, num) || !join_components(a_in, a_out)) {
+        errno = ENOMEM;
+        return -1;
+    }
+
     for (size_t i = 0; i < num; i++) {
-        if (a_in->incoming_connections[in + i]) remove_the_connection(a_in, in + i);
-        create_incoming_connection(a_in, in + i, a_out, out + i);
-        create_outgoing_connection(a_out, out + i, a_in, in + i);
+        outgoing_t* node = take_outgoing(a_out);
+
+        remove_the_connection(a_in, in + i);
+        link_incoming(a_in, in + i, a_out, out + i);
+        if (!link_outgoing(a_out, out + i, a_in, in + i, node)) release_outgoing(a_out, node);
     }
 
     return 0;
@@ -137,6 +158,8 @@ int ma_connect(moore_t* a_in, size_t in, moore_t* a_out, size_t out, size_t num)
  * 0, or the specified range of input numbers is invalid, the function sets errno to EINVAL and returns -1.
  */
 int ma_disconnect(moore_t* a_in, size_t in, size_t num) {
+    STATS_SCOPE(MA_API_DISCONNECT);
+
     if (!a_in || num == 0 || in + num > a_in->input_signals_num) {
         errno = EINVAL;
         return -1;
@@ -157,41 +180,31 @@ int ma_disconnect(moore_t* a_in, size_t in, size_t num) {
  * errno to EINVAL and returns -1.
  */
 int ma_set_input(moore_t* a, uint64_t const* input) {
+    STATS_SCOPE(MA_API_SET_INPUT);
+
     if (!a || !input || a->input_signals_num == 0) {
         errno = EINVAL;
         return -1;
     }
 
-    size_t const input_signals = a->input_signals_num;
-
-    for (size_t i = 0; i < input_signals; i++) {
-        if (!a->incoming_connections[i]) {
-            // if there is no previous connection
-            size_t const block = i / BITS_PER_BLOCK;
-            size_t const bit_index = i % BITS_PER_BLOCK;
-
-            int const bit_value = get_bit(input, i);
-            set_bit(bit_value, a->input, block, bit_index);
-        }
-    }
+    merge_input(a, input);
 
     return 0;
 }
 
 /*
- * Sets the state of the automaton 'a' to the state 'state'. It returns 0 if the operation was successful or -1 if any
- * of the pointers is NULL, setting errno to EINVAL.
+ * Sets the state of the automaton 'a' to the state 'state', zeroing the unused bits of its last block. It returns 0 if
+ * the operation was successful or -1 if any of the pointers is NULL, setting errno to EINVAL.
  */
 int ma_set_state(moore_t* a, uint64_t const* state) {
+    STATS_SCOPE(MA_API_SET_STATE);
+
     if (!a || !state) {
         errno = EINVAL;
         return -1;
     }
 
-    size_t const state_signals = a->state_signals_num;
-    size_t const blocks = (state_signals + FILL_THE_BLOCK) / BITS_PER_BLOCK;
-
-    memcpy(a->state, state, blocks * sizeof(uint64_t));
+    masked_copy(a->state, state, a->state_signals_num);
 
     // because the state has changed, the recalculation of the output is necessary
     a->output_function(a->output, a->state, a->output_signals_num, a->state_signals_num);
@@ -204,6 +217,8 @@ int ma_set_state(moore_t* a, uint64_t const* state) {
  * or NULL if the pointer to the automaton is NULL, setting errno to EINVAL.
  */
 uint64_t const* ma_get_output(moore_t const* a) {
+    STATS_SCOPE(MA_API_GET_OUTPUT);
+
     if (!a) {
         errno = EINVAL;
         return NULL;
@@ -212,37 +227,65 @@ uint64_t const* ma_get_output(moore_t const* a) {
     return a->output;
 }
 
+/*
+ * The function returns the number of output signals of the automaton or 0 if the pointer to the automaton is NULL,
+ * setting errno to EINVAL.
+ */
+size_t ma_get_output_num(moore_t const* a) {
+    STATS_SCOPE(MA_API_GET_OUTPUT_NUM);
+
+    if (!a) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return a->output_signals_num;
+}
+
 /*
  * Funkcja wykonuje jeden krok obliczeń podanych automatów z tablicy 'at[]'. Wszystkie automaty działają równolegle i
  * synchronicznie. Oznacza to, że wartości stanów i wyjść po wywołaniu funkcji zależą jedynie od wartości stanów, wejść
  * i wyjść przed wywołaniem funkcji.
  *
- * Przakazuje w wyniku 0 lub -1, jeżeli któryś ze wskaźników w tablicy ma wartość NULL, num == 0 albo wystąpił błąd
- * alokacji pamięci, odpowiednio ustawiając errno na EINVAL lub ENOMEM.
+ * Przakazuje w wyniku 0 lub -1, jeżeli któryś ze wskaźników w tablicy ma wartość NULL albo num == 0, ustawiając errno
+ * na EINVAL.
  */
 /*
  * The function performs one computation step for the given automata in the array 'at[]'. All automata operate in
  * parallel and synchronously. This means that the values of states and outputs after the function call depend only on
  * the values of states, inputs, and outputs before the function call.
  *
- * It returns 0 or -1 if any pointer in the array is NULL, 'num' is 0, or a memory allocation error occurred, setting
- * errno to EINVAL or ENOMEM, respectively.
+ * It returns 0 or -1 if any pointer in the array is NULL or 'num' is 0, setting errno to EINVAL. It does not allocate
+ * memory.
  */
 int ma_step(moore_t* at[], size_t num) {
+    STATS_SCOPE(MA_API_STEP);
+
     if (!at || num == 0 || null_in_the_array(at, num)) {
         errno = EINVAL;
         return -1;
     }
 
+    if (atomic_load_explicit(&profiling, memory_order_relaxed)) {
+        profile_step(at, num);
+        return 0;
+    }
+
+    bool const sampled = atomic_load_explicit(&perf_sampling, memory_order_acquire) && perf_begin();
+
     // set the inputs
     for (size_t i = 0; i < num; i++) {
         get_input(at[i]);
     }
 
+    if (sampled) perf_gathered();
+
     // calculate the new states
     for (size_t i = 0; i < num; i++) {
         calculate_new_state(at[i]);
     }
 
+    if (sampled) perf_end();
+
     return 0;
 }
@@ -19,6 +19,7 @@ int ma_disconnect(moore_t *a_in, size_t in, size_t num);
 int ma_set_input(moore_t *a, uint64_t const *input);
 int ma_set_state(moore_t *a, uint64_t const *state);
 uint64_t const * ma_get_output(moore_t const *a);
+size_t ma_get_output_num(moore_t const *a);
 int ma_step(moore_t *at[], size_t num);
 
 #endif
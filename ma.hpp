@@ -0,0 +1,306 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Header-only C++ front end. Moore<N, M, S, T, Y> is an automaton whose numbers of signals and whose transition and
+ * output functions are template parameters, so the block counts and the masks of the last blocks are constants, the
+ * buffers live inside the object, and T and Y are called directly, which lets the compiler inline them. The functions
+ * have the same types as in ma.h, so one function can serve both the C and the C++ automata.
+ *
+ * Connected inputs are compiled into runs of consecutive bits read from the outputs of the sources, the same as in the
+ * store engine, and ma::step steps any number of automata of different types without an indirect call. The sources
+ * may also be C automata, and handle() gives a C automaton mirroring the output of a C++ one, which C automata can be
+ * connected to; ma::step_mixed steps such a mixed network keeping the semantics of ma_step.
+ *
+ * Requires C++17.
+ **/
+
+#ifndef MA_HPP
+#define MA_HPP
+
+extern "C" {
+#include "ma.h"
+}
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+namespace ma {
+
+namespace detail {
+
+constexpr std::size_t bits_per_block = 64;
+
+constexpr std::size_t blocks(std::size_t bits) {
+    return (bits + bits_per_block - 1) / bits_per_block;
+}
+
+// Mask of the used bits of the last block of a sequence of 'bits' bits.
+constexpr std::uint64_t last_block_mask(std::size_t bits) {
+    return bits % bits_per_block == 0 ? ~UINT64_C(0) : (UINT64_C(1) << (bits % bits_per_block)) - 1;
+}
+
+// Reads 'length' (at most 64) bits of 'source' starting from the bit 'position'.
+inline std::uint64_t read_bits(std::uint64_t const* source, std::size_t position, std::size_t length) {
+    std::size_t const block = position / bits_per_block;
+    std::size_t const offset = position % bits_per_block;
+
+    std::uint64_t value = source[block] >> offset;
+    if (offset + length > bits_per_block) value |= source[block + 1] << (bits_per_block - offset);
+
+    return length == bits_per_block ? value : value & ((UINT64_C(1) << length) - 1);
+}
+
+// Sets 'length' bits of 'dest' starting from the bit 'position', which have to be zero, to the bits of 'value'.
+inline void write_bits(std::uint64_t* dest, std::size_t position, std::size_t length, std::uint64_t value) {
+    std::size_t const block = position / bits_per_block;
+    std::size_t const offset = position % bits_per_block;
+
+    dest[block] |= value << offset;
+    if (offset + length > bits_per_block) dest[block + 1] |= value >> (bits_per_block - offset);
+}
+
+// Input bits 'bit' .. 'bit + length - 1' are the bits 'source_bit' .. of 'source'.
+struct run {
+    std::uint64_t const* source;
+    std::size_t source_bit;
+    std::size_t bit;
+    std::size_t length;
+};
+
+// Keeps the state of the mirror, so its output stays the mirrored one when it is stepped by ma_step.
+inline void keep_state(std::uint64_t* next_state, std::uint64_t const*, std::uint64_t const* state, std::size_t,
+                       std::size_t s) {
+    std::memcpy(next_state, state, blocks(s) * sizeof(std::uint64_t));
+}
+
+} // namespace detail
+
+template <std::size_t N, std::size_t M, std::size_t S, transition_function_t T, output_function_t Y>
+class Moore {
+    static_assert(M > 0 && S > 0, "an automaton needs outputs and a state");
+
+public:
+    static constexpr std::size_t inputs = N;
+    static constexpr std::size_t outputs = M;
+    static constexpr std::size_t state_bits = S;
+    static constexpr std::size_t input_blocks = detail::blocks(N);
+    static constexpr std::size_t output_blocks = detail::blocks(M);
+    static constexpr std::size_t state_blocks = detail::blocks(S);
+
+    // Creates the automaton in the state 'q', or in the zero state if 'q' is NULL.
+    explicit Moore(std::uint64_t const* q = nullptr) {
+        if (q) {
+            set_state(q);
+        }
+        else {
+            compute_output();
+        }
+    }
+
+    // Other automata read the output by its address, so an automaton cannot be copied or moved.
+    Moore(Moore const&) = delete;
+    Moore& operator=(Moore const&) = delete;
+
+    ~Moore() {
+        if (mirror_) ma_delete(mirror_);
+    }
+
+    // Sets the inputs which are not connected, like ma_set_input.
+    void set_input(std::uint64_t const* input) {
+        static_assert(N > 0, "the automaton has no inputs");
+        for (std::size_t w = 0; w < input_blocks; w++) {
+            input_[w] = (input_[w] & connected_[w]) | (input[w] & ~connected_[w]);
+        }
+        input_[input_blocks - 1] &= detail::last_block_mask(N);
+    }
+
+    // Sets the state and computes the output, like ma_set_state.
+    void set_state(std::uint64_t const* state) {
+        std::memcpy(state_.data(), state, state_blocks * sizeof(std::uint64_t));
+        state_[state_blocks - 1] &= detail::last_block_mask(S);
+        compute_output();
+    }
+
+    std::uint64_t const* output() const {
+        return output_.data();
+    }
+
+    std::uint64_t const* state() const {
+        return state_.data();
+    }
+
+    // Connects the inputs 'in' .. 'in + num - 1' to the outputs 'out' .. of another C++ automaton.
+    template <std::size_t N2, std::size_t M2, std::size_t S2, transition_function_t T2, output_function_t Y2>
+    void connect(std::size_t in, Moore<N2, M2, S2, T2, Y2> const& source, std::size_t out, std::size_t num) {
+        connect_bits(in, source.output(), out, num, M2);
+    }
+
+    // Connects the inputs 'in' .. 'in + num - 1' to the outputs 'out' .. of a C automaton. Its output buffer has to
+    // stay where it is, so it must not join an output buffer (ma_output.h) or be reordered in a pool afterwards.
+    void connect(std::size_t in, moore_t const* source, std::size_t out, std::size_t num) {
+        std::uint64_t const* output = ma_get_output(source);
+        if (!output) throw std::invalid_argument("ma::Moore::connect: NULL source");
+        connect_bits(in, output, out, num, ma_get_output_num(source));
+    }
+
+    void disconnect(std::size_t in, std::size_t num) {
+        check_inputs(in, num);
+        for (std::size_t i = 0; i < num; i++) {
+            sources_[in + i] = nullptr;
+        }
+        compile();
+    }
+
+    // Returns a C automaton with the outputs of this one, which C automata can be connected to. It is created on the
+    // first call and updated after every step; stepping it with ma_step does not change it.
+    moore_t* handle() {
+        if (!mirror_) {
+            mirror_ = ma_create_full(0, M, M, detail::keep_state, identity, output_.data());
+            if (!mirror_) {
+                if (errno == ENOMEM) throw std::bad_alloc();
+                throw std::system_error(errno, std::generic_category(), "ma::Moore::handle");
+            }
+        }
+        return mirror_;
+    }
+
+    // Reads the connected inputs from the current outputs of their sources.
+    void gather() {
+        if constexpr (N > 0) {
+            for (std::size_t w = 0; w < input_blocks; w++) {
+                input_[w] &= ~connected_[w];
+            }
+            for (detail::run const& r : runs_) {
+                for (std::size_t done = 0; done < r.length; done += detail::bits_per_block) {
+                    std::size_t const length = r.length - done < detail::bits_per_block ? r.length - done
+                                                                                         : detail::bits_per_block;
+                    detail::write_bits(input_.data(), r.bit + done, length,
+                                       detail::read_bits(r.source, r.source_bit + done, length));
+                }
+            }
+        }
+    }
+
+    // Computes the new state and output from the gathered inputs.
+    void compute() {
+        next_.fill(0);
+        T(next_.data(), input_.data(), state_.data(), N, S);
+        std::memcpy(state_.data(), next_.data(), state_blocks * sizeof(std::uint64_t));
+        state_[state_blocks - 1] &= detail::last_block_mask(S);
+        compute_output();
+    }
+
+    void step() {
+        gather();
+        compute();
+    }
+
+private:
+    static void identity(std::uint64_t* output, std::uint64_t const* state, std::size_t m, std::size_t) {
+        std::memcpy(output, state, detail::blocks(m) * sizeof(std::uint64_t));
+    }
+
+    void compute_output() {
+        Y(output_.data(), state_.data(), M, S);
+        output_[output_blocks - 1] &= detail::last_block_mask(M);
+        if (mirror_) ma_set_state(mirror_, output_.data());
+    }
+
+    void check_inputs(std::size_t in, std::size_t num) const {
+        if (num == 0 || in > N || num > N - in) throw std::out_of_range("ma::Moore: invalid range of inputs");
+    }
+
+    void connect_bits(std::size_t in, std::uint64_t const* output, std::size_t out, std::size_t num,
+                      std::size_t source_outputs) {
+        check_inputs(in, num);
+        if (out > source_outputs || num > source_outputs - out) {
+            throw std::out_of_range("ma::Moore::connect: invalid range of outputs");
+        }
+
+        for (std::size_t i = 0; i < num; i++) {
+            sources_[in + i] = output;
+            source_bits_[in + i] = out + i;
+        }
+        compile();
+    }
+
+    // Compiles the sources of the inputs into runs and the mask of connected inputs.
+    void compile() {
+        std::vector<detail::run> runs;
+        connected_.fill(0);
+
+        for (std::size_t bit = 0; bit < N; bit++) {
+            if (!sources_[bit]) continue;
+
+            connected_[bit / detail::bits_per_block] |= UINT64_C(1) << (bit % detail::bits_per_block);
+            if (!runs.empty()) {
+                detail::run& last = runs.back();
+                if (last.source == sources_[bit] && last.bit + last.length == bit &&
+                    last.source_bit + last.length == source_bits_[bit]) {
+                    last.length++;
+                    continue;
+                }
+            }
+            runs.push_back({sources_[bit], source_bits_[bit], bit, 1});
+        }
+
+        runs_.swap(runs);
+    }
+
+    static constexpr std::size_t at_least_one(std::size_t n) {
+        return n > 0 ? n : 1;
+    }
+
+    std::array<std::uint64_t, at_least_one(input_blocks)> input_{};
+    std::array<std::uint64_t, at_least_one(input_blocks)> connected_{};
+    std::array<std::uint64_t, state_blocks> state_{};
+    std::array<std::uint64_t, state_blocks> next_{};
+    std::array<std::uint64_t, output_blocks> output_{};
+
+    std::array<std::uint64_t const*, at_least_one(N)> sources_{};
+    std::array<std::size_t, at_least_one(N)> source_bits_{};
+    std::vector<detail::run> runs_;
+
+    moore_t* mirror_ = nullptr;
+};
+
+// Performs one step of all the automata, like ma_step: all of them gather their inputs before any of them computes.
+template <class... Automata>
+void step(Automata&... automata) {
+    (automata.gather(), ...);
+    (automata.compute(), ...);
+}
+
+// Performs one step of a network of the C automata 'at' and the C++ 'automata', which may be connected to each other
+// in both directions through handle(). The result is the same as one ma_step of the whole network. 'num' may be 0 if
+// there are no C automata. It returns 0, or -1 if 'num' is not 0 and 'at' or any of its pointers is NULL, setting
+// errno to EINVAL; in such a case nothing is stepped.
+template <class... Automata>
+int step_mixed(moore_t* at[], std::size_t num, Automata&... automata) {
+    if (num != 0 && !at) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (std::size_t i = 0; i < num; i++) {
+        if (!at[i]) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    (automata.gather(), ...); // before the C automata change their outputs
+    if (num != 0) ma_step(at, num); // before the mirrors change, it cannot fail for valid arguments
+    (automata.compute(), ...);
+    return 0;
+}
+
+} // namespace ma
+
+#endif //MA_HPP
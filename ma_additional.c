@@ -15,19 +15,6 @@
 #define FILL_THE_BLOCK 63
 #define BITS_PER_BLOCK 64
 
-// Represents a linked list of outgoing connections from the specified bit of the automaton.
-typedef struct outgoing {
-    moore_t* aut_getting_signals;
-    size_t bit_getting_signals;
-    struct outgoing* next;
-} outgoing_t;
-
-// Represents a single incoming connection to the specified bit of the automaton.
-typedef struct incoming {
-    moore_t* source_aut;
-    size_t source_bit;
-} incoming_t;
-
 uint64_t create_bit_mask(size_t const num_bits) {
     uint64_t const mask = (1ULL << num_bits) - 1;
     return mask;
@@ -65,11 +52,41 @@ void set_bit(int const bit_value, uint64_t* const array, size_t const block_inde
     else array[block_index] &= ~(1ULL << bit_index);
 }
 
+// Adds 'length' bits of 'src', starting from its first bit, to the bits of 'dest' starting from the bit 'position'.
+void add_bits(uint64_t* dest, size_t const position, uint64_t const* src, size_t const length) {
+    for (size_t done = 0; done < length; done += BITS_PER_BLOCK) {
+        size_t const bits = length - done < BITS_PER_BLOCK ? length - done : BITS_PER_BLOCK;
+        uint64_t value = src[done / BITS_PER_BLOCK];
+        if (bits < BITS_PER_BLOCK) value &= create_bit_mask(bits);
+
+        size_t const p = position + done;
+        size_t const offset = p % BITS_PER_BLOCK;
+        dest[p / BITS_PER_BLOCK] ^= value << offset;
+        if (offset + bits > BITS_PER_BLOCK) dest[p / BITS_PER_BLOCK + 1] ^= value >> (BITS_PER_BLOCK - offset);
+    }
+}
+
+// Copies 'length' bits of 'src' starting from the bit 'position' to 'dest', zeroing the unused bits of its last block.
+void extract_bits(uint64_t* dest, uint64_t const* src, size_t const position, size_t const length) {
+    for (size_t done = 0; done < length; done += BITS_PER_BLOCK) {
+        size_t const p = position + done;
+        size_t const offset = p % BITS_PER_BLOCK;
+        uint64_t value = src[p / BITS_PER_BLOCK] >> offset;
+        if (offset != 0 && offset + length - done > BITS_PER_BLOCK) {
+            value |= src[p / BITS_PER_BLOCK + 1] << (BITS_PER_BLOCK - offset);
+        }
+        dest[done / BITS_PER_BLOCK] = value;
+    }
+
+    if (length % BITS_PER_BLOCK != 0) dest[length / BITS_PER_BLOCK] &= create_bit_mask(length % BITS_PER_BLOCK);
+}
+
 /*
- * Removes a connection from the outgoing list 'head' by deleting the element with aut_gettong_signals = 'a_in' and
- * bit_getting_signals = 'bit'.
+ * Removes a connection from the outgoing list 'head' of the automaton 'owner' by deleting the element with
+ * aut_gettong_signals = 'a_in' and bit_getting_signals = 'bit'.
  */
-static void remove_from_the_outgoing_list(outgoing_t** head, moore_t const* const a_in, size_t const bit) {
+static void remove_from_the_outgoing_list(moore_t* owner, outgoing_t** head, moore_t const* const a_in,
+                                          size_t const bit) {
     if (!*head) {
         errno = EINVAL;
         return;
@@ -90,7 +107,8 @@ static void remove_from_the_outgoing_list(outgoing_t** head, moore_t const* cons
                 *head = current->next;
             }
 
-            free(current);
+            current->next = NULL;
+            release_outgoing(owner, current);
             return;
         }
 
@@ -118,15 +136,18 @@ bool allocate_automaton(moore_t* a, size_t const n, size_t const m, size_t const
 
     if (n == 0) {
         a->input = NULL;
+        a->connected = NULL;
         a->incoming_connections = NULL;
     }
 
+    // the mask of connected inputs is allocated together with the input
     if (n != 0) {
-        a->input = (uint64_t*)calloc(input_blocks, sizeof(uint64_t));
+        a->input = (uint64_t*)calloc(2 * input_blocks, sizeof(uint64_t));
         if (!a->input) {
             errno = ENOMEM;
             return false;
         }
+        a->connected = a->input + input_blocks;
     }
 
     a->output = (uint64_t*)calloc(output_blocks, sizeof(uint64_t));
@@ -136,16 +157,18 @@ bool allocate_automaton(moore_t* a, size_t const n, size_t const m, size_t const
         return false;
     }
 
-    a->state = (uint64_t*)calloc(state_blocks, sizeof(uint64_t));
+    // the buffer for the next state is allocated together with the state, so that stepping does not allocate memory
+    a->state = (uint64_t*)calloc(2 * state_blocks, sizeof(uint64_t));
     if (!a->state) {
         errno = ENOMEM;
         if (a->input) free(a->input);
         free(a->output);
         return false;
     }
+    a->next_state = a->state + state_blocks;
 
     if (n != 0) {
-        a->incoming_connections = (incoming_t**)calloc(n, sizeof(incoming_t*));
+        a->incoming_connections = (incoming_t*)calloc(n, sizeof(incoming_t));
         if (!a->incoming_connections) {
             errno = ENOMEM;
             free(a->input);
@@ -155,7 +178,7 @@ bool allocate_automaton(moore_t* a, size_t const n, size_t const m, size_t const
         }
 
         for (size_t i = 0; i < n; i++) {
-            a->incoming_connections[i] = NULL;
+            a->incoming_connections[i].source_aut = NULL;
         }
     }
 
@@ -188,10 +211,32 @@ bool initialize_automaton(moore_t* a, size_t const n, size_t const m, size_t con
     a->state_signals_num = s;
     a->transition_function = t;
     a->output_function = y;
+    a->pool = NULL;
+    a->output_buffer = NULL;
+    a->component = NULL;
+    atomic_init(&a->owner, 0);
+    a->linear = NULL;
+    a->spare_outgoing = NULL;
+    a->spare_outgoing_num = 0;
+    a->outgoing_blocks = NULL;
 
     return true;
 }
 
+/*
+ * Sets the inputs of the automaton which are not connected to outputs to the values of 'input' and zeroes the unused
+ * bits of the last block.
+ */
+void merge_input(moore_t* a, uint64_t const* input) {
+    size_t const blocks = (a->input_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+
+    masked_merge(a->input, input, a->connected, blocks);
+
+    if (a->input_signals_num % BITS_PER_BLOCK != 0) { // mask the last block if needed
+        a->input[blocks - 1] &= create_bit_mask(a->input_signals_num % BITS_PER_BLOCK);
+    }
+}
+
 /*
  * Copies the state of the automaton to its output. Only for simple automata.
  */
@@ -201,13 +246,7 @@ void identity_function(uint64_t* output, uint64_t const* state, size_t m, size_t
         return;
     }
 
-    const size_t blocks = (m + FILL_THE_BLOCK) / BITS_PER_BLOCK;
-    memcpy(output, state, blocks * sizeof(uint64_t));
-
-    if (m % BITS_PER_BLOCK != 0) { // mask the last block if needed
-        uint64_t const mask = create_bit_mask(m % BITS_PER_BLOCK);
-        output[blocks - 1] &= mask;
-    }
+    masked_copy(output, state, m);
 }
 
 /*
@@ -222,18 +261,14 @@ void get_input(moore_t* a) {
     size_t const input_signals = a->input_signals_num;
 
     for (size_t i = 0; i < input_signals; i++) {
-        incoming_t const* const current = a->incoming_connections[i];
-
-        if (current) {
-            moore_t const* const source_automaton = current->source_aut;
-            size_t const source_bit = current->source_bit;
-
-            if (source_automaton) {
-                int const bit_value = get_bit(source_automaton->output, source_bit);
-                size_t const block = i / BITS_PER_BLOCK;
-                size_t const bit_index = i % BITS_PER_BLOCK;
-                set_bit(bit_value, a->input, block, bit_index);
-            }
+        incoming_t const* const current = &a->incoming_connections[i];
+        moore_t const* const source_automaton = current->source_aut;
+
+        if (source_automaton) {
+            int const bit_value = get_bit(source_automaton->output, current->source_bit);
+            size_t const block = i / BITS_PER_BLOCK;
+            size_t const bit_index = i % BITS_PER_BLOCK;
+            set_bit(bit_value, a->input, block, bit_index);
         }
     }
 
@@ -257,7 +292,7 @@ bool null_in_the_array(moore_t* a[], size_t const size) {
 
 /*
  * Function calculates the new state of the automaton based on its input and current state using 'transition_function'.
- * Then it sets the new state of the automaton.
+ * Then it sets the new state of the automaton. The new state is computed in the 'next_state' buffer of the automaton.
  */
 void calculate_new_state(moore_t* a) {
     if (!a) {
@@ -265,105 +300,165 @@ void calculate_new_state(moore_t* a) {
         return;
     }
 
-    size_t const state_offset = a->state_signals_num % BITS_PER_BLOCK;
-    size_t const output_offset = a->output_signals_num % BITS_PER_BLOCK;
-    size_t const state_blocks = (a->state_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
-    size_t const output_blocks = (a->output_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+    apply_transition(a, a->next_state);
+}
 
-    uint64_t* next_state = (uint64_t*)calloc(state_blocks, sizeof(uint64_t));
-    if (next_state == NULL) {
-        errno = ENOMEM;
+/*
+ * Does the work of calculate_new_state using the caller's 'next_state' buffer, which has to hold at least as many
+ * blocks as the state of the automaton. It lets callers stepping many automata reuse one buffer for all of them.
+ */
+void apply_transition(moore_t* a, uint64_t* next_state) {
+    if (!a || !next_state) {
+        errno = EINVAL;
         return;
     }
 
+    compute_next_state(a, next_state);
+    store_next_state(a, next_state);
+    compute_output(a);
+    mask_output(a);
+}
+
+/*
+ * The phases of apply_transition, also timed separately by the profiler (see ma_profile.c). Computes the new state of
+ * the automaton into the 'next_state' buffer.
+ */
+void compute_next_state(moore_t* a, uint64_t* next_state) {
+    size_t const state_blocks = (a->state_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+
+    memset(next_state, 0, state_blocks * sizeof(uint64_t)); // the buffer may hold the state of another automaton
     a->transition_function(next_state, a->input, a->state, a->input_signals_num, a->state_signals_num);
-    memcpy(a->state, next_state, state_blocks * sizeof(uint64_t));
+}
 
-    if (state_offset != 0) { // mask the last block if needed
-        uint64_t const mask = create_bit_mask(state_offset);
-        a->state[state_blocks - 1] &= mask;
-    }
+// Copies the new state from the 'next_state' buffer, masking the unused bits of its last block.
+void store_next_state(moore_t* a, uint64_t const* next_state) {
+    masked_copy(a->state, next_state, a->state_signals_num);
+}
 
+// Computes the output of the automaton from its state.
+void compute_output(moore_t* a) {
     a->output_function(a->output, a->state, a->output_signals_num, a->state_signals_num);
+}
+
+// Masks the unused bits of the last block of the output.
+void mask_output(moore_t* a) {
+    size_t const output_offset = a->output_signals_num % BITS_PER_BLOCK;
+    size_t const output_blocks = (a->output_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
 
     if (output_offset != 0) { // mask the last block if needed
         uint64_t const mask = create_bit_mask(output_offset);
         a->output[output_blocks - 1] &= mask;
     }
+}
+
+static void mark_connected(moore_t* a, size_t const bit, bool const connected) {
+    uint64_t const mask = 1ULL << (bit % BITS_PER_BLOCK);
 
-    free(next_state);
+    if (connected) {
+        a->connected[bit / BITS_PER_BLOCK] |= mask;
+    }
+    else {
+        a->connected[bit / BITS_PER_BLOCK] &= ~mask;
+    }
 }
 
 /*
- * The function creates a new connection between the 'source_bit' of the automaton 'gives_signals' and the 'bit' of the
- * automaton 'gets_signals' by adding a pointer to 'gives_signals' to the list of incoming connections.
+ * Makes sure that the automaton 'a' has at least 'num' spare outgoing connection nodes, allocating the missing ones
+ * with a single allocation. The nodes belong to 'a' until it is deleted. Returns false and sets errno to ENOMEM if a
+ * memory allocation error occurs.
  */
-void create_incoming_connection(moore_t* const gets_signals, size_t const bit, moore_t* const gives_signals,
-                                size_t const source_bit) {
-    if (!gets_signals || !gives_signals || bit >= gets_signals->input_signals_num || source_bit >=
-        gives_signals->output_signals_num) {
-        errno = EINVAL;
-        return;
-    }
+bool reserve_outgoing(moore_t* a, size_t const num) {
+    if (a->spare_outgoing_num >= num) return true;
 
-    if (gets_signals->incoming_connections[bit] != NULL) {
-        free(gets_signals->incoming_connections[bit]);
-        outgoing_t* current = gives_signals->outgoing_connections[source_bit];
-        remove_from_the_outgoing_list(&current, gets_signals, bit);
-        gives_signals->outgoing_connections[source_bit] = current;
+    size_t const missing = num - a->spare_outgoing_num;
+    outgoing_block_t* block = (outgoing_block_t*)malloc(sizeof(outgoing_block_t) + missing * sizeof(outgoing_t));
+    if (!block) {
+        errno = ENOMEM;
+        return false;
     }
 
-    incoming_t* new_connection = (incoming_t*)malloc(sizeof(incoming_t));
-    if (!new_connection) {
-        errno = ENOMEM;
-        return;
+    for (size_t i = 0; i < missing; i++) {
+        block->nodes[i].next = i + 1 < missing ? &block->nodes[i + 1] : a->spare_outgoing;
     }
+    a->spare_outgoing = block->nodes;
+    a->spare_outgoing_num += missing;
 
-    new_connection->source_aut = gives_signals;
-    new_connection->source_bit = source_bit;
-    gets_signals->incoming_connections[bit] = new_connection;
+    block->next = a->outgoing_blocks;
+    a->outgoing_blocks = block;
+
+    return true;
 }
 
 /*
- * The function creates a new connection between the 'source_bit' of the automaton 'gives_signals' and the 'bit' of the
- * automaton 'gets_signals' by adding an element to the outgoing connections list and setting it as the start of the
- * connections list for the 'source_bit'.
+ * Takes one of the spare outgoing connection nodes of the automaton 'a', reserved with reserve_outgoing.
  */
-void create_outgoing_connection(moore_t* const gives_signals, size_t const source_bit, moore_t* const gets_signals,
-                                size_t const bit) {
-    if (!gives_signals || !gets_signals || source_bit >= gives_signals->output_signals_num || bit >=
-        gets_signals->input_signals_num) {
-        errno = EINVAL;
-        return;
-    }
+outgoing_t* take_outgoing(moore_t* a) {
+    outgoing_t* node = a->spare_outgoing;
+    a->spare_outgoing = node->next;
+    a->spare_outgoing_num--;
+    node->next = NULL;
 
-    bool existing_connection = false;
-    outgoing_t *current = gives_signals->outgoing_connections[source_bit];
+    return node;
+}
 
-    while (current && !existing_connection) {
-        if (current->aut_getting_signals == gets_signals && current->bit_getting_signals == bit) {
-            existing_connection = true;
-        }
-        current = current->next;
+/*
+ * Gives the outgoing connection nodes of the list 'nodes', linked by 'next', back to the spare nodes of their owner 'a'.
+ */
+void release_outgoing(moore_t* a, outgoing_t* nodes) {
+    while (nodes) {
+        outgoing_t* next = nodes->next;
+        nodes->next = a->spare_outgoing;
+        a->spare_outgoing = nodes;
+        a->spare_outgoing_num++;
+        nodes = next;
     }
+}
 
-    if (!existing_connection) {
-        outgoing_t* new_connection = (outgoing_t*)malloc(sizeof(outgoing_t));
-        if (!new_connection) {
-            errno = ENOMEM;
-            return;
-        }
+// Frees the outgoing connection nodes of the automaton, none of which may be in use.
+static void free_outgoing(moore_t* a) {
+    while (a->outgoing_blocks) {
+        outgoing_block_t* next = a->outgoing_blocks->next;
+        free(a->outgoing_blocks);
+        a->outgoing_blocks = next;
+    }
+
+    a->spare_outgoing = NULL;
+    a->spare_outgoing_num = 0;
+}
 
-        new_connection->aut_getting_signals = gets_signals;
-        new_connection->bit_getting_signals = bit;
-        new_connection->next = gives_signals->outgoing_connections[source_bit];
-        gives_signals->outgoing_connections[source_bit] = new_connection;
+/*
+ * Connects the 'bit' of the automaton 'gets_signals', which must not be connected, to the 'source_bit' of the
+ * automaton 'gives_signals' and marks the bit as connected. It cannot fail.
+ */
+void link_incoming(moore_t* const gets_signals, size_t const bit, moore_t* const gives_signals,
+                   size_t const source_bit) {
+    gets_signals->incoming_connections[bit].source_aut = gives_signals;
+    gets_signals->incoming_connections[bit].source_bit = source_bit;
+    mark_connected(gets_signals, bit, true);
+}
+
+/*
+ * Adds the already taken 'node' to the outgoing connections of the 'source_bit' of the automaton 'gives_signals',
+ * unless the 'bit' of 'gets_signals' is already there. Returns false if the node was not used. It cannot fail.
+ */
+bool link_outgoing(moore_t* const gives_signals, size_t const source_bit, moore_t* const gets_signals, size_t const bit,
+                   outgoing_t* node) {
+    for (outgoing_t const* current = gives_signals->outgoing_connections[source_bit]; current; current = current->next) {
+        if (current->aut_getting_signals == gets_signals && current->bit_getting_signals == bit) return false;
     }
+
+    node->aut_getting_signals = gets_signals;
+    node->bit_getting_signals = bit;
+    node->next = gives_signals->outgoing_connections[source_bit];
+    gives_signals->outgoing_connections[source_bit] = node;
+
+    return true;
 }
 
 /*
  * The function removes the connections of the 'bit' from 'a_in' by removing this element from the 'outgoing_connections'
- * list of the automaton providing the signal and setting the 'incoming_connections[bit]' element to NULL.
+ * list of the automaton providing the signal, setting the source of the 'incoming_connections[bit]' element to NULL
+ * and marking the bit as not connected.
  *
  * If such a connection does not exist, it does nothing. If the value of 'bit' is out of range or the pointer 'a_in'
  * is NULL, it sets errno to EINVAL.
@@ -374,21 +469,21 @@ void remove_the_connection(moore_t* a_in, size_t const bit) {
         return;
     }
 
-    if (!a_in->incoming_connections[bit] || !a_in->incoming_connections[bit]->source_aut) {
+    if (!a_in->incoming_connections[bit].source_aut) {
         return;
     }
 
     // what is the bit 'bit' connected to
-    size_t const source_bit = a_in->incoming_connections[bit]->source_bit;
-    moore_t const* const source_aut = a_in->incoming_connections[bit]->source_aut;
+    size_t const source_bit = a_in->incoming_connections[bit].source_bit;
+    moore_t* const source_aut = a_in->incoming_connections[bit].source_aut;
 
     // remove the connection from the list of outgoing connections
     outgoing_t* current_out = source_aut->outgoing_connections[source_bit];
-    remove_from_the_outgoing_list(&current_out, a_in, bit);
+    remove_from_the_outgoing_list(source_aut, &current_out, a_in, bit);
     source_aut->outgoing_connections[source_bit] = current_out;
 
-    free(a_in->incoming_connections[bit]);
-    a_in->incoming_connections[bit] = NULL;
+    a_in->incoming_connections[bit].source_aut = NULL;
+    mark_connected(a_in, bit, false);
 }
 
 /*
@@ -413,48 +508,33 @@ void clear_the_connections(moore_t* a) {
 
     // removing the outgoing connections
     for (size_t i = 0; i < output_signals; i++) {
-        outgoing_t* current = a->outgoing_connections[i];
-
-        while (current) {
-            outgoing_t* next = current->next;
-
+        for (outgoing_t const* current = a->outgoing_connections[i]; current; current = current->next) {
             moore_t* getting_signals = current->aut_getting_signals;
             size_t const receiver = current->bit_getting_signals;
 
-            if (getting_signals->incoming_connections[receiver]) free(getting_signals->incoming_connections[receiver]);
-            getting_signals->incoming_connections[receiver] = NULL;
-
-            free(current);
-            current = next;
+            getting_signals->incoming_connections[receiver].source_aut = NULL;
+            mark_connected(getting_signals, receiver, false);
         }
+        release_outgoing(a, a->outgoing_connections[i]);
         a->outgoing_connections[i] = NULL;
     }
+
+    free_outgoing(a);
 }
 
+/*
+ * Frees the memory used by the automaton. Automata belonging to a pool are left untouched, because their buffers and
+ * structures are released together with the pool by ma_pool_delete.
+ */
 void free_automaton(moore_t* a) {
-    if (a) {
+    if (a && !a->pool) {
+        if (a->output_buffer) detach_output(a);
         if (a->input) free(a->input);
         if (a->output) free(a->output);
         if (a->state) free(a->state);
-        if (a->incoming_connections) {
-            for (size_t i = 0; i < a->input_signals_num; i++) {
-                if (a->incoming_connections[i]) {
-                    free(a->incoming_connections[i]);
-                }
-            }
-            free(a->incoming_connections);
-        }
-        if (a->outgoing_connections) {
-            for (size_t i = 0; i < a->output_signals_num; i++) {
-                outgoing_t* current = a->outgoing_connections[i];
-                while (current) {
-                    outgoing_t* next = current->next;
-                    free(current);
-                    current = next;
-                }
-            }
-            free(a->outgoing_connections);
-        }
+        if (a->incoming_connections) free(a->incoming_connections);
+        if (a->outgoing_connections) free(a->outgoing_connections);
+        free_outgoing(a);
         free(a);
     }
 }
@@ -1,11 +1,26 @@
 #ifndef MA_A_H
 #define MA_A_H
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include "ma.h"
+#include "ma_stats.h"
+
+// Attributes the allocations made until the end of the enclosing scope to the public function 'api' (see ma_stats.c).
+#ifdef MA_STATS
+#define STATS_SCOPE(api) ma_api_t const stats_previous_api __attribute__((cleanup(stats_leave))) = stats_enter(api)
+#else
+#define STATS_SCOPE(api) ((void)0)
+#endif
 
 typedef struct outgoing outgoing_t;
+typedef struct outgoing_block outgoing_block_t;
 typedef struct incoming incoming_t;
+typedef struct ma_pool ma_pool_t;
+typedef struct ma_output_buffer ma_output_buffer_t;
+typedef struct component component_t;
+typedef struct linear linear_t;
 
 typedef struct moore {
     size_t input_signals_num;
@@ -15,31 +30,135 @@ typedef struct moore {
     uint64_t* state;
     uint64_t* input;
     uint64_t* output;
+    uint64_t* next_state; // buffer for the new state used while stepping
+    uint64_t* connected;  // bit 'i' is set if the input 'i' is connected to an output, stored after the input
 
     transition_function_t transition_function;
     output_function_t output_function;
 
     outgoing_t **outgoing_connections; // Tablica list ze wskaźnikami na automaty przyjmujące bity od tego automatu
-    incoming_t **incoming_connections; // tablica wskaznikow na automaty od ktorych przyjmujemy wejscie
+    incoming_t *incoming_connections; // tablica polaczen wejsc, 'source_aut' jest NULL dla niepodlaczonego wejscia
+
+    ma_pool_t* pool; // pool owning the buffers of the automaton, NULL if the automaton owns them itself
+    ma_output_buffer_t* output_buffer; // packed buffer holding the output, NULL if the output is in its own buffer
+    component_t* component; // node of the connected component (see ma_component.c), NULL if never connected
+    atomic_uintptr_t owner; // thread stepping the automaton with ma_step_checked, used while 'component' is NULL
+    linear_t* linear; // matrices declared with ma_set_linear (see ma_linear.c), NULL if none
+    outgoing_t* spare_outgoing; // unused nodes for the outgoing connections, linked by 'next'
+    size_t spare_outgoing_num;
+    outgoing_block_t* outgoing_blocks; // allocations holding the outgoing connection nodes, freed with the automaton
 
 } moore_t;
 
+// Represents a linked list of outgoing connections from the specified bit of the automaton.
+typedef struct outgoing {
+    moore_t* aut_getting_signals;
+    size_t bit_getting_signals;
+    struct outgoing* next;
+} outgoing_t;
+
+// Outgoing connection nodes allocated at once for one automaton, which owns them until it is deleted.
+typedef struct outgoing_block {
+    struct outgoing_block* next;
+    outgoing_t nodes[];
+} outgoing_block_t;
+
+// Represents a single incoming connection to the specified bit of the automaton, 'source_aut' is NULL if the bit is not
+// connected.
+typedef struct incoming {
+    moore_t* source_aut;
+    size_t source_bit;
+} incoming_t;
+
+// Barrier of a group of threads, which can be shrunk when some of the threads that were supposed to wait on it could
+// not be started (see ma_parallel.c).
+typedef struct barrier {
+    pthread_mutex_t lock;
+    pthread_cond_t released;
+    size_t count;
+    size_t waiting;
+    size_t generation;
+} barrier_t;
+
+// Hash map from automata to their positions in an array of automata.
+typedef struct automata_index {
+    size_t capacity;
+    moore_t const** keys;
+    size_t* values;
+} automata_index_t;
+
+// Connection graph of an array of automata, vertices are the positions in the array. The sources of the vertex 'i' are
+// 'source_list[source_offsets[i]]' .. 'source_list[source_offsets[i + 1] - 1]', the targets are stored the same way.
+// Weights hold the number of connected bits of every edge.
+typedef struct automata_graph {
+    size_t num;
+    size_t* source_offsets;
+    size_t* source_list;
+    size_t* source_weights;
+    size_t* target_offsets;
+    size_t* target_list;
+    size_t* target_weights;
+} automata_graph_t;
+
 uint64_t create_bit_mask(size_t const num_bits);
+void masked_copy(uint64_t* dest, uint64_t const* src, size_t const bits);
+void masked_merge(uint64_t* dest, uint64_t const* src, uint64_t const* keep, size_t const words);
+size_t xor_diff(uint64_t* diff, uint64_t const* a, uint64_t const* b, size_t const words);
 int get_bit(uint64_t const* source, size_t const bit_index);
 void set_bit(int const bit_value, uint64_t* const array, size_t const block_index, size_t const bit_index);
+void add_bits(uint64_t* dest, size_t const position, uint64_t const* src, size_t const length);
+void extract_bits(uint64_t* dest, uint64_t const* src, size_t const position, size_t const length);
 bool allocate_automaton(moore_t* a, size_t const n, size_t const m, size_t const s);
 bool initialize_automaton(moore_t* a, size_t const n, size_t const m, size_t const s, transition_function_t const t,
                           output_function_t const y);
+void merge_input(moore_t* a, uint64_t const* input);
+void detach_output(moore_t* a);
+uint64_t* owned_output(moore_t const* a);
+void replace_owned_output(moore_t* a, uint64_t* output);
 void identity_function(uint64_t* output, uint64_t const * state, size_t m, size_t s);
 void get_input(moore_t* a);
 bool null_in_the_array(moore_t *a[], size_t const size);
 void calculate_new_state(moore_t* a);
-void create_incoming_connection(moore_t* const gets_signals, size_t const bit, moore_t* const gives_signals,
-                                size_t const source_bit);
-void create_outgoing_connection(moore_t* const gives_signals, size_t const source_bit, moore_t* const gets_signals,
-                                size_t const bit);
+void apply_transition(moore_t* a, uint64_t* next_state);
+void compute_next_state(moore_t* a, uint64_t* next_state);
+void store_next_state(moore_t* a, uint64_t const* next_state);
+void compute_output(moore_t* a);
+void mask_output(moore_t* a);
+bool reserve_outgoing(moore_t* a, size_t const num);
+outgoing_t* take_outgoing(moore_t* a);
+void release_outgoing(moore_t* a, outgoing_t* nodes);
+void link_incoming(moore_t* const gets_signals, size_t const bit, moore_t* const gives_signals,
+                   size_t const source_bit);
+bool link_outgoing(moore_t* const gives_signals, size_t const source_bit, moore_t* const gets_signals, size_t const bit,
+                   outgoing_t* node);
 void remove_the_connection(moore_t* a_in, size_t const bit);
 void clear_the_connections(moore_t* a);
 void free_automaton(moore_t* a);
+bool join_components(moore_t* a, moore_t* b);
+void leave_component(moore_t* a);
+void forget_linear(moore_t* a);
+
+extern atomic_bool profiling; // set while ma_step is profiled (see ma_profile.c)
+extern atomic_bool perf_sampling; // set while hardware counters of ma_step are sampled (see ma_perf.c)
+
+void profile_step(moore_t* at[], size_t const num);
+void profile_forget(moore_t const* a);
+bool perf_begin(void);
+void perf_gathered(void);
+void perf_end(void);
+ma_api_t stats_enter(ma_api_t const api);
+void stats_leave(ma_api_t const* previous);
+
+bool build_index(automata_index_t* index, moore_t* const at[], size_t const num);
+size_t find_index(automata_index_t const* index, moore_t const* a);
+void free_index(automata_index_t* index);
+bool build_graph(automata_graph_t* g, moore_t* const at[], size_t const num);
+void free_graph(automata_graph_t* g);
+bool compute_order(automata_graph_t const* g, size_t* order);
+bool partition_graph(automata_graph_t const* g, size_t const parts, size_t* part_of);
+void barrier_init(barrier_t* b, size_t const count);
+void barrier_destroy(barrier_t* b);
+void barrier_wait(barrier_t* b);
+void barrier_resize(barrier_t* b, size_t const count);
 
 #endif //MA_A_H
@@ -0,0 +1,283 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Asynchronous stepping. An executor owns a fixed number of threads and a queue of jobs, each job being 'steps' calls
+ * of ma_step on one array of automata. A thread takes the job from the head of the queue, performs at most 'quantum'
+ * steps of it and puts it back at the tail, so many networks share the threads in a round-robin way and a long job
+ * does not hold back the short ones.
+ *
+ * A finished job calls its callback, if it has one, and then adds 1 to the counter of the eventfd of the executor, so
+ * the completions can also be waited for with poll, select or epoll.
+ **/
+
+#define _GNU_SOURCE
+
+#include "ma.h"
+#include "ma_additional.h"
+#include "ma_async.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+typedef struct job {
+    struct job* next;
+    size_t steps; // steps left
+    ma_done_t done;
+    void* context;
+    size_t num;
+    moore_t* at[];
+} job_t;
+
+typedef struct ma_executor {
+    pthread_mutex_t lock;
+    pthread_cond_t queued;   // a job was queued or the executor is stopping
+    pthread_cond_t finished; // no job is queued or running
+    job_t* head;
+    job_t* tail;
+    size_t pending; // jobs queued or running
+    bool stopping;
+
+    size_t quantum;
+    int fd;
+    size_t threads_num;
+    pthread_t* threads;
+} ma_executor_t;
+
+static void push_job(ma_executor_t* ex, job_t* job) {
+    job->next = NULL;
+    if (ex->tail) {
+        ex->tail->next = job;
+    }
+    else {
+        ex->head = job;
+    }
+    ex->tail = job;
+}
+
+static job_t* pop_job(ma_executor_t* ex) {
+    job_t* job = ex->head;
+    ex->head = job->next;
+    if (!ex->head) ex->tail = NULL;
+    return job;
+}
+
+/*
+ * Reports the end of the job and frees it. Called without the lock held, as the callback may queue new jobs.
+ */
+static void finish_job(ma_executor_t* ex, job_t* job, int const error) {
+    if (job->done) job->done(job->context, error);
+    free(job);
+
+    uint64_t const one = 1;
+    ssize_t const written = write(ex->fd, &one, sizeof(one));
+    (void)written; // fails only if the counter would overflow, when the readers are long gone
+
+    pthread_mutex_lock(&ex->lock);
+    if (--ex->pending == 0) pthread_cond_broadcast(&ex->finished);
+    pthread_mutex_unlock(&ex->lock);
+}
+
+static void* worker_main(void* arg) {
+    ma_executor_t* ex = (ma_executor_t*)arg;
+
+    pthread_mutex_lock(&ex->lock);
+    for (;;) {
+        while (!ex->head && !ex->stopping) {
+            pthread_cond_wait(&ex->queued, &ex->lock);
+        }
+        if (ex->stopping) break;
+
+        job_t* job = pop_job(ex);
+        pthread_mutex_unlock(&ex->lock);
+
+        size_t const slice = job->steps < ex->quantum ? job->steps : ex->quantum;
+        int error = 0;
+        for (size_t i = 0; i < slice; i++) {
+            if (ma_step(job->at, job->num) != 0) {
+                error = errno;
+                break;
+            }
+        }
+        job->steps -= slice;
+
+        if (error != 0 || job->steps == 0) {
+            finish_job(ex, job, error);
+            pthread_mutex_lock(&ex->lock);
+        }
+        else {
+            pthread_mutex_lock(&ex->lock);
+            push_job(ex, job);
+        }
+    }
+    pthread_mutex_unlock(&ex->lock);
+
+    return NULL;
+}
+
+/*
+ * Stops and joins the first 'started' threads, finishes the queued jobs with ECANCELED and frees the executor.
+ */
+static void stop_executor(ma_executor_t* ex, size_t const started) {
+    pthread_mutex_lock(&ex->lock);
+    ex->stopping = true;
+    pthread_cond_broadcast(&ex->queued);
+    pthread_mutex_unlock(&ex->lock);
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(ex->threads[i], NULL);
+    }
+
+    while (ex->head) {
+        finish_job(ex, pop_job(ex), ECANCELED);
+    }
+
+    close(ex->fd);
+    pthread_mutex_destroy(&ex->lock);
+    pthread_cond_destroy(&ex->queued);
+    pthread_cond_destroy(&ex->finished);
+    free(ex->threads);
+    free(ex);
+}
+
+/*
+ * The function creates an executor with 'threads' threads, or as many as there are online processors if 'threads' is
+ * 0. A thread performs at most 'quantum' steps of a job before taking the next one.
+ *
+ * It returns a pointer to the executor, or NULL if 'quantum' is 0, setting errno to EINVAL, if a memory allocation
+ * error occurred, setting errno to ENOMEM, if a thread could not be started, setting errno to EAGAIN, or if the eventfd
+ * could not be created, setting errno as eventfd did.
+ */
+ma_executor_t* ma_executor_create(size_t threads, size_t quantum) {
+    if (quantum == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (threads == 0) {
+        long const online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (size_t)online : 1;
+    }
+
+    ma_executor_t* ex = (ma_executor_t*)calloc(1, sizeof(ma_executor_t));
+    if (!ex) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    ex->threads = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    if (!ex->threads) {
+        free(ex);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    ex->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (ex->fd < 0) {
+        int const error = errno;
+        free(ex->threads);
+        free(ex);
+        errno = error;
+        return NULL;
+    }
+
+    pthread_mutex_init(&ex->lock, NULL);
+    pthread_cond_init(&ex->queued, NULL);
+    pthread_cond_init(&ex->finished, NULL);
+    ex->quantum = quantum;
+    ex->threads_num = threads;
+
+    for (size_t i = 0; i < threads; i++) {
+        if (pthread_create(&ex->threads[i], NULL, worker_main, ex) != 0) {
+            stop_executor(ex, i);
+            errno = EAGAIN;
+            return NULL;
+        }
+    }
+
+    return ex;
+}
+
+/*
+ * The function queues 'steps' steps of the automata from the array 'at[]' and returns without waiting for them. The
+ * array is copied, but the automata must stay valid, and must not be stepped, changed or queued in another job, until
+ * the job is finished. Then 'done' is called with 'context', if 'done' is not NULL, on one of the threads of the
+ * executor, and the counter of the eventfd of the executor is increased by 1.
+ *
+ * It returns 0, or -1 if any pointer but 'done' and 'context' is NULL or 'num' or 'steps' is 0, setting errno to
+ * EINVAL, or if a memory allocation error occurred, setting errno to ENOMEM. In such cases, 'done' is not called.
+ */
+int ma_step_async(ma_executor_t* ex, moore_t* at[], size_t num, size_t steps, ma_done_t done, void* context) {
+    if (!ex || !at || num == 0 || steps == 0 || null_in_the_array(at, num)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    job_t* job = (job_t*)malloc(sizeof(job_t) + num * sizeof(moore_t*));
+    if (!job) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    job->steps = steps;
+    job->done = done;
+    job->context = context;
+    job->num = num;
+    memcpy(job->at, at, num * sizeof(moore_t*));
+
+    pthread_mutex_lock(&ex->lock);
+    push_job(ex, job);
+    ex->pending++;
+    pthread_cond_signal(&ex->queued);
+    pthread_mutex_unlock(&ex->lock);
+
+    return 0;
+}
+
+/*
+ * Returns the eventfd of the executor, or -1 if the pointer is NULL, setting errno to EINVAL. It becomes readable when
+ * a job is finished, and reading it returns the number of jobs finished since the last read. The descriptor is
+ * non-blocking and is closed when the executor is deleted.
+ */
+int ma_executor_fd(ma_executor_t const* ex) {
+    if (!ex) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return ex->fd;
+}
+
+/*
+ * The function waits until all jobs queued so far, and the jobs queued by their callbacks, are finished.
+ *
+ * It returns 0, or -1 if the pointer is NULL, setting errno to EINVAL.
+ */
+int ma_executor_wait(ma_executor_t* ex) {
+    if (!ex) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&ex->lock);
+    while (ex->pending != 0) {
+        pthread_cond_wait(&ex->finished, &ex->lock);
+    }
+    pthread_mutex_unlock(&ex->lock);
+
+    return 0;
+}
+
+/*
+ * The function stops the executor and frees it. The running slices of jobs are completed, and the jobs not finished
+ * yet are finished with ECANCELED, their callbacks being called by the calling thread. It must not be called from a
+ * callback. It does nothing if called with a NULL pointer.
+ */
+void ma_executor_delete(ma_executor_t* ex) {
+    if (ex) {
+        stop_executor(ex, ex->threads_num);
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef MA_ASYNC_H
+#define MA_ASYNC_H
+
+#include <stddef.h>
+#include "ma.h"
+
+// Called by the executor when the job is finished, with 'error' equal to 0 or to the errno of the failed step.
+typedef void (*ma_done_t)(void *context, int error);
+
+typedef struct ma_executor ma_executor_t;
+
+ma_executor_t * ma_executor_create(size_t threads, size_t quantum);
+int ma_step_async(ma_executor_t *ex, moore_t *at[], size_t num, size_t steps, ma_done_t done, void *context);
+int ma_executor_fd(ma_executor_t const *ex);
+int ma_executor_wait(ma_executor_t *ex);
+void ma_executor_delete(ma_executor_t *ex);
+
+#endif //MA_ASYNC_H
@@ -0,0 +1,166 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Setting the inputs of many automata at once. The whole batch is checked before any input is changed, so the inputs
+ * are either all set or none is, and then every automaton gets a single masked merge of its unconnected inputs, the
+ * same as in ma_set_input.
+ *
+ * Connecting many ranges at once works the same way: all ranges are checked and all connection nodes are reserved,
+ * with at most one allocation for every source automaton, before the first connection is changed, so a failed call
+ * leaves the network as it was.
+ **/
+
+#include "ma.h"
+#include "ma_additional.h"
+#include "ma_batch.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+#define FILL_THE_BLOCK 63
+#define BITS_PER_BLOCK 64
+
+static bool valid_batch(moore_t* at[], size_t const num) {
+    if (!at || num == 0) return false;
+
+    for (size_t i = 0; i < num; i++) {
+        if (!at[i] || at[i]->input_signals_num == 0) return false;
+    }
+
+    return true;
+}
+
+/*
+ * The function sets the unconnected inputs of every automaton 'at[i]' to the values of 'inputs[i]', like ma_set_input
+ * called for every automaton.
+ *
+ * It returns 0, or -1 if any pointer is NULL, 'num' is 0, or any of the automata has no inputs, setting errno to
+ * EINVAL. In such cases, no input is changed.
+ */
+int ma_set_inputs(moore_t* at[], uint64_t const* const inputs[], size_t num) {
+    if (!inputs || !valid_batch(at, num)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        if (!inputs[i]) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        merge_input(at[i], inputs[i]);
+    }
+
+    return 0;
+}
+
+/*
+ * The function sets the unconnected inputs of every automaton 'at[i]' to the values stored in 'buffer' starting from
+ * the block 'offsets[i]'. If 'offsets' is NULL, the inputs are stored one after another, each taking as many blocks
+ * as the automaton has input signals.
+ *
+ * It returns 0, or -1 if 'at' or 'buffer' is NULL, 'num' is 0, or any of the automata is NULL or has no inputs,
+ * setting errno to EINVAL. In such cases, no input is changed.
+ */
+int ma_set_inputs_packed(moore_t* at[], uint64_t const* buffer, size_t const* offsets, size_t num) {
+    if (!buffer || !valid_batch(at, num)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0; i < num; i++) {
+        if (offsets) offset = offsets[i];
+        merge_input(at[i], buffer + offset);
+        offset += (at[i]->input_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+    }
+
+    return 0;
+}
+
+/*
+ * Reserves the outgoing connection nodes of all ranges, one allocation for every source automaton. Returns false if a
+ * memory allocation error occurs, the nodes reserved until then stay with their automata.
+ */
+static bool reserve_sources(ma_edge_range_t const* edges, size_t const count) {
+    moore_t** sources = (moore_t**)malloc(count * sizeof(moore_t*));
+    size_t* needed = (size_t*)calloc(count, sizeof(size_t));
+    automata_index_t index = {0};
+    bool ok = sources && needed;
+
+    if (ok) {
+        for (size_t e = 0; e < count; e++) {
+            sources[e] = edges[e].a_out;
+        }
+        ok = build_index(&index, sources, count);
+    }
+
+    // the nodes of every source are counted at its first range
+    for (size_t e = 0; ok && e < count; e++) {
+        needed[find_index(&index, sources[e])] += edges[e].num;
+    }
+    for (size_t e = 0; ok && e < count; e++) {
+        if (needed[e] != 0) ok = reserve_outgoing(sources[e], needed[e]);
+    }
+
+    free_index(&index);
+    free(sources);
+    free(needed);
+    return ok;
+}
+
+/*
+ * The function connects all ranges of signals described by 'edges', like ma_connect called for every range in the
+ * order of the array, so a later range overrides an earlier one connecting the same input.
+ *
+ * It returns 0, or -1 if 'edges' is NULL, 'count' is 0, or any range has a NULL pointer, 'num' equal to 0 or an
+ * invalid range of signals, setting errno to EINVAL, or if a memory allocation error occurred, setting errno to
+ * ENOMEM. In such cases, no connection is changed.
+ */
+int ma_connect_many(ma_edge_range_t const* edges, size_t count) {
+    if (!edges || count == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (size_t e = 0; e < count; e++) {
+        ma_edge_range_t const* edge = &edges[e];
+        if (!edge->a_in || !edge->a_out || edge->num == 0 || edge->in + edge->num > edge->a_in->input_signals_num ||
+            edge->out + edge->num > edge->a_out->output_signals_num) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    if (!reserve_sources(edges, count)) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // joining components only makes them larger, which they are allowed to be, so it may fail halfway
+    for (size_t e = 0; e < count; e++) {
+        if (!join_components(edges[e].a_in, edges[e].a_out)) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    for (size_t e = 0; e < count; e++) {
+        ma_edge_range_t const* edge = &edges[e];
+
+        for (size_t i = 0; i < edge->num; i++) {
+            outgoing_t* node = take_outgoing(edge->a_out);
+
+            remove_the_connection(edge->a_in, edge->in + i);
+            link_incoming(edge->a_in, edge->in + i, edge->a_out, edge->out + i);
+            if (!link_outgoing(edge->a_out, edge->out + i, edge->a_in, edge->in + i, node)) {
+                release_outgoing(edge->a_out, node);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef MA_BATCH_H
+#define MA_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ma.h"
+
+// Connection of the inputs 'in' .. 'in + num - 1' of 'a_in' to the outputs 'out' .. 'out + num - 1' of 'a_out'.
+typedef struct ma_edge_range {
+    moore_t *a_in;
+    size_t in;
+    moore_t *a_out;
+    size_t out;
+    size_t num;
+} ma_edge_range_t;
+
+int ma_set_inputs(moore_t *at[], uint64_t const *const inputs[], size_t num);
+int ma_set_inputs_packed(moore_t *at[], uint64_t const *buffer, size_t const *offsets, size_t num);
+int ma_connect_many(ma_edge_range_t const *edges, size_t count);
+
+#endif //MA_BATCH_H
@@ -0,0 +1,481 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Benchmark suite of the library. Every workload builds a network, wires it, steps it, rewires it and deletes it,
+ * measuring the time and the number of memory allocations of every phase. Workloads run in separate processes, so the
+ * reported peak resident set size belongs to the workload alone. The results are printed as JSON.
+ *
+ * Allocations are counted through the wrappers of malloc and friends defined below, which the library is linked
+ * against with -Wl,--wrap (see the makefile). When the library is built with MA_STATS, it provides the wrappers itself
+ * and the benchmark reads its counters instead, reporting also the number of allocated bytes.
+ *
+ * Usage: ma_bench [--scale N] [--steps N] [--seed N] [--output FILE] [workload...]
+ **/
+
+#define _GNU_SOURCE
+
+#include "ma.h"
+#include "ma_stats.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// Allocation counters, read at the start and at the end of every phase.
+typedef struct counters {
+    size_t allocations;
+    size_t frees;
+    size_t allocated_bytes;
+} counters_t;
+
+#ifdef MA_STATS
+
+// The library counts its allocations itself (see ma_stats.h).
+static counters_t read_counters(void) {
+    counters_t c = {0, 0, 0};
+    ma_stats_t stats;
+
+    if (ma_stats_get(&stats) == 0) {
+        for (size_t api = 0; api < MA_API_COUNT; api++) {
+            c.allocations += stats.api[api].allocations;
+            c.frees += stats.api[api].frees;
+            c.allocated_bytes += stats.api[api].allocated_bytes;
+        }
+    }
+
+    return c;
+}
+
+#else
+
+static size_t allocations;
+static size_t frees;
+
+void* __wrap_malloc(size_t size) {
+    allocations++;
+    return malloc(size);
+}
+
+void* __wrap_calloc(size_t num, size_t size) {
+    allocations++;
+    return calloc(num, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    allocations++;
+    return realloc(ptr, size);
+}
+
+void* __wrap_reallocarray(void* ptr, size_t num, size_t size) {
+    allocations++;
+    return reallocarray(ptr, num, size);
+}
+
+char* __wrap_strdup(char const* s) {
+    allocations++;
+    return strdup(s);
+}
+
+char* __wrap_strndup(char const* s, size_t size) {
+    allocations++;
+    return strndup(s, size);
+}
+
+void __wrap_free(void* ptr) {
+    if (ptr) frees++;
+    free(ptr);
+}
+
+static counters_t read_counters(void) {
+    counters_t const c = {allocations, frees, 0};
+    return c;
+}
+
+#endif
+
+// A connection made while wiring, replayed when rewiring.
+typedef struct edge {
+    moore_t* a_in;
+    size_t in;
+    moore_t* a_out;
+    size_t out;
+    size_t num;
+} edge_t;
+
+typedef struct network {
+    moore_t** at;
+    size_t num;
+    edge_t* edges;
+    size_t edges_num;
+    size_t edges_capacity;
+    size_t connected_bits;
+    size_t side; // of the grid
+    uint64_t seed;
+} network_t;
+
+typedef struct workload {
+    char const* name;
+    void (*create)(network_t* net, size_t scale);
+    void (*wire)(network_t* net);
+} workload_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t next_random(network_t* net) {
+    net->seed ^= net->seed << 13;
+    net->seed ^= net->seed >> 7;
+    net->seed ^= net->seed << 17;
+    return net->seed;
+}
+
+static void fail(char const* what) {
+    perror(what);
+    exit(EXIT_FAILURE);
+}
+
+static void allocate_network(network_t* net, size_t const num) {
+    net->num = num;
+    net->at = (moore_t**)calloc(num, sizeof(moore_t*));
+    if (!net->at) fail("calloc");
+}
+
+static void add_automaton(network_t* net, size_t const i, moore_t* a) {
+    if (!a) fail("ma_create");
+    net->at[i] = a;
+}
+
+static void wire_bits(network_t* net, moore_t* a_in, size_t const in, moore_t* a_out, size_t const out,
+                      size_t const num) {
+    if (net->edges_num == net->edges_capacity) {
+        net->edges_capacity = net->edges_capacity ? 2 * net->edges_capacity : 1024;
+        net->edges = (edge_t*)realloc(net->edges, net->edges_capacity * sizeof(edge_t));
+        if (!net->edges) fail("realloc");
+    }
+
+    if (ma_connect(a_in, in, a_out, out, num) != 0) fail("ma_connect");
+
+    edge_t const e = {a_in, in, a_out, out, num};
+    net->edges[net->edges_num++] = e;
+    net->connected_bits += num;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// transition functions
+
+static void count_up(uint64_t* next_state, uint64_t const* input, uint64_t const* state, size_t n, size_t s) {
+    (void)s;
+    next_state[0] = state[0] + 1 + (n ? (input[0] & 1) : 0);
+}
+
+static void shift_in(uint64_t* next_state, uint64_t const* input, uint64_t const* state, size_t n, size_t s) {
+    (void)state;
+    (void)s;
+    memcpy(next_state, input, (n + 63) / 64 * sizeof(uint64_t));
+}
+
+static void majority(uint64_t* next_state, uint64_t const* input, uint64_t const* state, size_t n, size_t s) {
+    (void)n;
+    (void)s;
+    int const alive = __builtin_popcountll(input[0] & 0xF) + (int)(state[0] & 1);
+    next_state[0] = alive >= 3;
+}
+
+static void toggle(uint64_t* next_state, uint64_t const* input, uint64_t const* state, size_t n, size_t s) {
+    (void)input;
+    (void)n;
+    (void)s;
+    next_state[0] = ~state[0] & 1;
+}
+
+static void mix(uint64_t* next_state, uint64_t const* input, uint64_t const* state, size_t n, size_t s) {
+    (void)s;
+    uint64_t const x = (state[0] ^ (n ? input[0] : 0)) * 0x9E3779B97F4A7C15ULL;
+    next_state[0] = x ^ (x >> 29);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// workloads
+
+// Ring of 8-bit counters, every counter reads the top bit of the previous one.
+static void create_ring(network_t* net, size_t const scale) {
+    allocate_network(net, 1000 * scale);
+    for (size_t i = 0; i < net->num; i++) {
+        add_automaton(net, i, ma_create_simple(1, 8, count_up));
+    }
+}
+
+static void wire_ring(network_t* net) {
+    for (size_t i = 0; i < net->num; i++) {
+        wire_bits(net, net->at[i], 0, net->at[(i + net->num - 1) % net->num], 7, 1);
+    }
+}
+
+// Chain of 64-bit registers closed into a loop, every register takes the whole output of the previous one.
+static void create_shift(network_t* net, size_t const scale) {
+    allocate_network(net, 1000 * scale);
+    for (size_t i = 0; i < net->num; i++) {
+        add_automaton(net, i, ma_create_simple(64, 64, shift_in));
+        uint64_t const pattern = next_random(net);
+        ma_set_state(net->at[i], &pattern);
+    }
+}
+
+static void wire_shift(network_t* net) {
+    for (size_t i = 0; i < net->num; i++) {
+        wire_bits(net, net->at[i], 0, net->at[(i + net->num - 1) % net->num], 0, 64);
+    }
+}
+
+// Square torus of cells, every cell reads its four neighbours.
+static void create_grid(network_t* net, size_t const scale) {
+    size_t side = 1;
+    while (side * side < 10000 * scale) side++;
+
+    net->side = side;
+    allocate_network(net, side * side);
+    for (size_t i = 0; i < net->num; i++) {
+        uint64_t const alive = next_random(net) & 1;
+        add_automaton(net, i, ma_create_simple(4, 1, majority));
+        ma_set_state(net->at[i], &alive);
+    }
+}
+
+static void wire_grid(network_t* net) {
+    size_t const side = net->side;
+    for (size_t y = 0; y < side; y++) {
+        for (size_t x = 0; x < side; x++) {
+            moore_t* cell = net->at[y * side + x];
+            wire_bits(net, cell, 0, net->at[y * side + (x + 1) % side], 0, 1);
+            wire_bits(net, cell, 1, net->at[y * side + (x + side - 1) % side], 0, 1);
+            wire_bits(net, cell, 2, net->at[((y + 1) % side) * side + x], 0, 1);
+            wire_bits(net, cell, 3, net->at[((y + side - 1) % side) * side + x], 0, 1);
+        }
+    }
+}
+
+// Clock tree: one clock drives 64 buffers, every buffer drives 64 * scale leaves.
+static void create_clock(network_t* net, size_t const scale) {
+    allocate_network(net, 1 + 64 + 64 * 64 * scale);
+    add_automaton(net, 0, ma_create_simple(0, 1, toggle));
+    for (size_t i = 1; i < net->num; i++) {
+        add_automaton(net, i, ma_create_simple(1, 1, shift_in));
+    }
+}
+
+static void wire_clock(network_t* net) {
+    for (size_t b = 0; b < 64; b++) {
+        wire_bits(net, net->at[1 + b], 0, net->at[0], 0, 1);
+    }
+    for (size_t i = 65; i < net->num; i++) {
+        wire_bits(net, net->at[i], 0, net->at[1 + (i - 65) % 64], 0, 1);
+    }
+}
+
+// Random acyclic network, every input bit reads a random output bit of an earlier automaton.
+static void create_dag(network_t* net, size_t const scale) {
+    allocate_network(net, 5000 * scale);
+    for (size_t i = 0; i < net->num; i++) {
+        add_automaton(net, i, ma_create_simple(i == 0 ? 0 : 8, 8, mix));
+    }
+}
+
+static void wire_dag(network_t* net) {
+    for (size_t i = 1; i < net->num; i++) {
+        for (size_t bit = 0; bit < 8; bit++) {
+            wire_bits(net, net->at[i], bit, net->at[next_random(net) % i], next_random(net) % 8, 1);
+        }
+    }
+}
+
+static workload_t const workloads[] = {
+    {"ring_counters", create_ring, wire_ring},
+    {"shift_chain", create_shift, wire_shift},
+    {"grid_2d", create_grid, wire_grid},
+    {"clock_tree", create_clock, wire_clock},
+    {"random_dag", create_dag, wire_dag},
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+typedef struct phase {
+    uint64_t ns;
+    counters_t counters;
+} phase_t;
+
+static phase_t start_phase(void) {
+    phase_t const p = {now_ns(), read_counters()};
+    return p;
+}
+
+static void end_phase(phase_t* p) {
+    counters_t const c = read_counters();
+    p->ns = now_ns() - p->ns;
+    p->counters.allocations = c.allocations - p->counters.allocations;
+    p->counters.frees = c.frees - p->counters.frees;
+    p->counters.allocated_bytes = c.allocated_bytes - p->counters.allocated_bytes;
+}
+
+static void print_phase(FILE* out, char const* name, phase_t const* p, bool const last) {
+    fprintf(out, "    \"%s\": {\"ns\": %llu, \"allocations\": %zu, \"frees\": %zu", name,
+            (unsigned long long)p->ns, p->counters.allocations, p->counters.frees);
+#ifdef MA_STATS
+    fprintf(out, ", \"allocated_bytes\": %zu", p->counters.allocated_bytes);
+#endif
+    fprintf(out, "}%s\n", last ? "" : ",");
+}
+
+/*
+ * Runs the workload and prints its results as a JSON object. Called in a child process.
+ */
+static void run_workload(FILE* out, workload_t const* w, size_t const scale, size_t const steps, uint64_t const seed) {
+    network_t net;
+    memset(&net, 0, sizeof(net));
+    net.seed = seed;
+
+    phase_t create = start_phase();
+    w->create(&net, scale);
+    end_phase(&create);
+
+    phase_t wire = start_phase();
+    w->wire(&net);
+    end_phase(&wire);
+
+    phase_t step = start_phase();
+    for (size_t s = 0; s < steps; s++) {
+        if (ma_step(net.at, net.num) != 0) fail("ma_step");
+    }
+    end_phase(&step);
+
+    phase_t disconnect = start_phase();
+    for (size_t e = 0; e < net.edges_num; e++) {
+        if (ma_disconnect(net.edges[e].a_in, net.edges[e].in, net.edges[e].num) != 0) fail("ma_disconnect");
+    }
+    end_phase(&disconnect);
+
+    phase_t reconnect = start_phase();
+    for (size_t e = 0; e < net.edges_num; e++) {
+        edge_t const* x = &net.edges[e];
+        if (ma_connect(x->a_in, x->in, x->a_out, x->out, x->num) != 0) fail("ma_connect");
+    }
+    end_phase(&reconnect);
+
+    phase_t teardown = start_phase();
+    for (size_t i = 0; i < net.num; i++) {
+        ma_delete(net.at[i]);
+    }
+    end_phase(&teardown);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    double const step_seconds = (double)step.ns / 1e9;
+    double const automaton_steps = (double)steps * (double)net.num;
+
+    fprintf(out, "  {\n");
+    fprintf(out, "    \"workload\": \"%s\",\n", w->name);
+    fprintf(out, "    \"automata\": %zu,\n", net.num);
+    fprintf(out, "    \"connect_calls\": %zu,\n", net.edges_num);
+    fprintf(out, "    \"connected_bits\": %zu,\n", net.connected_bits);
+    fprintf(out, "    \"steps\": %zu,\n", steps);
+    fprintf(out, "    \"steps_per_sec\": %.1f,\n", step_seconds > 0 ? (double)steps / step_seconds : 0.0);
+    fprintf(out, "    \"ns_per_automaton_step\": %.2f,\n", automaton_steps > 0 ? (double)step.ns / automaton_steps : 0.0);
+    fprintf(out, "    \"connect_per_sec\": %.1f,\n",
+            reconnect.ns > 0 ? (double)net.edges_num * 1e9 / (double)reconnect.ns : 0.0);
+    fprintf(out, "    \"disconnect_per_sec\": %.1f,\n",
+            disconnect.ns > 0 ? (double)net.edges_num * 1e9 / (double)disconnect.ns : 0.0);
+    fprintf(out, "    \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+    print_phase(out, "create", &create, false);
+    print_phase(out, "wire", &wire, false);
+    print_phase(out, "step", &step, false);
+    print_phase(out, "disconnect", &disconnect, false);
+    print_phase(out, "reconnect", &reconnect, false);
+    print_phase(out, "teardown", &teardown, true);
+    fprintf(out, "  }");
+
+    free(net.at);
+    free(net.edges);
+}
+
+static size_t parse_size(char const* value) {
+    char* end;
+    unsigned long long const parsed = strtoull(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || parsed == 0) {
+        fprintf(stderr, "invalid number: %s\n", value);
+        exit(EXIT_FAILURE);
+    }
+    return (size_t)parsed;
+}
+
+int main(int argc, char* argv[]) {
+    size_t scale = 1;
+    size_t steps = 100;
+    uint64_t seed = 0x2545F4914F6CDD1DULL;
+    char const* output = NULL;
+    bool selected[sizeof(workloads) / sizeof(workloads[0])] = {false};
+    bool any_selected = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) scale = parse_size(argv[++i]);
+        else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) steps = parse_size(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = parse_size(argv[++i]);
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) output = argv[++i];
+        else {
+            bool found = false;
+            for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+                if (strcmp(argv[i], workloads[w].name) == 0) {
+                    selected[w] = true;
+                    any_selected = found = true;
+                }
+            }
+            if (!found) {
+                fprintf(stderr, "usage: %s [--scale N] [--steps N] [--seed N] [--output FILE] [workload...]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out) fail(output);
+
+    fprintf(out, "{\n\"scale\": %zu,\n\"steps\": %zu,\n\"seed\": %llu,\n\"results\": [\n", scale, steps,
+            (unsigned long long)seed);
+
+    bool first = true;
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+        if (any_selected && !selected[w]) continue;
+
+        if (!first) fprintf(out, ",\n");
+        first = false;
+        fflush(out);
+
+        // every workload runs in its own process, so that the peak RSS is its own
+        pid_t const pid = fork();
+        if (pid < 0) fail("fork");
+        if (pid == 0) {
+            run_workload(out, &workloads[w], scale, steps, seed);
+            fflush(out);
+            _exit(EXIT_SUCCESS);
+        }
+
+        int status;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            fprintf(stderr, "workload %s failed\n", workloads[w].name);
+            return EXIT_FAILURE;
+        }
+    }
+
+    fprintf(out, "\n]\n}\n");
+    if (out != stdout) fclose(out);
+
+    return EXIT_SUCCESS;
+}
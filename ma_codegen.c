@@ -0,0 +1,629 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Code generation backend for networks which do not change once they are built. The generator emits a C source with
+ * one step function over a flat array of blocks, holding the input, state, next state and output of every automaton
+ * one after another. Every connected input block is assembled with constant offsets, shifts and masks, and the
+ * transition and output functions are called by their names. The source is compiled with the system compiler into a
+ * shared object, which is loaded with dlopen and steps the network in place of ma_step.
+ *
+ * A callback is called directly if dladdr finds a global symbol at its address which dlsym resolves back to it, e.g. a
+ * function of a shared library or of a program linked with -rdynamic. Other callbacks, like static functions, are
+ * called through a table passed to the step function. The output function of ma_create_simple is inlined as a copy.
+ *
+ * The generated step is split into functions of CHUNK automata each, so the compiler is never given one function
+ * with the whole network. The compiler is "gcc" unless the MA_CC environment variable names another one.
+ **/
+
+#define _GNU_SOURCE
+
+#include "ma.h"
+#include "ma_additional.h"
+#include "ma_codegen.h"
+
+#include <ctype.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define FILL_THE_BLOCK 63
+#define BITS_PER_BLOCK 64
+#define NOT_FOUND ((size_t)-1)
+#define CHUNK 256
+#define PREFIX "ma_fused_"
+#define WORDS PREFIX "w" // name of the flat array in the generated source
+
+extern char** environ;
+
+typedef void (*callback_function_t)(void);
+typedef void (*fused_step_t)(uint64_t*, size_t, callback_function_t const*);
+
+// Transition or output function of some of the automata, called by 'name', or through 'table[slot]' if 'name' is
+// NULL.
+typedef struct callback {
+    callback_function_t function;
+    bool transition;
+    char const* name;
+    size_t slot;
+} callback_t;
+
+typedef struct ma_codegen {
+    moore_t** at;
+    size_t num;
+    moore_t** external; // automata outside the array read by its automata
+    size_t external_num;
+    automata_index_t index;
+    automata_index_t external_index;
+
+    size_t* base; // the blocks of 'at[i]' start at 'words[base[i]]': input, state, next state and output
+    size_t* external_base; // the output of 'external[j]' starts at 'words[external_base[j]]'
+    size_t blocks;
+    uint64_t* words;
+
+    callback_t* callbacks;
+    size_t callbacks_num;
+    callback_function_t* table;
+    size_t table_num;
+
+    void* library;
+    fused_step_t step;
+} ma_codegen_t;
+
+static void free_codegen(ma_codegen_t* g) {
+    free(g->at);
+    free(g->external);
+    free_index(&g->index);
+    free_index(&g->external_index);
+    free(g->base);
+    free(g->external_base);
+    free(g->words);
+    free(g->callbacks);
+    free(g->table);
+    if (g->library) dlclose(g->library);
+    free(g);
+}
+
+static size_t blocks_of(size_t const bits) {
+    return (bits + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+}
+
+static size_t state_of(ma_codegen_t const* g, size_t const i) {
+    return g->base[i] + blocks_of(g->at[i]->input_signals_num);
+}
+
+static size_t next_state_of(ma_codegen_t const* g, size_t const i) {
+    return state_of(g, i) + blocks_of(g->at[i]->state_signals_num);
+}
+
+static size_t output_of(ma_codegen_t const* g, size_t const i) {
+    return next_state_of(g, i) + blocks_of(g->at[i]->state_signals_num);
+}
+
+// Returns the first block of the output of the automaton 'a', which is in the array or outside it.
+static size_t source_of(ma_codegen_t const* g, moore_t const* a) {
+    size_t const i = find_index(&g->index, a);
+    if (i != NOT_FOUND) return output_of(g, i);
+
+    return g->external_base[find_index(&g->external_index, a)];
+}
+
+/*
+ * Returns the name under which the generated code can call 'function', or NULL if it has to be called through the
+ * table: there is no global symbol at its address, the symbol resolves to another function, or its name could clash
+ * with the names of the generated code.
+ */
+static char const* symbol_of(callback_function_t function) {
+    Dl_info info;
+
+    if (!dladdr((void*)function, &info) || !info.dli_sname || info.dli_saddr != (void*)function) return NULL;
+
+    char const* name = info.dli_sname;
+    if (strncmp(name, PREFIX, strlen(PREFIX)) == 0 || isdigit((unsigned char)name[0])) return NULL;
+    for (char const* c = name; *c; c++) {
+        if (!isalnum((unsigned char)*c) && *c != '_') return NULL;
+    }
+
+    return dlsym(RTLD_DEFAULT, name) == (void*)function ? name : NULL;
+}
+
+static callback_t const* find_callback(ma_codegen_t const* g, callback_function_t function) {
+    for (size_t k = 0; k < g->callbacks_num; k++) {
+        if (g->callbacks[k].function == function) return &g->callbacks[k];
+    }
+
+    return NULL;
+}
+
+static void add_callback(ma_codegen_t* g, callback_function_t function, bool const transition) {
+    if (find_callback(g, function)) return;
+
+    callback_t* c = &g->callbacks[g->callbacks_num++];
+    c->function = function;
+    c->transition = transition;
+    c->name = symbol_of(function);
+    c->slot = NOT_FOUND;
+
+    if (!c->name) {
+        c->slot = g->table_num;
+        g->table[g->table_num++] = function;
+    }
+}
+
+static bool inlined_output(moore_t const* a) {
+    return a->output_function == identity_function && a->output_signals_num == a->state_signals_num;
+}
+
+/*
+ * Finds the automata outside the array read by the automata of the array, lays out the flat array and collects the
+ * callbacks. Returns false and sets errno to ENOMEM if a memory allocation error occurs.
+ */
+static bool lay_out(ma_codegen_t* g) {
+    size_t candidates = 0;
+
+    for (size_t i = 0; i < g->num; i++) {
+        moore_t const* a = g->at[i];
+        for (size_t bit = 0; bit < a->input_signals_num; bit++) {
+            moore_t const* source = a->incoming_connections[bit].source_aut;
+            if (source && find_index(&g->index, source) == NOT_FOUND) candidates++;
+        }
+    }
+
+    g->external = (moore_t**)malloc((candidates + 1) * sizeof(moore_t*));
+    g->base = (size_t*)malloc(g->num * sizeof(size_t));
+    g->callbacks = (callback_t*)malloc(2 * g->num * sizeof(callback_t));
+    g->table = (callback_function_t*)malloc(2 * g->num * sizeof(callback_function_t));
+    if (!g->external || !g->base || !g->callbacks || !g->table) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    for (size_t i = 0; i < g->num; i++) {
+        moore_t* a = g->at[i];
+        for (size_t bit = 0; bit < a->input_signals_num; bit++) {
+            moore_t* source = a->incoming_connections[bit].source_aut;
+            if (source && find_index(&g->index, source) == NOT_FOUND) g->external[g->external_num++] = source;
+        }
+    }
+
+    if (!build_index(&g->external_index, g->external, g->external_num)) return false;
+
+    // duplicates among the external automata share the slot of the first occurrence
+    size_t unique = 0;
+    for (size_t j = 0; j < g->external_num; j++) {
+        if (find_index(&g->external_index, g->external[j]) == j) g->external[unique++] = g->external[j];
+    }
+    g->external_num = unique;
+    free_index(&g->external_index);
+
+    g->external_base = (size_t*)malloc((unique + 1) * sizeof(size_t));
+    if (!g->external_base || !build_index(&g->external_index, g->external, unique)) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    for (size_t i = 0; i < g->num; i++) {
+        moore_t const* a = g->at[i];
+        g->base[i] = g->blocks;
+        g->blocks += blocks_of(a->input_signals_num) + 2 * blocks_of(a->state_signals_num) +
+                     blocks_of(a->output_signals_num);
+
+        add_callback(g, (callback_function_t)a->transition_function, true);
+        if (!inlined_output(a)) add_callback(g, (callback_function_t)a->output_function, false);
+    }
+
+    for (size_t j = 0; j < unique; j++) {
+        g->external_base[j] = g->blocks;
+        g->blocks += blocks_of(g->external[j]->output_signals_num);
+    }
+
+    return true;
+}
+
+/*
+ * Creates the generator for the automata from the array 'at[]'. Returns NULL and sets errno to EINVAL if any pointer
+ * is NULL, 'num' is 0 or an automaton occurs twice, or to ENOMEM if a memory allocation error occurs.
+ */
+static ma_codegen_t* plan(moore_t* at[], size_t const num) {
+    if (!at || num == 0 || null_in_the_array(at, num)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ma_codegen_t* g = (ma_codegen_t*)calloc(1, sizeof(ma_codegen_t));
+    if (!g) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    g->num = num;
+    g->at = (moore_t**)malloc(num * sizeof(moore_t*));
+    if (!g->at) {
+        free_codegen(g);
+        errno = ENOMEM;
+        return NULL;
+    }
+    memcpy(g->at, at, num * sizeof(moore_t*));
+
+    bool ok = build_index(&g->index, g->at, num);
+
+    for (size_t i = 0; ok && i < num; i++) {
+        if (find_index(&g->index, g->at[i]) != i) {
+            ok = false;
+            errno = EINVAL;
+        }
+    }
+
+    if (!ok || !lay_out(g)) {
+        free_codegen(g);
+        return NULL;
+    }
+
+    return g;
+}
+
+// Emits the term of an expression taking 'length' bits of the block 'source' from the bit 'from', moved to 'to'.
+static void emit_piece(FILE* out, size_t const source, size_t const from, size_t const to, size_t const length) {
+    if (length == BITS_PER_BLOCK) {
+        fprintf(out, WORDS "[%zu]", source);
+        return;
+    }
+
+    fprintf(out, "(");
+    if (from == 0) {
+        fprintf(out, "(" WORDS "[%zu]", source);
+    }
+    else {
+        fprintf(out, "(" WORDS "[%zu] >> %zu", source, from);
+    }
+    if (from + length < BITS_PER_BLOCK) {
+        fprintf(out, " & UINT64_C(0x%" PRIx64 ")", create_bit_mask(length));
+    }
+    fprintf(out, ")");
+    if (to != 0) fprintf(out, " << %zu", to);
+    fprintf(out, ")");
+}
+
+/*
+ * Emits the statements reading the connected inputs of 'at[i]'. Every input block holding a connected bit is
+ * assembled from its unconnected bits and pieces of the source blocks, a piece being a sequence of consecutive bits
+ * read from consecutive bits of one block.
+ */
+static void emit_gather(ma_codegen_t const* g, size_t const i, FILE* out) {
+    moore_t const* a = g->at[i];
+    incoming_t const* connections = a->incoming_connections;
+
+    for (size_t block = 0; block < blocks_of(a->input_signals_num); block++) {
+        size_t const first = block * BITS_PER_BLOCK;
+        size_t const end = a->input_signals_num < first + BITS_PER_BLOCK ? a->input_signals_num
+                                                                        : first + BITS_PER_BLOCK;
+        uint64_t connected = 0;
+        for (size_t bit = first; bit < end; bit++) {
+            if (connections[bit].source_aut) connected |= 1ULL << (bit - first);
+        }
+        if (connected == 0) continue;
+
+        fprintf(out, "    " WORDS "[%zu] = ", g->base[i] + block);
+        bool joined = ~connected != 0; // the unconnected bits are kept
+        if (joined) fprintf(out, "(" WORDS "[%zu] & UINT64_C(0x%" PRIx64 "))", g->base[i] + block, ~connected);
+
+        for (size_t bit = first; bit < end;) {
+            moore_t const* source = connections[bit].source_aut;
+            if (!source) {
+                bit++;
+                continue;
+            }
+
+            size_t const source_bit = connections[bit].source_bit;
+            size_t length = 1;
+            while (bit + length < end && (source_bit + length) % BITS_PER_BLOCK != 0 &&
+                   connections[bit + length].source_aut == source &&
+                   connections[bit + length].source_bit == source_bit + length) {
+                length++;
+            }
+
+            if (joined) fprintf(out, " | ");
+            joined = true;
+            emit_piece(out, source_of(g, source) + source_bit / BITS_PER_BLOCK, source_bit % BITS_PER_BLOCK,
+                       bit - first, length);
+            bit += length;
+        }
+
+        fprintf(out, ";\n");
+    }
+}
+
+static void emit_call(callback_t const* c, FILE* out) {
+    if (c->name) {
+        fprintf(out, "    %s(", c->name);
+    }
+    else {
+        fprintf(out, "    ((" PREFIX "%s_t)" PREFIX "table[%zu])(", c->transition ? "transition" : "output", c->slot);
+    }
+}
+
+// Emits the copy of 'bits' bits from the block 'src' to the block 'dest', masking the last block.
+static void emit_copy(FILE* out, size_t const dest, size_t const src, size_t const bits) {
+    size_t const blocks = blocks_of(bits);
+
+    for (size_t k = 0; k < blocks; k++) {
+        fprintf(out, "    " WORDS "[%zu] = " WORDS "[%zu]", dest + k, src + k);
+        if (k == blocks - 1 && bits % BITS_PER_BLOCK != 0) {
+            fprintf(out, " & UINT64_C(0x%" PRIx64 ")", create_bit_mask(bits % BITS_PER_BLOCK));
+        }
+        fprintf(out, ";\n");
+    }
+}
+
+// Emits the statements computing the new state and output of 'at[i]', the same as apply_transition.
+static void emit_compute(ma_codegen_t const* g, size_t const i, FILE* out) {
+    moore_t const* a = g->at[i];
+    size_t const n = a->input_signals_num;
+    size_t const m = a->output_signals_num;
+    size_t const s = a->state_signals_num;
+
+    for (size_t k = 0; k < blocks_of(s); k++) {
+        fprintf(out, "    " WORDS "[%zu] = 0;\n", next_state_of(g, i) + k);
+    }
+
+    emit_call(find_callback(g, (callback_function_t)a->transition_function), out);
+    fprintf(out, WORDS " + %zu, " WORDS " + %zu, " WORDS " + %zu, %zu, %zu);\n", next_state_of(g, i), g->base[i],
+            state_of(g, i), n, s);
+    emit_copy(out, state_of(g, i), next_state_of(g, i), s);
+
+    if (inlined_output(a)) {
+        emit_copy(out, output_of(g, i), state_of(g, i), m);
+        return;
+    }
+
+    emit_call(find_callback(g, (callback_function_t)a->output_function), out);
+    fprintf(out, WORDS " + %zu, " WORDS " + %zu, %zu, %zu);\n", output_of(g, i), state_of(g, i), m, s);
+    if (m % BITS_PER_BLOCK != 0) {
+        fprintf(out, "    " WORDS "[%zu] &= UINT64_C(0x%" PRIx64 ");\n", output_of(g, i) + blocks_of(m) - 1,
+                create_bit_mask(m % BITS_PER_BLOCK));
+    }
+}
+
+/*
+ * Writes the source of the step function of the network to 'out'. Returns -1 and sets errno to EIO if writing
+ * fails.
+ */
+static int generate(ma_codegen_t const* g, FILE* out) {
+    size_t const chunks = (g->num + CHUNK - 1) / CHUNK;
+
+    fprintf(out, "/* step function of a network of %zu automata, generated by ma_codegen */\n\n", g->num);
+    fprintf(out, "#include <stddef.h>\n#include <stdint.h>\n\n");
+    fprintf(out, "typedef void (*" PREFIX "transition_t)(uint64_t*, uint64_t const*, uint64_t const*, size_t, "
+                 "size_t);\n");
+    fprintf(out, "typedef void (*" PREFIX "output_t)(uint64_t*, uint64_t const*, size_t, size_t);\n\n");
+
+    for (size_t k = 0; k < g->callbacks_num; k++) {
+        callback_t const* c = &g->callbacks[k];
+        if (!c->name) continue;
+
+        if (c->transition) {
+            fprintf(out, "extern void %s(uint64_t*, uint64_t const*, uint64_t const*, size_t, size_t);\n", c->name);
+        }
+        else {
+            fprintf(out, "extern void %s(uint64_t*, uint64_t const*, size_t, size_t);\n", c->name);
+        }
+    }
+
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        size_t const last = (chunk + 1) * CHUNK < g->num ? (chunk + 1) * CHUNK : g->num;
+
+        fprintf(out, "\nstatic void " PREFIX "gather_%zu(uint64_t* " WORDS ") {\n", chunk);
+        for (size_t i = chunk * CHUNK; i < last; i++) {
+            emit_gather(g, i, out);
+        }
+        fprintf(out, "}\n");
+
+        fprintf(out, "\nstatic void " PREFIX "compute_%zu(uint64_t* " WORDS ", void (*const* " PREFIX "table)(void))"
+                     " {\n    (void)" PREFIX "table;\n", chunk);
+        for (size_t i = chunk * CHUNK; i < last; i++) {
+            emit_compute(g, i, out);
+        }
+        fprintf(out, "}\n");
+    }
+
+    fprintf(out, "\nvoid " PREFIX "step(uint64_t* " WORDS ", size_t " PREFIX "steps, void (*const* " PREFIX "table)"
+                 "(void)) {\n");
+    fprintf(out, "    for (size_t " PREFIX "i = 0; " PREFIX "i < " PREFIX "steps; " PREFIX "i++) {\n");
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        fprintf(out, "        " PREFIX "gather_%zu(" WORDS ");\n", chunk);
+    }
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        fprintf(out, "        " PREFIX "compute_%zu(" WORDS ", " PREFIX "table);\n", chunk);
+    }
+    fprintf(out, "    }\n}\n");
+
+    if (ferror(out)) {
+        errno = EIO;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Runs the compiler on 'source', building the shared object 'object'. Returns false and sets errno to ENOEXEC if the
+ * compiler cannot be run or fails.
+ */
+static bool compile(char const* source, char const* object) {
+    char const* compiler = getenv("MA_CC");
+    if (!compiler || !*compiler) compiler = "gcc";
+
+    char* argv[] = {(char*)compiler, "-O2", "-fPIC", "-shared", "-o", (char*)object, (char*)source, NULL};
+    pid_t pid;
+    if (posix_spawnp(&pid, compiler, NULL, NULL, argv, environ) != 0) {
+        errno = ENOEXEC;
+        return false;
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            errno = ENOEXEC;
+            return false;
+        }
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        errno = ENOEXEC;
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Generates, compiles and loads the step function in a temporary directory, which is removed afterwards. Returns
+ * false and sets errno if any of it fails.
+ */
+static bool build(ma_codegen_t* g) {
+    char const* tmp = getenv("TMPDIR");
+    char dir[PATH_MAX];
+    char source[PATH_MAX + 16];
+    char object[PATH_MAX + 16];
+
+    snprintf(dir, sizeof(dir), "%s/ma_codegen.XXXXXX", tmp && *tmp ? tmp : "/tmp");
+    if (!mkdtemp(dir)) return false;
+    snprintf(source, sizeof(source), "%s/step.c", dir);
+    snprintf(object, sizeof(object), "%s/step.so", dir);
+
+    FILE* out = fopen(source, "w");
+    bool ok = out && generate(g, out) == 0;
+    if (out && fclose(out) != 0 && ok) {
+        ok = false;
+        errno = EIO;
+    }
+
+    ok = ok && compile(source, object);
+
+    if (ok) {
+        g->library = dlopen(object, RTLD_NOW | RTLD_LOCAL);
+        g->step = g->library ? (fused_step_t)dlsym(g->library, PREFIX "step") : NULL;
+        if (!g->step) {
+            ok = false;
+            errno = ENOEXEC;
+        }
+    }
+
+    int const error = errno;
+    unlink(source);
+    unlink(object);
+    rmdir(dir);
+    errno = error;
+
+    return ok;
+}
+
+/*
+ * The function writes to 'out' the C source of the step function which ma_codegen_create would compile for the
+ * automata from the array 'at[]'. The source refers to the callbacks by name where it can, so it only makes sense for
+ * the process which generated it.
+ *
+ * It returns 0, or -1 if any pointer is NULL, 'num' is 0, or an automaton occurs twice, setting errno to EINVAL, if a
+ * memory allocation error occurred, setting errno to ENOMEM, or if writing failed, setting errno to EIO.
+ */
+int ma_codegen_emit(moore_t* at[], size_t num, FILE* out) {
+    if (!out) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ma_codegen_t* g = plan(at, num);
+    if (!g) return -1;
+
+    int const result = generate(g, out);
+    free_codegen(g);
+
+    return result;
+}
+
+/*
+ * The function creates a compiled step engine for the automata from the array 'at[]': it generates the fused step
+ * function of the network, compiles it and loads it.
+ *
+ * The engine works on a snapshot of the connections, which must not change while the engine exists, and neither may
+ * the automata be deleted, nor the automata outside the array read by its automata. Inputs, states and outputs may be
+ * changed between the steps as usual.
+ *
+ * It returns a pointer to the engine, or NULL if any pointer is NULL, 'num' is 0, or an automaton occurs twice,
+ * setting errno to EINVAL, if a memory allocation error occurred, setting errno to ENOMEM, or if the compiler could not
+ * be run, failed, or its result could not be loaded, setting errno to ENOEXEC. Errors of creating the temporary files
+ * are reported with the errno of the failed call.
+ */
+ma_codegen_t* ma_codegen_create(moore_t* at[], size_t num) {
+    ma_codegen_t* g = plan(at, num);
+    if (!g) return NULL;
+
+    g->words = (uint64_t*)calloc(g->blocks + 1, sizeof(uint64_t));
+    if (!g->words) {
+        free_codegen(g);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (!build(g)) {
+        int const error = errno;
+        free_codegen(g);
+        errno = error;
+        return NULL;
+    }
+
+    return g;
+}
+
+/*
+ * The function performs 'steps' computation steps of all automata of the engine. The result is the same as calling
+ * ma_step 'steps' times on the array the engine was created with.
+ *
+ * It returns 0, or -1 if the pointer is NULL or 'steps' is 0, setting errno to EINVAL.
+ */
+int ma_codegen_step(ma_codegen_t* g, size_t steps) {
+    if (!g || steps == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (size_t i = 0; i < g->num; i++) {
+        moore_t const* a = g->at[i];
+        if (a->input_signals_num != 0) {
+            memcpy(g->words + g->base[i], a->input, blocks_of(a->input_signals_num) * sizeof(uint64_t));
+        }
+        memcpy(g->words + state_of(g, i), a->state, blocks_of(a->state_signals_num) * sizeof(uint64_t));
+        memcpy(g->words + output_of(g, i), a->output, blocks_of(a->output_signals_num) * sizeof(uint64_t));
+    }
+
+    for (size_t j = 0; j < g->external_num; j++) {
+        moore_t const* a = g->external[j];
+        memcpy(g->words + g->external_base[j], a->output, blocks_of(a->output_signals_num) * sizeof(uint64_t));
+    }
+
+    g->step(g->words, steps, g->table);
+
+    for (size_t i = 0; i < g->num; i++) {
+        moore_t* a = g->at[i];
+        if (a->input_signals_num != 0) {
+            memcpy(a->input, g->words + g->base[i], blocks_of(a->input_signals_num) * sizeof(uint64_t));
+        }
+        memcpy(a->state, g->words + state_of(g, i), blocks_of(a->state_signals_num) * sizeof(uint64_t));
+        memcpy(a->output, g->words + output_of(g, i), blocks_of(a->output_signals_num) * sizeof(uint64_t));
+    }
+
+    return 0;
+}
+
+/*
+ * The function frees the engine and unloads its compiled step function. The automata stay valid. It does nothing if
+ * called with a NULL pointer.
+ */
+void ma_codegen_delete(ma_codegen_t* g) {
+    if (g) free_codegen(g);
+}
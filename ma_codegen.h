@@ -0,0 +1,15 @@
+#ifndef MA_CODEGEN_H
+#define MA_CODEGEN_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "ma.h"
+
+typedef struct ma_codegen ma_codegen_t;
+
+int ma_codegen_emit(moore_t *at[], size_t num, FILE *out);
+ma_codegen_t * ma_codegen_create(moore_t *at[], size_t num);
+int ma_codegen_step(ma_codegen_t *g, size_t steps);
+void ma_codegen_delete(ma_codegen_t *g);
+
+#endif //MA_CODEGEN_H
@@ -0,0 +1,391 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Connected components of the connection graph and checked stepping. Every automaton which was ever connected points
+ * to a node of a union-find forest, and ma_connect joins the trees of both automata, so two automata sharing an edge
+ * always have the same root. Disconnecting does not split the trees, the components are only an upper bound until
+ * ma_components computes them again from the edges.
+ *
+ * The root of a component (or the automaton itself, while it was never connected) holds the owner word. ma_step_checked
+ * claims the owner words of all stepped automata with compare-and-swap before stepping and releases them afterwards,
+ * so two threads stepping the same component at the same time get EBUSY instead of a data race, and threads stepping
+ * different components never wait for each other.
+ *
+ * The nodes are reference counted by the automata and the child nodes pointing to them, so deleting an automaton never
+ * leaves a dangling parent pointer.
+ **/
+
+#include "ma.h"
+#include "ma_additional.h"
+#include "ma_component.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NOT_FOUND ((size_t)-1)
+
+struct component {
+    component_t* parent; // NULL for the root
+    size_t rank;
+    size_t refs; // automata and child nodes pointing to the node
+    atomic_uintptr_t owner; // token of the thread stepping the component, 0 if none, used in roots only
+};
+
+// Set of automata growing while the closure of the connection graph is collected, mapping them to their positions.
+typedef struct closure {
+    size_t num;
+    size_t capacity; // power of two, at least twice 'num'
+    moore_t** list;
+    moore_t** keys;
+    size_t* values;
+} closure_t;
+
+static _Thread_local char thread_token; // its address identifies the thread owning a component
+
+static component_t* new_component(size_t const refs) {
+    component_t* c = (component_t*)malloc(sizeof(component_t));
+    if (c) {
+        c->parent = NULL;
+        c->rank = 0;
+        c->refs = refs;
+        atomic_init(&c->owner, 0);
+    }
+    return c;
+}
+
+static void release_component(component_t* c) {
+    while (c && --c->refs == 0) {
+        component_t* parent = c->parent;
+        free(c);
+        c = parent;
+    }
+}
+
+static component_t* find_root(component_t* c) {
+    while (c->parent) c = c->parent;
+    return c;
+}
+
+/*
+ * Points the automaton directly at the root of its tree, so the next lookups are short. Only called while the
+ * automaton is not stepped.
+ */
+static component_t* compress(moore_t* a) {
+    component_t* root = find_root(a->component);
+    if (root != a->component) {
+        root->refs++;
+        release_component(a->component);
+        a->component = root;
+    }
+    return root;
+}
+
+/*
+ * Joins the components of the automata 'a' and 'b'. Returns false if a memory allocation error occurred, in which
+ * case nothing is changed.
+ */
+bool join_components(moore_t* a, moore_t* b) {
+    if (a == b) return true;
+
+    if (!a->component && !b->component) {
+        component_t* c = new_component(2);
+        if (!c) return false;
+        a->component = c;
+        b->component = c;
+        return true;
+    }
+
+    if (!a->component) {
+        a->component = compress(b);
+        a->component->refs++;
+        return true;
+    }
+    if (!b->component) {
+        b->component = compress(a);
+        b->component->refs++;
+        return true;
+    }
+
+    component_t* x = compress(a);
+    component_t* y = compress(b);
+    if (x == y) return true;
+
+    if (x->rank > y->rank) {
+        component_t* swap = x;
+        x = y;
+        y = swap;
+    }
+    x->parent = y;
+    y->refs++;
+    if (x->rank == y->rank) y->rank++;
+
+    return true;
+}
+
+/*
+ * Removes the automaton from its component. Called when it is deleted.
+ */
+void leave_component(moore_t* a) {
+    release_component(a->component);
+    a->component = NULL;
+}
+
+static atomic_uintptr_t* owner_of(moore_t* a) {
+    return a->component ? &find_root(a->component)->owner : &a->owner;
+}
+
+static size_t hash_automaton(moore_t const* a, size_t const capacity) {
+    uintptr_t x = (uintptr_t)a;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (size_t)x & (capacity - 1);
+}
+
+static size_t closure_find(closure_t const* c, moore_t const* a) {
+    for (size_t h = hash_automaton(a, c->capacity);; h = (h + 1) & (c->capacity - 1)) {
+        if (!c->keys[h]) return NOT_FOUND;
+        if (c->keys[h] == a) return c->values[h];
+    }
+}
+
+static void closure_put(closure_t* c, moore_t* a, size_t const value) {
+    size_t h = hash_automaton(a, c->capacity);
+    while (c->keys[h]) h = (h + 1) & (c->capacity - 1);
+    c->keys[h] = a;
+    c->values[h] = value;
+}
+
+static bool closure_grow(closure_t* c) {
+    size_t const capacity = c->capacity ? 2 * c->capacity : 64;
+    moore_t** list = (moore_t**)realloc(c->list, capacity / 2 * sizeof(moore_t*));
+    if (!list) return false;
+    c->list = list;
+
+    moore_t** keys = (moore_t**)calloc(capacity, sizeof(moore_t*));
+    size_t* values = (size_t*)malloc(capacity * sizeof(size_t));
+    if (!keys || !values) {
+        free(keys);
+        free(values);
+        return false;
+    }
+
+    free(c->keys);
+    free(c->values);
+    c->keys = keys;
+    c->values = values;
+    c->capacity = capacity;
+    for (size_t i = 0; i < c->num; i++) {
+        closure_put(c, c->list[i], i);
+    }
+
+    return true;
+}
+
+/*
+ * Adds the automaton to the closure unless it is already there. Returns false if a memory allocation error occurred.
+ */
+static bool closure_add(closure_t* c, moore_t* a) {
+    if (c->capacity && closure_find(c, a) != NOT_FOUND) return true;
+    if (2 * (c->num + 1) > c->capacity && !closure_grow(c)) return false;
+
+    c->list[c->num] = a;
+    closure_put(c, a, c->num);
+    c->num++;
+
+    return true;
+}
+
+static void free_closure(closure_t* c) {
+    free(c->list);
+    free(c->keys);
+    free(c->values);
+}
+
+static size_t find_set(size_t* parent, size_t x) {
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+static void union_sets(size_t* parent, size_t const x, size_t const y) {
+    size_t const rx = find_set(parent, x);
+    size_t const ry = find_set(parent, y);
+    if (rx < ry) {
+        parent[ry] = rx;
+    }
+    else {
+        parent[rx] = ry;
+    }
+}
+
+/*
+ * Collects all automata reachable from 'at' through connections in either direction and joins the sets of connected
+ * automata in 'parent'. Returns false if a memory allocation error occurred.
+ */
+static bool collect_closure(closure_t* c, size_t** parent, moore_t* at[], size_t const num) {
+    for (size_t i = 0; i < num; i++) {
+        if (!closure_add(c, at[i])) return false;
+    }
+
+    for (size_t i = 0; i < c->num; i++) {
+        moore_t const* a = c->list[i];
+
+        for (size_t bit = 0; bit < a->input_signals_num; bit++) {
+            incoming_t const* connection = &a->incoming_connections[bit];
+            if (connection->source_aut && !closure_add(c, connection->source_aut)) return false;
+        }
+        for (size_t bit = 0; bit < a->output_signals_num; bit++) {
+            for (outgoing_t const* o = a->outgoing_connections[bit]; o; o = o->next) {
+                if (!closure_add(c, o->aut_getting_signals)) return false;
+            }
+        }
+    }
+
+    *parent = (size_t*)malloc(c->num * sizeof(size_t));
+    if (!*parent) return false;
+    for (size_t i = 0; i < c->num; i++) {
+        (*parent)[i] = i;
+    }
+
+    for (size_t i = 0; i < c->num; i++) {
+        moore_t const* a = c->list[i];
+
+        for (size_t bit = 0; bit < a->input_signals_num; bit++) {
+            incoming_t const* connection = &a->incoming_connections[bit];
+            if (connection->source_aut) union_sets(*parent, i, closure_find(c, connection->source_aut));
+        }
+    }
+
+    return true;
+}
+
+/*
+ * The function computes the connected components of the connection graph of the automata 'at' and of all automata
+ * connected to them, directly or not, and writes the number of the component of 'at[i]' to 'ids[i]'. The components
+ * are numbered from 0, in the order of their first automaton in the array. The components kept for ma_step_checked are
+ * replaced with the computed ones, so the ones left too large by disconnecting are split. No automaton of the graph
+ * may be stepped while the function runs.
+ *
+ * It returns the number of components of the automata 'at', or 0 if any pointer is NULL or 'num' is 0, setting errno
+ * to EINVAL, or if a memory allocation error occurred, setting errno to ENOMEM. In such cases, no component is changed.
+ */
+size_t ma_components(moore_t* at[], size_t num, size_t* ids) {
+    if (!at || !ids || num == 0 || null_in_the_array(at, num)) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    closure_t c = {0};
+    size_t* parent = NULL;
+    component_t** fresh = NULL;
+    size_t* members = NULL;
+
+    bool ok = collect_closure(&c, &parent, at, num);
+    if (ok) {
+        fresh = (component_t**)calloc(c.num, sizeof(component_t*));
+        members = (size_t*)calloc(c.num, sizeof(size_t));
+        ok = fresh && members;
+    }
+
+    if (ok) {
+        for (size_t i = 0; i < c.num; i++) {
+            members[find_set(parent, i)]++;
+        }
+        for (size_t i = 0; i < c.num && ok; i++) {
+            if (members[i] > 1) { // automata without connections need no node
+                fresh[i] = new_component(members[i]);
+                ok = fresh[i] != NULL;
+            }
+        }
+        if (!ok) {
+            for (size_t i = 0; i < c.num; i++) {
+                free(fresh[i]);
+            }
+        }
+    }
+
+    if (!ok) {
+        free(members);
+        free(fresh);
+        free(parent);
+        free_closure(&c);
+        errno = ENOMEM;
+        return 0;
+    }
+
+    for (size_t i = 0; i < c.num; i++) {
+        moore_t* a = c.list[i];
+        release_component(a->component);
+        a->component = fresh[find_set(parent, i)];
+    }
+
+    // numbering the components, 'members' now maps the roots to the numbers
+    size_t count = 0;
+    for (size_t i = 0; i < c.num; i++) {
+        members[i] = NOT_FOUND;
+    }
+    for (size_t i = 0; i < num; i++) {
+        size_t const root = find_set(parent, closure_find(&c, at[i]));
+        if (members[root] == NOT_FOUND) members[root] = count++;
+        ids[i] = members[root];
+    }
+
+    free(members);
+    free(fresh);
+    free(parent);
+    free_closure(&c);
+
+    return count;
+}
+
+static void release_owners(moore_t* at[], size_t const num, uintptr_t const token) {
+    for (size_t i = 0; i < num; i++) {
+        atomic_uintptr_t* owner = owner_of(at[i]);
+        if (atomic_load_explicit(owner, memory_order_relaxed) == token) {
+            atomic_store_explicit(owner, 0, memory_order_release);
+        }
+    }
+}
+
+/*
+ * The function works like ma_step, but first claims the components of all automata 'at' for the calling thread.
+ * Different threads may call it at the same time for arrays whose automata belong to different components; if a
+ * component is already being stepped by another thread, nothing is stepped.
+ *
+ * It returns 0, or -1 if any pointer is NULL or 'num' is 0, setting errno to EINVAL, if a component of the automata is
+ * stepped by another thread, setting errno to EBUSY, or if ma_step failed, keeping its errno.
+ */
+int ma_step_checked(moore_t* at[], size_t num) {
+    if (!at || num == 0 || null_in_the_array(at, num)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uintptr_t const token = (uintptr_t)&thread_token;
+
+    for (size_t i = 0; i < num; i++) {
+        atomic_uintptr_t* owner = owner_of(at[i]);
+        uintptr_t expected = 0;
+
+        if (atomic_load_explicit(owner, memory_order_relaxed) == token) continue; // claimed for an earlier automaton
+        if (!atomic_compare_exchange_strong_explicit(owner, &expected, token, memory_order_acquire,
+                                                     memory_order_relaxed)) {
+            release_owners(at, i, token);
+            errno = EBUSY;
+            return -1;
+        }
+    }
+
+    int const result = ma_step(at, num);
+    int const error = errno;
+
+    release_owners(at, num, token);
+    errno = error;
+
+    return result;
+}
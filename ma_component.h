@@ -0,0 +1,10 @@
+#ifndef MA_COMPONENT_H
+#define MA_COMPONENT_H
+
+#include <stddef.h>
+#include "ma.h"
+
+size_t ma_components(moore_t *at[], size_t num, size_t *ids);
+int ma_step_checked(moore_t *at[], size_t num);
+
+#endif //MA_COMPONENT_H
@@ -0,0 +1,552 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Distributed stepping by message passing. Every participant (process or node) builds the same network and creates
+ * a partition runtime for its own part of it; the split is deterministic, so all participants agree on the owners of
+ * the automata. A partition steps only its own automata and keeps local copies of the outputs of the others.
+ *
+ * At the beginning of every step the partitions exchange only the output bits read across partitions (boundary bits).
+ * The bits sent between two partitions are packed into words, XOR-ed with the words sent in the previous step, and only
+ * the changed words are sent. Exchanges are done pairwise in a fixed order, which keeps them free of deadlocks.
+ *
+ * The runtime uses the transport only through ma_transport_t. A backend over connected Unix domain sockets is included.
+ **/
+
+#include "ma.h"
+#include "ma_additional.h"
+#include "ma_dist.h"
+
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define FILL_THE_BLOCK 63
+#define BITS_PER_BLOCK 64
+#define NOT_FOUND ((size_t)-1)
+#define DENSE_MESSAGE (1ULL << 63)
+
+// A boundary bit: an output bit of an automaton read by another partition.
+typedef struct boundary_bit {
+    size_t automaton;
+    size_t bit;
+} boundary_bit_t;
+
+// Boundary bits exchanged with one other partition, in the same order on both sides.
+typedef struct link {
+    boundary_bit_t* sent;
+    size_t sent_num;
+    uint64_t* sent_previous; // packed words sent in the previous step
+
+    boundary_bit_t* received;
+    size_t received_num;
+    uint64_t* received_previous;
+} link_t;
+
+typedef struct ma_partition {
+    moore_t** at;
+    size_t num;
+    size_t parts;
+    size_t me;
+    size_t* part_of;
+    automata_index_t index;
+
+    size_t* members;
+    size_t members_num;
+
+    link_t* links;
+    uint64_t* packed;  // scratch space for packing
+    uint64_t* message; // scratch space for encoding
+    uint64_t* next_state;
+
+    ma_transport_t transport;
+    ma_comm_stats_t stats;
+} ma_partition_t;
+
+static size_t blocks_of(size_t const signals) {
+    return (signals + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+}
+
+static int compare_boundary_bits(void const* x, void const* y) {
+    boundary_bit_t const* a = (boundary_bit_t const*)x;
+    boundary_bit_t const* b = (boundary_bit_t const*)y;
+    if (a->automaton != b->automaton) return (a->automaton > b->automaton) - (a->automaton < b->automaton);
+    return (a->bit > b->bit) - (a->bit < b->bit);
+}
+
+static size_t sort_unique(boundary_bit_t* bits, size_t const num) {
+    qsort(bits, num, sizeof(boundary_bit_t), compare_boundary_bits);
+
+    size_t unique = 0;
+    for (size_t k = 0; k < num; k++) {
+        if (unique == 0 || compare_boundary_bits(&bits[unique - 1], &bits[k]) != 0) bits[unique++] = bits[k];
+    }
+
+    return unique;
+}
+
+static void free_partition(ma_partition_t* p) {
+    if (p->links) {
+        for (size_t q = 0; q < p->parts; q++) {
+            free(p->links[q].sent);
+            free(p->links[q].sent_previous);
+            free(p->links[q].received);
+            free(p->links[q].received_previous);
+        }
+    }
+
+    free(p->links);
+    free(p->at);
+    free(p->part_of);
+    free(p->members);
+    free(p->packed);
+    free(p->message);
+    free(p->next_state);
+    free_index(&p->index);
+    free(p);
+}
+
+/*
+ * Finds the boundary bits sent to and received from every other partition. Both sides of a link compute the same
+ * sorted lists from the same network.
+ */
+static bool build_links(ma_partition_t* p) {
+    size_t* sent_count = (size_t*)calloc(p->parts, sizeof(size_t));
+    size_t* received_count = (size_t*)calloc(p->parts, sizeof(size_t));
+    if (!sent_count || !received_count) {
+        free(sent_count);
+        free(received_count);
+        return false;
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < p->num; i++) {
+            moore_t const* a = p->at[i];
+            for (size_t bit = 0; bit < a->input_signals_num; bit++) {
+                incoming_t const* connection = &a->incoming_connections[bit];
+                if (!connection->source_aut) continue;
+
+                size_t const j = find_index(&p->index, connection->source_aut);
+                if (j == NOT_FOUND || p->part_of[j] == p->part_of[i]) continue;
+
+                boundary_bit_t const entry = {j, connection->source_bit};
+                if (p->part_of[j] == p->me) {
+                    link_t* l = &p->links[p->part_of[i]];
+                    if (pass == 1) l->sent[l->sent_num++] = entry;
+                    else sent_count[p->part_of[i]]++;
+                }
+                else if (p->part_of[i] == p->me) {
+                    link_t* l = &p->links[p->part_of[j]];
+                    if (pass == 1) l->received[l->received_num++] = entry;
+                    else received_count[p->part_of[j]]++;
+                }
+            }
+        }
+
+        if (pass == 1) break;
+
+        for (size_t q = 0; q < p->parts; q++) {
+            link_t* l = &p->links[q];
+            l->sent = (boundary_bit_t*)malloc((sent_count[q] + 1) * sizeof(boundary_bit_t));
+            l->received = (boundary_bit_t*)malloc((received_count[q] + 1) * sizeof(boundary_bit_t));
+            if (!l->sent || !l->received) {
+                free(sent_count);
+                free(received_count);
+                return false;
+            }
+        }
+    }
+
+    free(sent_count);
+    free(received_count);
+
+    size_t max_words = 1;
+    for (size_t q = 0; q < p->parts; q++) {
+        link_t* l = &p->links[q];
+        l->sent_num = sort_unique(l->sent, l->sent_num);
+        l->received_num = sort_unique(l->received, l->received_num);
+        p->stats.boundary_bits += l->sent_num + l->received_num;
+
+        l->sent_previous = (uint64_t*)calloc(blocks_of(l->sent_num) + 1, sizeof(uint64_t));
+        l->received_previous = (uint64_t*)calloc(blocks_of(l->received_num) + 1, sizeof(uint64_t));
+        if (!l->sent_previous || !l->received_previous) return false;
+
+        if (blocks_of(l->sent_num) > max_words) max_words = blocks_of(l->sent_num);
+        if (blocks_of(l->received_num) > max_words) max_words = blocks_of(l->received_num);
+    }
+
+    // a sparse message holds a header and at most half of the words as index and value pairs, a dense one all words
+    p->packed = (uint64_t*)calloc(max_words, sizeof(uint64_t));
+    p->message = (uint64_t*)calloc(max_words + 2, sizeof(uint64_t));
+    return p->packed && p->message;
+}
+
+/*
+ * Packs the boundary bits sent over the link, encodes their changes and sends them.
+ */
+static int send_boundary(ma_partition_t* p, size_t const q) {
+    link_t* l = &p->links[q];
+    size_t const words = blocks_of(l->sent_num);
+
+    memset(p->packed, 0, words * sizeof(uint64_t));
+    for (size_t k = 0; k < l->sent_num; k++) {
+        uint64_t const value = (uint64_t)get_bit(p->at[l->sent[k].automaton]->output, l->sent[k].bit);
+        p->packed[k / BITS_PER_BLOCK] |= value << (k % BITS_PER_BLOCK);
+    }
+
+    size_t const changed = xor_diff(p->packed, p->packed, l->sent_previous, words);
+    xor_diff(l->sent_previous, l->sent_previous, p->packed, words);
+
+    size_t length;
+    if (2 * changed > words) {
+        p->message[0] = DENSE_MESSAGE | words;
+        memcpy(p->message + 1, p->packed, words * sizeof(uint64_t));
+        length = words + 1;
+    }
+    else {
+        p->message[0] = changed;
+        length = 1;
+        for (size_t w = 0; w < words; w++) {
+            if (p->packed[w]) {
+                p->message[length++] = w;
+                p->message[length++] = p->packed[w];
+            }
+        }
+    }
+
+    p->stats.last_changed_words += changed;
+    p->stats.last_bytes_sent += length * sizeof(uint64_t);
+    return p->transport.send(p->transport.context, q, p->message, length * sizeof(uint64_t));
+}
+
+/*
+ * Receives the changes of the boundary bits over the link and writes the bits into the local copies of the outputs.
+ */
+static int receive_boundary(ma_partition_t* p, size_t const q) {
+    link_t* l = &p->links[q];
+    size_t const words = blocks_of(l->received_num);
+
+    if (p->transport.receive(p->transport.context, q, p->message, sizeof(uint64_t)) != 0) return -1;
+
+    uint64_t const header = p->message[0];
+    size_t const count = (size_t)(header & ~DENSE_MESSAGE);
+    bool const dense = (header & DENSE_MESSAGE) != 0;
+    size_t const length = dense ? count : 2 * count;
+
+    if ((dense && count != words) || (!dense && count > words)) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (length > 0 &&
+        p->transport.receive(p->transport.context, q, p->message + 1, length * sizeof(uint64_t)) != 0) {
+        return -1;
+    }
+    p->stats.last_bytes_received += (length + 1) * sizeof(uint64_t);
+
+    if (dense) {
+        xor_diff(l->received_previous, l->received_previous, p->message + 1, words);
+    }
+    else {
+        for (size_t k = 0; k < count; k++) {
+            size_t const w = (size_t)p->message[1 + 2 * k];
+            if (w >= words) {
+                errno = EPROTO;
+                return -1;
+            }
+            l->received_previous[w] ^= p->message[2 + 2 * k];
+        }
+    }
+
+    for (size_t k = 0; k < l->received_num; k++) {
+        int const value = (int)((l->received_previous[k / BITS_PER_BLOCK] >> (k % BITS_PER_BLOCK)) & 1);
+        set_bit(value, p->at[l->received[k].automaton]->output, l->received[k].bit / BITS_PER_BLOCK,
+                l->received[k].bit % BITS_PER_BLOCK);
+    }
+
+    return 0;
+}
+
+/*
+ * Exchanges boundary bits with all partitions. The partitions are visited in increasing order and in every pair the
+ * partition with the lower number sends first, so no two partitions wait for each other.
+ */
+static int exchange(ma_partition_t* p) {
+    for (size_t q = 0; q < p->parts; q++) {
+        link_t const* l = &p->links[q];
+        if (q == p->me || (l->sent_num == 0 && l->received_num == 0)) continue;
+
+        if (p->me < q) {
+            if (l->sent_num != 0 && send_boundary(p, q) != 0) return -1;
+            if (l->received_num != 0 && receive_boundary(p, q) != 0) return -1;
+        }
+        else {
+            if (l->received_num != 0 && receive_boundary(p, q) != 0) return -1;
+            if (l->sent_num != 0 && send_boundary(p, q) != 0) return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * The function creates the runtime of the partition 'me' out of 'parts' partitions of the network made of the automata
+ * from the array 'at[]'. Every participant has to call it with the same network, with the automata in the same order,
+ * and with the same number of partitions. Only the automata owned by the partition (see ma_partition_owns) are stepped,
+ * the outputs of the others are kept up to date as far as this partition reads them.
+ *
+ * It returns a pointer to the runtime, or NULL if any pointer is NULL, 'num' or 'parts' is 0, 'me' is not less than
+ * 'parts', the transport has no functions, or a memory allocation error occurred, setting errno to EINVAL or ENOMEM,
+ * respectively.
+ */
+ma_partition_t* ma_partition_create(moore_t* at[], size_t num, size_t parts, size_t me,
+                                    ma_transport_t const* transport) {
+    if (!at || num == 0 || parts == 0 || me >= parts || !transport || !transport->send || !transport->receive ||
+        null_in_the_array(at, num)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ma_partition_t* p = (ma_partition_t*)calloc(1, sizeof(ma_partition_t));
+    if (!p) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    p->num = num;
+    p->parts = parts;
+    p->me = me;
+    p->transport = *transport;
+    p->at = (moore_t**)malloc(num * sizeof(moore_t*));
+    p->part_of = (size_t*)malloc(num * sizeof(size_t));
+    p->members = (size_t*)malloc(num * sizeof(size_t));
+    p->links = (link_t*)calloc(parts, sizeof(link_t));
+    if (!p->at || !p->part_of || !p->members || !p->links) {
+        free_partition(p);
+        errno = ENOMEM;
+        return NULL;
+    }
+    memcpy(p->at, at, num * sizeof(moore_t*));
+
+    automata_graph_t g;
+    if (!build_index(&p->index, p->at, num) || !build_graph(&g, p->at, num)) {
+        free_partition(p);
+        return NULL;
+    }
+    bool const partitioned = partition_graph(&g, parts, p->part_of);
+    free_graph(&g);
+
+    size_t state_blocks = 1;
+    for (size_t i = 0; partitioned && i < num; i++) {
+        if (p->part_of[i] != me) continue;
+
+        p->members[p->members_num++] = i;
+        if (blocks_of(at[i]->state_signals_num) > state_blocks) state_blocks = blocks_of(at[i]->state_signals_num);
+    }
+
+    p->next_state = (uint64_t*)calloc(state_blocks, sizeof(uint64_t));
+    if (!partitioned || !p->next_state || !build_links(p)) {
+        free_partition(p);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    return p;
+}
+
+/*
+ * The function performs 'steps' computation steps of the automata owned by the partition, exchanging boundary bits with
+ * the other partitions at the beginning of every step. All partitions have to step the same number of times.
+ *
+ * It returns 0, or -1 if the pointer is NULL or 'steps' is 0, setting errno to EINVAL, or if the transport failed,
+ * leaving errno set by the transport. After a transport error, the partition is out of sync with the others.
+ */
+int ma_partition_step(ma_partition_t* p, size_t steps) {
+    if (!p || steps == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (size_t s = 0; s < steps; s++) {
+        p->stats.last_bytes_sent = 0;
+        p->stats.last_bytes_received = 0;
+        p->stats.last_changed_words = 0;
+
+        if (exchange(p) != 0) return -1;
+
+        for (size_t k = 0; k < p->members_num; k++) {
+            get_input(p->at[p->members[k]]);
+        }
+        for (size_t k = 0; k < p->members_num; k++) {
+            apply_transition(p->at[p->members[k]], p->next_state);
+        }
+
+        p->stats.steps++;
+        p->stats.total_bytes_sent += p->stats.last_bytes_sent;
+        p->stats.total_bytes_received += p->stats.last_bytes_received;
+    }
+
+    return 0;
+}
+
+/*
+ * Writes the communication volume of the partition to 'stats'. It returns 0, or -1 if any pointer is NULL, setting
+ * errno to EINVAL.
+ */
+int ma_partition_stats(ma_partition_t const* p, ma_comm_stats_t* stats) {
+    if (!p || !stats) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *stats = p->stats;
+    return 0;
+}
+
+/*
+ * Returns 1 if the automaton 'a' is stepped by the partition, 0 if it is not or it is not a part of the network, or -1
+ * if any pointer is NULL, setting errno to EINVAL.
+ */
+int ma_partition_owns(ma_partition_t const* p, moore_t const* a) {
+    if (!p || !a) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t const i = find_index(&p->index, a);
+    return i != NOT_FOUND && p->part_of[i] == p->me;
+}
+
+/*
+ * The function frees the runtime of the partition. The automata and the transport are left untouched. It does nothing
+ * if called with a NULL pointer.
+ */
+void ma_partition_delete(ma_partition_t* p) {
+    if (p) {
+        free_partition(p);
+    }
+}
+
+// Context of the Unix domain socket transport: one connected socket per partition.
+typedef struct socket_transport {
+    int* fds;
+    size_t parts;
+} socket_transport_t;
+
+static int socket_send(void* context, size_t to, void const* data, size_t size) {
+    socket_transport_t const* s = (socket_transport_t const*)context;
+    char const* current = (char const*)data;
+
+    while (size > 0) {
+        ssize_t const done = send(s->fds[to], current, size, MSG_NOSIGNAL);
+        if (done < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        current += done;
+        size -= (size_t)done;
+    }
+
+    return 0;
+}
+
+static int socket_receive(void* context, size_t from, void* data, size_t size) {
+    socket_transport_t const* s = (socket_transport_t const*)context;
+    char* current = (char*)data;
+
+    while (size > 0) {
+        ssize_t const done = recv(s->fds[from], current, size, 0);
+        if (done < 0 && errno == EINTR) continue;
+        if (done <= 0) {
+            if (done == 0) errno = ECONNRESET;
+            return -1;
+        }
+        current += done;
+        size -= (size_t)done;
+    }
+
+    return 0;
+}
+
+/*
+ * The function connects every pair of 'parts' partitions with a Unix domain socket pair. 'fds' has to hold
+ * 'parts * parts' descriptors; 'fds[p * parts + q]' is the socket of the partition 'p' connected to the partition 'q',
+ * the descriptors on the diagonal are set to -1. It is meant for tests and for partitions running as threads or forked
+ * processes of one host.
+ *
+ * It returns 0, or -1 if 'fds' is NULL or 'parts' is 0, setting errno to EINVAL, or if a socket could not be created,
+ * leaving errno set by socketpair. On error, no descriptors are left open.
+ */
+int ma_socket_mesh(size_t parts, int* fds) {
+    if (!fds || parts == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (size_t k = 0; k < parts * parts; k++) {
+        fds[k] = -1;
+    }
+
+    for (size_t p = 0; p < parts; p++) {
+        for (size_t q = p + 1; q < parts; q++) {
+            int pair[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+                int const error = errno;
+                for (size_t k = 0; k < parts * parts; k++) {
+                    if (fds[k] >= 0) close(fds[k]);
+                    fds[k] = -1;
+                }
+                errno = error;
+                return -1;
+            }
+            fds[p * parts + q] = pair[0];
+            fds[q * parts + p] = pair[1];
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * The function initializes 't' as a transport over connected stream sockets: 'fds[q]' is the socket connected to the
+ * partition 'q' (ignored for the own partition). The descriptors stay owned by the caller.
+ *
+ * It returns 0, or -1 if any pointer is NULL or 'parts' is 0, or a memory allocation error occurred, setting errno to
+ * EINVAL or ENOMEM, respectively.
+ */
+int ma_transport_socket_init(ma_transport_t* t, int const* fds, size_t parts) {
+    if (!t || !fds || parts == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    socket_transport_t* s = (socket_transport_t*)malloc(sizeof(socket_transport_t));
+    int* copy = (int*)malloc(parts * sizeof(int));
+    if (!s || !copy) {
+        free(s);
+        free(copy);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    memcpy(copy, fds, parts * sizeof(int));
+    s->fds = copy;
+    s->parts = parts;
+
+    t->context = s;
+    t->send = socket_send;
+    t->receive = socket_receive;
+    return 0;
+}
+
+/*
+ * The function frees the context of a transport initialized with ma_transport_socket_init. The sockets are not closed.
+ */
+void ma_transport_socket_destroy(ma_transport_t* t) {
+    if (t && t->context) {
+        socket_transport_t* s = (socket_transport_t*)t->context;
+        free(s->fds);
+        free(s);
+        t->context = NULL;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef MA_DIST_H
+#define MA_DIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ma.h"
+
+// Transport connecting a partition with the other partitions. Both functions transfer exactly 'size' bytes and return
+// 0, or -1 with errno set on error.
+typedef struct ma_transport {
+    void *context;
+    int (*send)(void *context, size_t to, void const *data, size_t size);
+    int (*receive)(void *context, size_t from, void *data, size_t size);
+} ma_transport_t;
+
+// Communication volume of a partition.
+typedef struct ma_comm_stats {
+    size_t steps;
+    size_t boundary_bits;       // output bits sent to and received from other partitions every step
+    size_t last_bytes_sent;     // during the last step
+    size_t last_bytes_received;
+    size_t last_changed_words;  // packed boundary words which changed since the previous step
+    size_t total_bytes_sent;
+    size_t total_bytes_received;
+} ma_comm_stats_t;
+
+typedef struct ma_partition ma_partition_t;
+
+ma_partition_t * ma_partition_create(moore_t *at[], size_t num, size_t parts, size_t me,
+                                     ma_transport_t const *transport);
+int ma_partition_step(ma_partition_t *p, size_t steps);
+int ma_partition_stats(ma_partition_t const *p, ma_comm_stats_t *stats);
+int ma_partition_owns(ma_partition_t const *p, moore_t const *a);
+void ma_partition_delete(ma_partition_t *p);
+
+int ma_socket_mesh(size_t parts, int *fds);
+int ma_transport_socket_init(ma_transport_t *t, int const *fds, size_t parts);
+void ma_transport_socket_destroy(ma_transport_t *t);
+
+#endif //MA_DIST_H
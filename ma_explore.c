@@ -0,0 +1,918 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Explicit-state exploration of small networks: reachability and equivalence checking. A global state is the
+ * concatenation of the states of the automata, packed bit after bit. The free inputs are the inputs which are not
+ * connected; the inputs connected to automata outside the array read their current outputs, which do not change.
+ * Every state is expanded under every combination of the free inputs. The outputs of a state are computed once with
+ * the output functions, then the transition functions are called for every combination, only for the automata which
+ * have free inputs.
+ *
+ * The search is a breadth-first search by levels, run by a fixed group of threads. Each level has two phases:
+ * - Expansion: every thread takes chunks of its own part of the frontier, then steals chunks of the parts of the
+ *   others, and puts every successor into the bucket of its shard.
+ * - Insertion: every thread inserts the buckets of its own shard into its part of the visited set, and keeps the new
+ *   states as its part of the next frontier.
+ * A shard is owned by one thread, so the visited set needs neither locks nor atomic operations. It is a bitset when
+ * the global state is short enough. Otherwise it is a hash set of 64-bit fingerprints, with the usual risk of a
+ * collision hiding a state (about n^2 / 2^65 for n states).
+ *
+ * Two networks are compared on their product: both are stepped as one array, the k-th free input of one always
+ * having the value of the k-th free input of the other, and the search ends at the first level with a state whose
+ * observed outputs differ. The hash set then also keeps the fingerprint of the parent of every state, so the shortest
+ * trace is found by walking the parents back to the initial state and replaying the steps forward.
+ *
+ * The callbacks are called from several threads at the same time, so they have to be reentrant.
+ **/
+
+#include "ma.h"
+#include "ma_additional.h"
+#include "ma_explore.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FILL_THE_BLOCK 63
+#define BITS_PER_BLOCK 64
+#define NOT_FOUND ((size_t)-1)
+#define DEFAULT_INPUT_BITS 16
+#define DEFAULT_BITSET_BITS 28
+#define MAX_BITSET_BITS 32 // a bitset of 512 MiB
+#define CHUNK 64 // frontier states taken by a thread at a time
+#define INITIAL_SLOTS 1024
+
+// The input 'bit' of 'at[automaton]' is the output 'source_bit' of 'at[source]'.
+typedef struct wire {
+    size_t automaton;
+    size_t bit;
+    size_t source;
+    size_t source_bit;
+} wire_t;
+
+// The input 'bit' of 'at[automaton]' is not connected, it takes the bit 'combination_bit' of every combination.
+typedef struct free_input {
+    size_t automaton;
+    size_t bit;
+    size_t combination_bit;
+} free_input_t;
+
+// Growing array of entries of the same number of blocks.
+typedef struct state_list {
+    uint64_t* states;
+    size_t count;
+    size_t capacity;
+} state_list_t;
+
+// Open addressing set of nonzero fingerprints, at most half full, with the fingerprints of their parents if 'parents'
+// is not NULL (0 for the initial state).
+typedef struct fingerprint_set {
+    uint64_t* slots;
+    uint64_t* parents;
+    size_t capacity;
+    size_t count;
+} fingerprint_set_t;
+
+typedef struct explorer explorer_t;
+
+typedef struct worker {
+    explorer_t* x;
+    size_t id;
+    pthread_t thread;
+    uint64_t* scratch; // inputs, states, next states and outputs of all automata, laid out by 'base'
+    uint64_t* common; // successor with the next states of the automata without free inputs
+    uint64_t* successor; // followed by the fingerprint of its parent if the parents are kept
+    uint64_t* observed[2]; // observed outputs of both networks of a product
+    state_list_t current; // part of the frontier, taken in chunks from 'head' by all workers
+    atomic_size_t head;
+    state_list_t next; // new states of the shard of the worker
+    state_list_t* buckets; // successors found in the expansion phase, one list for every shard
+    fingerprint_set_t seen; // visited states of the shard, if there is no bitset
+    uint64_t transitions;
+    uint64_t distinguishing; // smallest fingerprint of a state with different observed outputs, 0 if none was found
+    bool failed;
+} worker_t;
+
+struct explorer {
+    moore_t** at;
+    size_t num;
+    size_t split; // automata from 'split' on form the second network of a product, 'num' if there is none
+    automata_index_t index;
+
+    size_t* base; // the blocks of 'at[i]' in the scratch start at 'base[i]': input, state, next state and output
+    size_t scratch_blocks;
+    uint64_t* fixed; // the scratch with the inputs connected outside the array set, the other inputs are overwritten
+    size_t* offset; // bit of the global state where the state of 'at[i]' starts
+    size_t state_bits;
+    size_t words; // blocks of a packed global state
+    size_t entry_words; // blocks of an entry of a bucket: the state and, if the parents are kept, its parent
+    uint64_t* initial;
+    bool* free_dependent; // 'at[i]' has free inputs
+    wire_t* wires;
+    size_t wires_num;
+    free_input_t* free;
+    size_t free_num;
+    size_t free_bits; // bits of a combination of the free inputs
+
+    size_t* observed[2]; // positions of the observed automata of both networks of a product
+    size_t observed_num[2];
+    size_t observed_bits; // of each network, 0 if the outputs are not compared
+
+    bool parents; // the parents of the states are kept
+    uint64_t* bitset; // visited states, NULL if the states are kept as fingerprints
+
+    worker_t* workers;
+    size_t workers_num;
+    barrier_t barrier;
+    atomic_bool stop; // a state with different observed outputs was found
+    bool done;
+};
+
+static size_t blocks_of(size_t const bits) {
+    return (bits + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+}
+
+static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t fingerprint(uint64_t const* state, size_t const words) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+
+    for (size_t w = 0; w < words; w++) {
+        h = mix(h ^ state[w]);
+    }
+
+    return h != 0 ? h : 1; // 0 marks an empty slot
+}
+
+/*
+ * Appends an entry of 'words' blocks to the list. Returns false if a memory allocation error occurs.
+ */
+static bool push_state(state_list_t* list, uint64_t const* state, size_t const words) {
+    if (list->count == list->capacity) {
+        size_t const capacity = list->capacity ? 2 * list->capacity : CHUNK;
+        uint64_t* states = (uint64_t*)realloc(list->states, capacity * words * sizeof(uint64_t));
+        if (!states) return false;
+        list->states = states;
+        list->capacity = capacity;
+    }
+
+    memcpy(list->states + list->count * words, state, words * sizeof(uint64_t));
+    list->count++;
+    return true;
+}
+
+// Returns the slot of the fingerprint 'f' in the set, or the empty slot where it belongs.
+static size_t find_slot(fingerprint_set_t const* set, uint64_t const f) {
+    size_t slot = f & (set->capacity - 1);
+    while (set->slots[slot] && set->slots[slot] != f) {
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    return slot;
+}
+
+/*
+ * Doubles the capacity of the set. Returns false if a memory allocation error occurs.
+ */
+static bool grow_set(fingerprint_set_t* set, bool const parents) {
+    fingerprint_set_t bigger = {NULL, NULL, set->capacity ? 2 * set->capacity : INITIAL_SLOTS, set->count};
+    bigger.slots = (uint64_t*)calloc(bigger.capacity, sizeof(uint64_t));
+    if (parents) bigger.parents = (uint64_t*)malloc(bigger.capacity * sizeof(uint64_t));
+    if (!bigger.slots || (parents && !bigger.parents)) {
+        free(bigger.slots);
+        free(bigger.parents);
+        return false;
+    }
+
+    for (size_t k = 0; k < set->capacity; k++) {
+        if (set->slots[k] == 0) continue;
+        size_t const slot = find_slot(&bigger, set->slots[k]);
+        bigger.slots[slot] = set->slots[k];
+        if (parents) bigger.parents[slot] = set->parents[k];
+    }
+
+    free(set->slots);
+    free(set->parents);
+    *set = bigger;
+    return true;
+}
+
+/*
+ * Inserts the fingerprint 'f', with the fingerprint 'parent' of its parent if the parents are kept, into the set.
+ * Returns 1 if it was not there, 0 if it was, or -1 if a memory allocation error occurs.
+ */
+static int insert_fingerprint(fingerprint_set_t* set, uint64_t const f, uint64_t const parent, bool const parents) {
+    if (2 * (set->count + 1) > set->capacity && !grow_set(set, parents)) return -1;
+
+    size_t const slot = find_slot(set, f);
+    if (set->slots[slot]) return 0;
+
+    set->slots[slot] = f;
+    if (parents) set->parents[slot] = parent;
+    set->count++;
+    return 1;
+}
+
+static size_t shard_of_fingerprint(explorer_t const* x, uint64_t const f) {
+    return (size_t)((f >> 32) % x->workers_num);
+}
+
+static size_t shard_of(explorer_t const* x, uint64_t const* state) {
+    if (x->bitset) return (size_t)((state[0] / BITS_PER_BLOCK) % x->workers_num); // owner of the bitset block
+
+    return shard_of_fingerprint(x, fingerprint(state, x->words));
+}
+
+/*
+ * Inserts the state of the bucket entry into the visited set of the shard of 'w'. Returns 1 if it is new, 0 if not,
+ * or -1 if a memory allocation error occurs.
+ */
+static int visit(worker_t* w, uint64_t const* entry) {
+    explorer_t const* x = w->x;
+
+    if (x->bitset) {
+        uint64_t* block = &x->bitset[entry[0] / BITS_PER_BLOCK];
+        uint64_t const bit = 1ULL << (entry[0] % BITS_PER_BLOCK);
+        if (*block & bit) return 0;
+        *block |= bit;
+        return 1;
+    }
+
+    uint64_t const parent = x->parents ? entry[x->words] : 0;
+    return insert_fingerprint(&w->seen, fingerprint(entry, x->words), parent, x->parents);
+}
+
+// Returns the fingerprint of the parent of the visited state with the fingerprint 'f', 0 if there is none.
+static uint64_t parent_of(explorer_t const* x, uint64_t const f) {
+    fingerprint_set_t const* set = &x->workers[shard_of_fingerprint(x, f)].seen;
+    if (set->capacity == 0) return 0;
+
+    size_t const slot = find_slot(set, f);
+    return set->slots[slot] ? set->parents[slot] : 0;
+}
+
+static uint64_t* output_in(explorer_t const* x, uint64_t* scratch, size_t const i) {
+    moore_t const* a = x->at[i];
+    return scratch + x->base[i] + blocks_of(a->input_signals_num) + 2 * blocks_of(a->state_signals_num);
+}
+
+// Computes the next state of 'at[i]' from the input and state in the scratch and adds it to 'successor'.
+static void advance(explorer_t const* x, uint64_t* scratch, size_t const i, uint64_t* successor) {
+    moore_t const* a = x->at[i];
+    size_t const s = a->state_signals_num;
+    uint64_t* input = scratch + x->base[i];
+    uint64_t* state = input + blocks_of(a->input_signals_num);
+    uint64_t* next = state + blocks_of(s);
+
+    memset(next, 0, blocks_of(s) * sizeof(uint64_t));
+    a->transition_function(next, input, state, a->input_signals_num, s);
+    add_bits(successor, x->offset[i], next, s);
+}
+
+/*
+ * Loads the global state 'state' into the scratch of 'w': computes the outputs, the inputs connected inside the array
+ * and the part of the successors coming from the automata without free inputs.
+ */
+static void load_state(worker_t* w, uint64_t const* state) {
+    explorer_t const* x = w->x;
+    uint64_t* scratch = w->scratch;
+
+    memcpy(scratch, x->fixed, x->scratch_blocks * sizeof(uint64_t));
+
+    for (size_t i = 0; i < x->num; i++) {
+        moore_t const* a = x->at[i];
+        uint64_t* own = scratch + x->base[i] + blocks_of(a->input_signals_num);
+
+        extract_bits(own, state, x->offset[i], a->state_signals_num);
+        a->output_function(output_in(x, scratch, i), own, a->output_signals_num, a->state_signals_num);
+    }
+
+    for (size_t k = 0; k < x->wires_num; k++) {
+        wire_t const* wire = &x->wires[k];
+        set_bit(get_bit(output_in(x, scratch, wire->source), wire->source_bit), scratch + x->base[wire->automaton],
+                wire->bit / BITS_PER_BLOCK, wire->bit % BITS_PER_BLOCK);
+    }
+
+    memset(w->common, 0, x->words * sizeof(uint64_t));
+    for (size_t i = 0; i < x->num; i++) {
+        if (!x->free_dependent[i]) advance(x, scratch, i, w->common);
+    }
+}
+
+// Computes the successor of the loaded state under the combination 'c' of the free inputs into 'w->successor'.
+static void compute_successor(worker_t* w, uint64_t const c) {
+    explorer_t const* x = w->x;
+
+    for (size_t k = 0; k < x->free_num; k++) {
+        free_input_t const* input = &x->free[k];
+        set_bit((int)((c >> input->combination_bit) & 1), w->scratch + x->base[input->automaton],
+                input->bit / BITS_PER_BLOCK, input->bit % BITS_PER_BLOCK);
+    }
+
+    memcpy(w->successor, w->common, x->words * sizeof(uint64_t));
+    for (size_t i = 0; i < x->num; i++) {
+        if (x->free_dependent[i]) advance(x, w->scratch, i, w->successor);
+    }
+}
+
+// Checks if the observed outputs of the two networks of a product differ in the loaded state.
+static bool distinguishes(worker_t* w) {
+    explorer_t const* x = w->x;
+    size_t const words = blocks_of(x->observed_bits);
+
+    for (size_t side = 0; side < 2; side++) {
+        memset(w->observed[side], 0, words * sizeof(uint64_t));
+
+        size_t position = 0;
+        for (size_t k = 0; k < x->observed_num[side]; k++) {
+            size_t const i = x->observed[side][k];
+            add_bits(w->observed[side], position, output_in(x, w->scratch, i), x->at[i]->output_signals_num);
+            position += x->at[i]->output_signals_num;
+        }
+    }
+
+    return memcmp(w->observed[0], w->observed[1], words * sizeof(uint64_t)) != 0;
+}
+
+/*
+ * Computes the successors of the global state 'state' under all combinations of the free inputs and puts them into
+ * the buckets of their shards, or, if the state has different observed outputs, notes it and stops the search.
+ * Returns false if a memory allocation error occurs.
+ */
+static bool expand(worker_t* w, uint64_t const* state) {
+    explorer_t* x = w->x;
+
+    load_state(w, state);
+
+    uint64_t const f = x->parents ? fingerprint(state, x->words) : 0;
+    if (x->observed_bits && distinguishes(w)) {
+        if (w->distinguishing == 0 || f < w->distinguishing) w->distinguishing = f;
+        atomic_store_explicit(&x->stop, true, memory_order_relaxed);
+        return true;
+    }
+
+    uint64_t const combinations = 1ULL << x->free_bits;
+    for (uint64_t c = 0; c < combinations; c++) {
+        compute_successor(w, c);
+        if (x->parents) w->successor[x->words] = f;
+        if (!push_state(&w->buckets[shard_of(x, w->successor)], w->successor, x->entry_words)) return false;
+    }
+
+    w->transitions += combinations;
+    return true;
+}
+
+/*
+ * Takes the next chunk of the part of the frontier of 'owner'. Returns false if nothing is left.
+ */
+static bool take_chunk(worker_t* owner, size_t* first, size_t* last) {
+    size_t const count = owner->current.count;
+    if (atomic_load_explicit(&owner->head, memory_order_relaxed) >= count) return false;
+
+    *first = atomic_fetch_add(&owner->head, CHUNK);
+    if (*first >= count) return false;
+
+    *last = *first + CHUNK < count ? *first + CHUNK : count;
+    return true;
+}
+
+static void expansion_phase(worker_t* w) {
+    explorer_t* x = w->x;
+
+    // the own part first, then the parts of the others
+    for (size_t k = 0; k < x->workers_num; k++) {
+        worker_t* owner = &x->workers[(w->id + k) % x->workers_num];
+        size_t first;
+        size_t last;
+
+        while (take_chunk(owner, &first, &last)) {
+            for (size_t j = first; j < last; j++) {
+                if (w->failed || atomic_load_explicit(&x->stop, memory_order_relaxed)) return;
+                if (!expand(w, owner->current.states + j * x->words)) w->failed = true;
+            }
+        }
+    }
+}
+
+static void insertion_phase(worker_t* w) {
+    explorer_t* x = w->x;
+
+    for (size_t t = 0; t < x->workers_num; t++) {
+        state_list_t* bucket = &x->workers[t].buckets[w->id];
+
+        for (size_t k = 0; k < bucket->count && !w->failed; k++) {
+            uint64_t const* entry = bucket->states + k * x->entry_words;
+            int const result = visit(w, entry);
+            if (result < 0 || (result > 0 && !push_state(&w->next, entry, x->words))) w->failed = true;
+        }
+
+        bucket->count = 0;
+    }
+}
+
+static void* worker_main(void* arg) {
+    worker_t* w = (worker_t*)arg;
+    explorer_t* x = w->x;
+
+    for (;;) {
+        barrier_wait(&x->barrier); // the frontier is ready
+        if (x->done) return NULL;
+
+        expansion_phase(w);
+        barrier_wait(&x->barrier);
+        insertion_phase(w);
+        barrier_wait(&x->barrier); // the coordinator prepares the next level
+    }
+}
+
+static void free_explorer(explorer_t* x) {
+    for (size_t t = 0; x->workers && t < x->workers_num; t++) {
+        worker_t* w = &x->workers[t];
+        free(w->scratch);
+        free(w->common);
+        free(w->successor);
+        free(w->observed[0]);
+        free(w->observed[1]);
+        for (size_t s = 0; w->buckets && s < x->workers_num; s++) {
+            free(w->buckets[s].states);
+        }
+        free(w->buckets);
+        free(w->current.states);
+        free(w->next.states);
+        free(w->seen.slots);
+        free(w->seen.parents);
+    }
+
+    free(x->workers);
+    free(x->at);
+    free_index(&x->index);
+    free(x->base);
+    free(x->fixed);
+    free(x->offset);
+    free(x->initial);
+    free(x->free_dependent);
+    free(x->wires);
+    free(x->free);
+    free(x->observed[0]);
+    free(x->observed[1]);
+    free(x->bitset);
+    free(x);
+}
+
+/*
+ * Lays out the scratch and the global state, packs the initial state and sorts the inputs into wires, free inputs and
+ * inputs connected outside the array. Returns false if a memory allocation error occurs.
+ */
+static bool lay_out(explorer_t* x) {
+    size_t inputs = 0;
+
+    x->base = (size_t*)malloc(x->num * sizeof(size_t));
+    x->offset = (size_t*)malloc(x->num * sizeof(size_t));
+    x->free_dependent = (bool*)calloc(x->num, sizeof(bool));
+    if (!x->base || !x->offset || !x->free_dependent) return false;
+
+    for (size_t i = 0; i < x->num; i++) {
+        moore_t const* a = x->at[i];
+        x->base[i] = x->scratch_blocks;
+        x->scratch_blocks += blocks_of(a->input_signals_num) + 2 * blocks_of(a->state_signals_num) +
+                             blocks_of(a->output_signals_num);
+        x->offset[i] = x->state_bits;
+        x->state_bits += a->state_signals_num;
+        inputs += a->input_signals_num;
+    }
+    x->words = blocks_of(x->state_bits);
+    x->entry_words = x->parents ? x->words + 1 : x->words;
+
+    x->fixed = (uint64_t*)calloc(x->scratch_blocks, sizeof(uint64_t));
+    x->initial = (uint64_t*)calloc(x->words, sizeof(uint64_t));
+    x->wires = (wire_t*)malloc((inputs + 1) * sizeof(wire_t));
+    x->free = (free_input_t*)malloc((inputs + 1) * sizeof(free_input_t));
+    if (!x->fixed || !x->initial || !x->wires || !x->free) return false;
+
+    size_t first_free = 0; // of the network of 'at[i]'
+    for (size_t i = 0; i < x->num; i++) {
+        moore_t const* a = x->at[i];
+        if (i == x->split) first_free = x->free_num;
+        add_bits(x->initial, x->offset[i], a->state, a->state_signals_num);
+
+        for (size_t bit = 0; bit < a->input_signals_num; bit++) {
+            incoming_t const* connection = &a->incoming_connections[bit];
+            size_t const source = connection->source_aut ? find_index(&x->index, connection->source_aut) : NOT_FOUND;
+
+            if (!connection->source_aut) {
+                x->free[x->free_num] = (free_input_t){i, bit, x->free_num - first_free};
+                x->free_num++;
+                x->free_dependent[i] = true;
+            }
+            else if (source == NOT_FOUND) {
+                set_bit(get_bit(connection->source_aut->output, connection->source_bit), x->fixed + x->base[i],
+                        bit / BITS_PER_BLOCK, bit % BITS_PER_BLOCK);
+            }
+            else {
+                x->wires[x->wires_num++] = (wire_t){i, bit, source, connection->source_bit};
+            }
+        }
+    }
+    x->free_bits = x->free_num - first_free;
+
+    return true;
+}
+
+/*
+ * Finds the positions of the automata observed by the network 'n', whose automata start at the position 'first', and
+ * counts their output bits. Returns the number of the bits, or NOT_FOUND and sets errno to EINVAL if an observed
+ * automaton is not in the network or to ENOMEM if a memory allocation error occurs.
+ */
+static size_t find_observed(explorer_t* x, ma_network_t const* n, size_t const first, size_t const side) {
+    x->observed[side] = (size_t*)malloc(n->observed_num * sizeof(size_t));
+    if (!x->observed[side]) {
+        errno = ENOMEM;
+        return NOT_FOUND;
+    }
+
+    size_t bits = 0;
+    for (size_t k = 0; k < n->observed_num; k++) {
+        size_t const i = find_index(&x->index, n->observed[k]);
+        if (i == NOT_FOUND || i < first || i >= first + n->num) {
+            errno = EINVAL;
+            return NOT_FOUND;
+        }
+        x->observed[side][k] = i;
+        bits += x->at[i]->output_signals_num;
+    }
+    x->observed_num[side] = n->observed_num;
+
+    return bits;
+}
+
+/*
+ * Allocates the buffers of the workers. Returns false if a memory allocation error occurs.
+ */
+static bool prepare_workers(explorer_t* x) {
+    x->workers = (worker_t*)calloc(x->workers_num, sizeof(worker_t));
+    if (!x->workers) return false;
+
+    size_t const observed_words = x->observed_bits ? blocks_of(x->observed_bits) : 1;
+    for (size_t t = 0; t < x->workers_num; t++) {
+        worker_t* w = &x->workers[t];
+        w->x = x;
+        w->id = t;
+        atomic_init(&w->head, 0);
+        w->scratch = (uint64_t*)malloc(x->scratch_blocks * sizeof(uint64_t));
+        w->common = (uint64_t*)malloc(x->words * sizeof(uint64_t));
+        w->successor = (uint64_t*)malloc(x->entry_words * sizeof(uint64_t));
+        w->observed[0] = (uint64_t*)malloc(observed_words * sizeof(uint64_t));
+        w->observed[1] = (uint64_t*)malloc(observed_words * sizeof(uint64_t));
+        w->buckets = (state_list_t*)calloc(x->workers_num, sizeof(state_list_t));
+        if (!w->scratch || !w->common || !w->successor || !w->observed[0] || !w->observed[1] || !w->buckets) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Returns the options with the defaults in place of the zero fields.
+ */
+static ma_explore_options_t complete_options(ma_explore_options_t const* options) {
+    ma_explore_options_t limits = options ? *options : (ma_explore_options_t){0};
+
+    if (limits.threads == 0) {
+        long const online = sysconf(_SC_NPROCESSORS_ONLN);
+        limits.threads = online > 0 ? (size_t)online : 1;
+    }
+    if (limits.max_input_bits == 0) limits.max_input_bits = DEFAULT_INPUT_BITS;
+    if (limits.bitset_bits == 0) limits.bitset_bits = DEFAULT_BITSET_BITS;
+    if (limits.bitset_bits > MAX_BITSET_BITS) limits.bitset_bits = MAX_BITSET_BITS;
+
+    return limits;
+}
+
+/*
+ * Creates the explorer of the automata 'at[]'. If 'networks' is not NULL, they are the automata of 'networks[0]'
+ * followed by those of 'networks[1]', whose observed outputs are compared and whose states keep their parents.
+ * Returns NULL and sets errno to EINVAL if an automaton occurs twice, the networks do not match, or there are too
+ * many free inputs, or to ENOMEM if a memory allocation error occurs.
+ */
+static explorer_t* create_explorer(moore_t* at[], size_t const num, ma_network_t const* networks,
+                                   ma_explore_options_t const* limits) {
+    explorer_t* x = (explorer_t*)calloc(1, sizeof(explorer_t));
+    if (!x) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    x->num = num;
+    x->split = networks ? networks[0].num : num;
+    x->parents = networks != NULL;
+    x->workers_num = limits->threads;
+    atomic_init(&x->stop, false);
+    x->at = (moore_t**)malloc(num * sizeof(moore_t*));
+    bool ok = x->at != NULL;
+    if (ok) {
+        memcpy(x->at, at, num * sizeof(moore_t*));
+        ok = build_index(&x->index, x->at, num);
+    }
+    if (!ok || !lay_out(x)) {
+        free_explorer(x);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        if (find_index(&x->index, x->at[i]) != i) ok = false;
+    }
+    // both networks of a product need the same number of free inputs
+    if (networks && 2 * x->free_bits != x->free_num) ok = false;
+    if (!ok || x->free_bits > limits->max_input_bits || x->free_bits >= BITS_PER_BLOCK) {
+        free_explorer(x);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (networks) {
+        size_t const bits = find_observed(x, &networks[0], 0, 0);
+        size_t const other = bits == NOT_FOUND ? NOT_FOUND : find_observed(x, &networks[1], x->split, 1);
+        if (other == NOT_FOUND || other != bits) {
+            if (other != NOT_FOUND) errno = EINVAL;
+            int const error = errno;
+            free_explorer(x);
+            errno = error;
+            return NULL;
+        }
+        x->observed_bits = bits;
+    }
+
+    ok = prepare_workers(x);
+    if (ok && !x->parents && x->state_bits <= limits->bitset_bits) {
+        x->bitset = (uint64_t*)calloc(blocks_of((size_t)1 << x->state_bits), sizeof(uint64_t));
+        ok = x->bitset != NULL;
+    }
+    if (!ok) {
+        free_explorer(x);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    return x;
+}
+
+static double seconds_since(struct timespec const* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Makes the new states of every shard the part of the frontier of its worker. Returns the number of the new states.
+ */
+static size_t next_level(explorer_t* x) {
+    size_t total = 0;
+
+    for (size_t t = 0; t < x->workers_num; t++) {
+        worker_t* w = &x->workers[t];
+        state_list_t const swap = w->current;
+        w->current = w->next;
+        w->next = swap;
+        w->next.count = 0;
+        atomic_store(&w->head, 0);
+        total += w->current.count;
+    }
+
+    return total;
+}
+
+/*
+ * Searches the states reachable from the initial one and fills 'stats'. Returns 0, or -1 and sets errno to ENOMEM if
+ * a memory allocation error occurs or to EAGAIN if a thread could not be started.
+ */
+static int run(explorer_t* x, ma_explore_options_t const* limits, ma_explore_stats_t* stats) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    memset(stats, 0, sizeof(ma_explore_stats_t));
+    stats->states = 1;
+    stats->complete = true;
+    stats->exact = x->bitset != NULL;
+
+    uint64_t* entry = x->workers[0].successor;
+    memcpy(entry, x->initial, x->words * sizeof(uint64_t));
+    if (x->parents) entry[x->words] = 0;
+    worker_t* owner = &x->workers[shard_of(x, x->initial)];
+    if (visit(owner, entry) < 0 || !push_state(&owner->next, x->initial, x->words)) {
+        errno = ENOMEM;
+        return -1;
+    }
+    next_level(x);
+
+    barrier_init(&x->barrier, x->workers_num);
+    size_t started = 1;
+    for (; started < x->workers_num; started++) {
+        if (pthread_create(&x->workers[started].thread, NULL, worker_main, &x->workers[started]) != 0) break;
+    }
+
+    int error = 0;
+    if (started < x->workers_num) {
+        error = EAGAIN;
+        x->done = true;
+        barrier_resize(&x->barrier, started); // the started threads stop at the first barrier
+        barrier_wait(&x->barrier);
+    }
+
+    worker_t* first = &x->workers[0];
+    while (!x->done) {
+        barrier_wait(&x->barrier); // the frontier is ready
+        expansion_phase(first);
+        barrier_wait(&x->barrier);
+        insertion_phase(first);
+        barrier_wait(&x->barrier);
+
+        for (size_t t = 0; t < x->workers_num; t++) {
+            if (x->workers[t].failed) error = ENOMEM;
+        }
+
+        size_t const found = next_level(x);
+        if (error || atomic_load(&x->stop) || found == 0) {
+            x->done = true;
+        }
+        else {
+            stats->states += found;
+            stats->depth++;
+            if ((limits->max_states && stats->states >= limits->max_states) ||
+                (limits->max_depth && stats->depth >= limits->max_depth)) {
+                stats->complete = false;
+                x->done = true;
+            }
+        }
+
+        if (x->done) barrier_wait(&x->barrier); // lets the threads see 'done'
+    }
+
+    for (size_t t = 1; t < started; t++) {
+        pthread_join(x->workers[t].thread, NULL);
+    }
+    barrier_destroy(&x->barrier);
+
+    for (size_t t = 0; t < x->workers_num; t++) {
+        stats->transitions += x->workers[t].transitions;
+    }
+    stats->seconds = seconds_since(&start);
+    stats->states_per_second = stats->seconds > 0 ? (double)stats->states / stats->seconds : 0;
+
+    if (error) {
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * The function explores the global states of the automata from the array 'at[]' reachable from their current states
+ * under all values of the inputs which are not connected, breadth first, and fills 'stats'. The inputs connected to
+ * automata outside the array keep their current values. The automata are not changed, the callbacks are called from
+ * 'options->threads' threads at the same time and have to be reentrant. 'options' may be NULL for the defaults.
+ *
+ * It returns 0, or -1 if any pointer but 'options' is NULL, 'num' is 0, an automaton occurs twice, or there are more
+ * free input bits than 'options->max_input_bits', setting errno to EINVAL, if a memory allocation error occurred,
+ * setting errno to ENOMEM, or if a thread could not be started, setting errno to EAGAIN.
+ */
+int ma_explore_reachable(moore_t* at[], size_t num, ma_explore_options_t const* options, ma_explore_stats_t* stats) {
+    if (!at || num == 0 || !stats || null_in_the_array(at, num)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ma_explore_options_t const limits = complete_options(options);
+    explorer_t* x = create_explorer(at, num, NULL, &limits);
+    if (!x) return -1;
+
+    int const result = run(x, &limits, stats);
+    int const error = errno;
+    free_explorer(x);
+    errno = error;
+
+    return result;
+}
+
+/*
+ * Replays the shortest trace to the state with the fingerprint 'f' found at the distance 'length' from the initial
+ * one and stores its combinations in the result. Returns false and sets errno to EIO if the trace cannot be replayed,
+ * which only happens if two states share a fingerprint, or to ENOMEM if a memory allocation error occurs.
+ */
+static bool replay_trace(explorer_t* x, uint64_t f, size_t const length, ma_equivalence_t* result) {
+    uint64_t* chain = (uint64_t*)malloc((length + 1) * sizeof(uint64_t));
+    uint64_t* state = (uint64_t*)malloc(x->words * sizeof(uint64_t));
+    if (!chain || !state) {
+        free(chain);
+        free(state);
+        errno = ENOMEM;
+        return false;
+    }
+
+    for (size_t j = length + 1; j-- > 0;) {
+        chain[j] = f;
+        f = parent_of(x, f);
+    }
+
+    worker_t* w = &x->workers[0];
+    uint64_t const combinations = 1ULL << x->free_bits;
+    bool ok = chain[0] == fingerprint(x->initial, x->words);
+    memcpy(state, x->initial, x->words * sizeof(uint64_t));
+
+    for (size_t j = 0; ok && j < length; j++) {
+        load_state(w, state);
+        ok = false;
+
+        for (uint64_t c = 0; !ok && c < combinations; c++) {
+            compute_successor(w, c);
+            if (fingerprint(w->successor, x->words) != chain[j + 1]) continue;
+
+            if (result->trace && j < result->trace_capacity) result->trace[j] = c;
+            memcpy(state, w->successor, x->words * sizeof(uint64_t));
+            ok = true;
+        }
+    }
+
+    free(chain);
+    free(state);
+    if (!ok) errno = EIO;
+    return ok;
+}
+
+/*
+ * The function checks if the networks 'a' and 'b' behave the same from the current states of their automata: if the
+ * concatenated outputs of their observed automata are equal after every sequence of values of the free inputs. The
+ * free inputs of both networks are paired in order (the automata in the order of 'at[]', the inputs of an automaton
+ * from the first one), so both need the same number of them, and the same number of observed output bits.
+ *
+ * The product of the networks is explored like in ma_explore_reachable, with the same 'options', which may be NULL.
+ * If a state with different outputs is reachable, 'result->trace_length' is the length of the shortest sequence of
+ * free input values reaching one, and the sequence is stored in 'result->trace' as far as 'result->trace_capacity'
+ * allows: the bit 'k' of its element 'j' is the value of the k-th free input in the step 'j'. 'result->equivalent' is
+ * set only if the exploration was complete and found no such state. The automata are not changed.
+ *
+ * It returns 0, or -1 if any pointer but 'options' and 'result->trace' is NULL, a network has no automata or no
+ * observed automata, observes an automaton which is not its own, an automaton occurs twice, the networks differ in
+ * the number of free inputs or of observed output bits, or there are more free input bits than
+ * 'options->max_input_bits', setting errno to EINVAL, if a memory allocation error occurred, setting errno to ENOMEM,
+ * if a thread could not be started, setting errno to EAGAIN, or if two states shared a fingerprint and the trace could
+ * not be replayed, setting errno to EIO.
+ */
+int ma_check_equivalence(ma_network_t const* a, ma_network_t const* b, ma_explore_options_t const* options,
+                         ma_equivalence_t* result) {
+    if (!a || !b || !result || !a->at || !b->at || a->num == 0 || b->num == 0 || !a->observed || !b->observed ||
+        a->observed_num == 0 || b->observed_num == 0 || null_in_the_array(a->at, a->num) ||
+        null_in_the_array(b->at, b->num) || null_in_the_array(a->observed, a->observed_num) ||
+        null_in_the_array(b->observed, b->observed_num)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    moore_t** product = (moore_t**)malloc((a->num + b->num) * sizeof(moore_t*));
+    if (!product) {
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(product, a->at, a->num * sizeof(moore_t*));
+    memcpy(product + a->num, b->at, b->num * sizeof(moore_t*));
+
+    ma_network_t const networks[2] = {*a, *b};
+    ma_explore_options_t const limits = complete_options(options);
+    explorer_t* x = create_explorer(product, a->num + b->num, networks, &limits);
+    free(product);
+    if (!x) return -1;
+
+    bool ok = run(x, &limits, &result->stats) == 0;
+    if (ok) {
+        uint64_t distinguishing = 0;
+        for (size_t t = 0; t < x->workers_num; t++) {
+            uint64_t const f = x->workers[t].distinguishing;
+            if (f != 0 && (distinguishing == 0 || f < distinguishing)) distinguishing = f;
+        }
+
+        result->equivalent = distinguishing == 0 && result->stats.complete;
+        result->trace_length = 0;
+        if (distinguishing != 0) {
+            result->trace_length = result->stats.depth;
+            ok = replay_trace(x, distinguishing, result->stats.depth, result);
+        }
+    }
+
+    int const error = errno;
+    free_explorer(x);
+    errno = error;
+
+    return ok ? 0 : -1;
+}
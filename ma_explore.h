@@ -0,0 +1,49 @@
+#ifndef MA_EXPLORE_H
+#define MA_EXPLORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ma.h"
+
+// Limits of the exploration, a zero field takes the default.
+typedef struct ma_explore_options {
+    size_t threads;         // the number of online processors by default
+    size_t max_input_bits;  // free input bits enumerated in every state, 16 by default
+    size_t bitset_bits;     // global states of at most this many bits are kept in a bitset, 28 by default, at most 32
+    uint64_t max_states;    // no limit by default
+    size_t max_depth;       // no limit by default
+} ma_explore_options_t;
+
+typedef struct ma_explore_stats {
+    uint64_t states;        // reachable global states found, the initial one included
+    uint64_t transitions;   // successors computed, one for every state and combination of the free inputs
+    size_t depth;           // largest distance of a found state from the initial one, in steps
+    bool complete;          // false if a limit stopped the exploration
+    bool exact;             // false if the states were told apart by 64-bit fingerprints
+    double seconds;
+    double states_per_second;
+} ma_explore_stats_t;
+
+// Network compared by ma_check_equivalence: the automata 'at[]' are stepped together, and the output of the network
+// is the concatenation of the outputs of 'observed[]', which are automata of 'at[]'.
+typedef struct ma_network {
+    moore_t **at;
+    size_t num;
+    moore_t **observed;
+    size_t observed_num;
+} ma_network_t;
+
+typedef struct ma_equivalence {
+    bool equivalent;        // the search was complete and found no distinguishing trace
+    ma_explore_stats_t stats; // of the product machine
+    uint64_t *trace;        // buffer for the distinguishing trace, provided by the caller, may be NULL
+    size_t trace_capacity;  // combinations the buffer can hold
+    size_t trace_length;    // steps of the shortest distinguishing trace, 0 if the initial outputs differ
+} ma_equivalence_t;
+
+int ma_explore_reachable(moore_t *at[], size_t num, ma_explore_options_t const *options, ma_explore_stats_t *stats);
+int ma_check_equivalence(ma_network_t const *a, ma_network_t const *b, ma_explore_options_t const *options,
+                         ma_equivalence_t *result);
+
+#endif //MA_EXPLORE_H
@@ -0,0 +1,383 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Fast-forwarding of networks of automata which are linear over GF(2), like LFSRs, CRC engines and scramblers. An
+ * automaton is declared linear by giving the matrices of its transition and output functions with ma_set_linear: the
+ * next state is T * state + B * input, and the output is C * state. The declaration does not replace the callbacks,
+ * which are still used by ma_step, it only promises that they compute the same.
+ *
+ * Over the steps of a network of linear automata, the inputs which are not connected and the outputs of the automata
+ * outside the network do not change, so the concatenated states evolve as an affine map. It is written as a square
+ * matrix G over the states and one constant bit, and k steps are G^k, computed with O(log k) squarings. The products
+ * use the method of the Four Russians (as in M4RI): for every group of 8 columns of the left factor, a table of the
+ * 256 sums of the 8 matching rows of the right factor is built, and every row of the product adds one entry of it.
+ **/
+
+#include "ma.h"
+#include "ma_additional.h"
+#include "ma_linear.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILL_THE_BLOCK 63
+#define BITS_PER_BLOCK 64
+#define NOT_FOUND ((size_t)-1)
+#define GROUP_BITS 8 // columns of the left factor handled by one table
+
+struct linear {
+    uint64_t* transition; // 's' rows of the blocks of 's' bits, row 'r' gives the bit 'r' of the next state
+    uint64_t* input; // 's' rows of the blocks of 'n' bits, NULL if the inputs do not change the state
+    uint64_t* output; // 'm' rows of the blocks of 's' bits, NULL if the output is the state
+};
+
+// Square matrix over GF(2) of 'size' rows of 'words' blocks each, the bits past 'size' in every row are zero.
+typedef struct matrix {
+    size_t size;
+    size_t words;
+    uint64_t* rows;
+} matrix_t;
+
+static size_t blocks_of(size_t const bits) {
+    return (bits + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+}
+
+static void free_linear(linear_t* l) {
+    if (l) {
+        free(l->transition);
+        free(l->input);
+        free(l->output);
+        free(l);
+    }
+}
+
+void forget_linear(moore_t* a) {
+    free_linear(a->linear);
+    a->linear = NULL;
+}
+
+/*
+ * Copies a matrix of 'rows' rows of 'bits' bits, zeroing the unused bits of every row. Returns NULL and sets errno to
+ * ENOMEM if a memory allocation error occurs.
+ */
+static uint64_t* copy_rows(uint64_t const* matrix, size_t const rows, size_t const bits) {
+    size_t const words = blocks_of(bits);
+    uint64_t* copy = (uint64_t*)malloc(rows * words * sizeof(uint64_t));
+    if (!copy) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    for (size_t r = 0; r < rows; r++) {
+        masked_copy(copy + r * words, matrix + r * words, bits);
+    }
+
+    return copy;
+}
+
+/*
+ * The function declares the automaton 'a' linear over GF(2), which lets ma_fast_forward step it. The matrices are
+ * stored row by row, every row taking the blocks of as many bits as the matrix has columns:
+ * - 'transition' has 's' rows of 's' bits: the bit 'r' of the next state is the sum of the bits of the state selected
+ *   by the row 'r', plus the sum of the input bits selected by the row 'r' of 'input';
+ * - 'input' has 's' rows of 'n' bits, or is NULL if the inputs do not change the state;
+ * - 'output' has 'm' rows of 's' bits selecting the state bits summed into every output bit, or is NULL if the output
+ *   is the state, which requires 'm' equal to 's'.
+ * The matrices are copied and have to describe the transition and output functions of the automaton. A NULL
+ * 'transition' removes the declaration.
+ *
+ * It returns 0, or -1 if the automaton is NULL, 'output' is NULL while the numbers of outputs and state bits differ,
+ * or 'input' is not NULL for an automaton without inputs, setting errno to EINVAL, or if a memory allocation error
+ * occurred, setting errno to ENOMEM. On failure the previous declaration is kept.
+ */
+int ma_set_linear(moore_t* a, uint64_t const* transition, uint64_t const* input, uint64_t const* output) {
+    if (!a) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (!transition) {
+        forget_linear(a);
+        return 0;
+    }
+
+    size_t const n = a->input_signals_num;
+    size_t const m = a->output_signals_num;
+    size_t const s = a->state_signals_num;
+
+    if ((!output && m != s) || (input && n == 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    linear_t* l = (linear_t*)calloc(1, sizeof(linear_t));
+    if (!l) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    l->transition = copy_rows(transition, s, s);
+    bool ok = l->transition != NULL;
+    if (ok && input) {
+        l->input = copy_rows(input, s, n);
+        ok = l->input != NULL;
+    }
+    if (ok && output) {
+        l->output = copy_rows(output, m, s);
+        ok = l->output != NULL;
+    }
+
+    if (!ok) {
+        free_linear(l);
+        return -1;
+    }
+
+    forget_linear(a);
+    a->linear = l;
+
+    return 0;
+}
+
+/*
+ * Adds the linear form of the output bit 'bit' of the automaton 'a', whose state starts at the bit 'offset' of the
+ * global state, to 'row'.
+ */
+static void add_output_form(uint64_t* row, moore_t const* a, size_t const offset, size_t const bit) {
+    size_t const s = a->state_signals_num;
+
+    if (a->linear->output) {
+        add_bits(row, offset, a->linear->output + bit * blocks_of(s), s);
+    }
+    else {
+        row[(offset + bit) / BITS_PER_BLOCK] ^= 1ULL << ((offset + bit) % BITS_PER_BLOCK);
+    }
+}
+
+/*
+ * Fills the matrix 'g' of one step of the automata 'at[]', whose states start at the bits 'offset[i]' of the global
+ * state, the last column being the constant one.
+ */
+static void build_step(matrix_t* g, moore_t* at[], size_t const num, size_t const* offset,
+                       automata_index_t const* index) {
+    size_t const one = g->size - 1;
+
+    memset(g->rows, 0, g->size * g->words * sizeof(uint64_t));
+    g->rows[one * g->words + one / BITS_PER_BLOCK] = 1ULL << (one % BITS_PER_BLOCK);
+
+    for (size_t i = 0; i < num; i++) {
+        moore_t const* a = at[i];
+        linear_t const* l = a->linear;
+        size_t const n = a->input_signals_num;
+        size_t const s = a->state_signals_num;
+
+        for (size_t r = 0; r < s; r++) {
+            uint64_t* row = g->rows + (offset[i] + r) * g->words;
+            add_bits(row, offset[i], l->transition + r * blocks_of(s), s);
+            if (!l->input) continue;
+
+            uint64_t const* selected = l->input + r * blocks_of(n);
+            for (size_t bit = 0; bit < n; bit++) {
+                if (!get_bit(selected, bit)) continue;
+
+                incoming_t const* connection = &a->incoming_connections[bit];
+                size_t const source = connection->source_aut ? find_index(index, connection->source_aut) : NOT_FOUND;
+
+                if (source != NOT_FOUND) {
+                    add_output_form(row, at[source], offset[source], connection->source_bit);
+                }
+                else if (connection->source_aut ? get_bit(connection->source_aut->output, connection->source_bit)
+                                                : get_bit(a->input, bit)) {
+                    row[one / BITS_PER_BLOCK] ^= 1ULL << (one % BITS_PER_BLOCK);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Computes 'product' = 'a' * 'b' with the method of the Four Russians, using 'table' of 2^GROUP_BITS rows.
+ */
+static void multiply(matrix_t* product, matrix_t const* a, matrix_t const* b, uint64_t* table) {
+    size_t const size = a->size;
+    size_t const words = a->words;
+
+    memset(product->rows, 0, size * words * sizeof(uint64_t));
+    memset(table, 0, words * sizeof(uint64_t));
+
+    for (size_t group = 0; group < size; group += GROUP_BITS) {
+        size_t const bits = size - group < GROUP_BITS ? size - group : GROUP_BITS;
+
+        // the row 'x' of the table is the sum of the rows 'group + k' of 'b' for the bits 'k' set in 'x'
+        for (size_t x = 1; x < (1u << bits); x++) {
+            uint64_t* sum = table + x * words;
+            uint64_t const* smaller = table + (x & (x - 1)) * words;
+            uint64_t const* row = b->rows + (group + (size_t)__builtin_ctzll(x)) * words;
+            for (size_t w = 0; w < words; w++) {
+                sum[w] = smaller[w] ^ row[w];
+            }
+        }
+
+        for (size_t i = 0; i < size; i++) {
+            size_t const x = (a->rows[i * words + group / BITS_PER_BLOCK] >> (group % BITS_PER_BLOCK)) &
+                             ((1u << GROUP_BITS) - 1);
+            if (x == 0) continue;
+
+            uint64_t* row = product->rows + i * words;
+            uint64_t const* sum = table + x * words;
+            for (size_t w = 0; w < words; w++) {
+                row[w] ^= sum[w];
+            }
+        }
+    }
+}
+
+// Computes 'result' = 'g' * 'v'.
+static void apply(uint64_t* result, matrix_t const* g, uint64_t const* v) {
+    memset(result, 0, g->words * sizeof(uint64_t));
+
+    for (size_t i = 0; i < g->size; i++) {
+        uint64_t const* row = g->rows + i * g->words;
+        uint64_t parity = 0;
+        for (size_t w = 0; w < g->words; w++) {
+            parity ^= row[w] & v[w];
+        }
+        if (__builtin_parityll(parity)) result[i / BITS_PER_BLOCK] |= 1ULL << (i % BITS_PER_BLOCK);
+    }
+}
+
+/*
+ * Computes the global state after 'steps' steps of the matrix 'g' applied to 'v', overwriting 'g'. Returns false and
+ * sets errno to ENOMEM if a memory allocation error occurs.
+ */
+static bool jump(matrix_t* g, uint64_t* v, uint64_t steps) {
+    size_t const words = g->words;
+    matrix_t square = {g->size, words, (uint64_t*)malloc(g->size * words * sizeof(uint64_t))};
+    uint64_t* table = (uint64_t*)malloc(((size_t)1 << GROUP_BITS) * words * sizeof(uint64_t));
+    uint64_t* result = (uint64_t*)malloc(words * sizeof(uint64_t));
+
+    if (!square.rows || !table || !result) {
+        free(square.rows);
+        free(table);
+        free(result);
+        errno = ENOMEM;
+        return false;
+    }
+
+    // g holds g^(2^i) while the bit 'i' of 'steps' is considered
+    while (steps != 0) {
+        if (steps & 1) {
+            apply(result, g, v);
+            memcpy(v, result, words * sizeof(uint64_t));
+        }
+
+        steps >>= 1;
+        if (steps != 0) {
+            multiply(&square, g, g, table);
+            uint64_t* swap = g->rows;
+            g->rows = square.rows;
+            square.rows = swap;
+        }
+    }
+
+    free(square.rows);
+    free(table);
+    free(result);
+    return true;
+}
+
+/*
+ * Computes the states of the automata 'at[]' after 'steps' steps and sets them, together with the outputs.
+ */
+static int jump_states(moore_t* at[], size_t const num, uint64_t const steps) {
+    automata_index_t index = {0};
+    size_t* offset = (size_t*)malloc(num * sizeof(size_t));
+    if (!offset || !build_index(&index, at, num)) {
+        free(offset);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    size_t total = 0;
+    bool ok = true;
+    for (size_t i = 0; i < num; i++) {
+        if (find_index(&index, at[i]) != i) ok = false;
+        offset[i] = total;
+        total += at[i]->state_signals_num;
+    }
+
+    matrix_t g = {total + 1, blocks_of(total + 1), NULL};
+    uint64_t* v = NULL;
+
+    if (!ok) {
+        errno = EINVAL;
+    }
+    else {
+        g.rows = (uint64_t*)malloc(g.size * g.words * sizeof(uint64_t));
+        v = (uint64_t*)calloc(g.words, sizeof(uint64_t));
+        if (!g.rows || !v) {
+            ok = false;
+            errno = ENOMEM;
+        }
+    }
+
+    if (ok) {
+        for (size_t i = 0; i < num; i++) {
+            add_bits(v, offset[i], at[i]->state, at[i]->state_signals_num);
+        }
+        v[total / BITS_PER_BLOCK] |= 1ULL << (total % BITS_PER_BLOCK);
+
+        build_step(&g, at, num, offset, &index);
+        ok = jump(&g, v, steps);
+    }
+
+    if (ok) {
+        for (size_t i = 0; i < num; i++) {
+            moore_t* a = at[i];
+            extract_bits(a->state, v, offset[i], a->state_signals_num);
+            a->output_function(a->output, a->state, a->output_signals_num, a->state_signals_num);
+            if (a->output_signals_num % BITS_PER_BLOCK != 0) {
+                a->output[blocks_of(a->output_signals_num) - 1] &= create_bit_mask(a->output_signals_num %
+                                                                                   BITS_PER_BLOCK);
+            }
+        }
+    }
+
+    free(g.rows);
+    free(v);
+    free(offset);
+    free_index(&index);
+
+    return ok ? 0 : -1;
+}
+
+/*
+ * The function performs 'steps' computation steps of the automata from the array 'at[]', all of which have to be
+ * declared linear with ma_set_linear. The result is the same as calling ma_step 'steps' times, but it takes O(log
+ * steps) products of square matrices of the size of all the states together. The inputs which are not connected and
+ * the outputs of the automata outside the array are read once and kept for all the steps, as they do not change.
+ *
+ * All steps but the last are computed from the matrices, the last one is performed by ma_step, so the inputs and
+ * outputs of the automata are left as ma_step leaves them.
+ *
+ * It returns 0, or -1 if any pointer is NULL, 'num' or 'steps' is 0, an automaton occurs twice or is not declared
+ * linear, setting errno to EINVAL, or if a memory allocation error occurred, setting errno to ENOMEM. In such cases the
+ * automata are not changed.
+ */
+int ma_fast_forward(moore_t* at[], size_t num, uint64_t steps) {
+    if (!at || num == 0 || steps == 0 || null_in_the_array(at, num)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        if (!at[i]->linear) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    if (steps > 1 && jump_states(at, num, steps - 1) != 0) return -1;
+
+    return ma_step(at, num);
+}
@@ -0,0 +1,11 @@
+#ifndef MA_LINEAR_H
+#define MA_LINEAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ma.h"
+
+int ma_set_linear(moore_t *a, uint64_t const *transition, uint64_t const *input, uint64_t const *output);
+int ma_fast_forward(moore_t *at[], size_t num, uint64_t steps);
+
+#endif //MA_LINEAR_H
@@ -0,0 +1,464 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Connection graph of an array of automata and the reordering pass built on it. The graph is derived from the
+ * 'incoming_connections' arrays of the automata, with vertices numbered by the positions of the automata in the array.
+ *
+ * The order places producers next to their consumers, so the gather phase of a step reads outputs that were touched
+ * shortly before. Acyclic networks are levelized, other networks are ordered with the reverse Cuthill-McKee algorithm.
+ * The same order is the starting point for splitting the graph into parts with few connections between them.
+ **/
+
+#include "ma.h"
+#include "ma_additional.h"
+#include "ma_order.h"
+
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#define NOT_FOUND ((size_t)-1)
+
+static size_t hash_pointer(moore_t const* const a, size_t const capacity) {
+    uint64_t const value = (uint64_t)(uintptr_t)a >> 4;
+    return (size_t)((value * 0x9E3779B97F4A7C15ULL) >> 17) & (capacity - 1);
+}
+
+/*
+ * Builds a hash map from the automata of the array 'at' to their positions. If an automaton occurs more than once,
+ * the first position is kept.
+ *
+ * Returns false and sets errno to ENOMEM if a memory allocation error occurs.
+ */
+bool build_index(automata_index_t* index, moore_t* const at[], size_t const num) {
+    size_t capacity = 16;
+    while (capacity < 2 * num) {
+        capacity *= 2;
+    }
+
+    index->capacity = capacity;
+    index->keys = (moore_t const**)calloc(capacity, sizeof(moore_t*));
+    index->values = (size_t*)malloc(capacity * sizeof(size_t));
+    if (!index->keys || !index->values) {
+        free_index(index);
+        errno = ENOMEM;
+        return false;
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        size_t slot = hash_pointer(at[i], capacity);
+        while (index->keys[slot] && index->keys[slot] != at[i]) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+
+        if (!index->keys[slot]) {
+            index->keys[slot] = at[i];
+            index->values[slot] = i;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Returns the position of the automaton 'a' in the array the index was built from, or NOT_FOUND ((size_t)-1) if it
+ * is not there.
+ */
+size_t find_index(automata_index_t const* index, moore_t const* a) {
+    size_t slot = hash_pointer(a, index->capacity);
+
+    while (index->keys[slot]) {
+        if (index->keys[slot] == a) {
+            return index->values[slot];
+        }
+        slot = (slot + 1) & (index->capacity - 1);
+    }
+
+    return NOT_FOUND;
+}
+
+void free_index(automata_index_t* index) {
+    free(index->keys);
+    free(index->values);
+    index->keys = NULL;
+    index->values = NULL;
+}
+
+/*
+ * Builds the connection graph of the automata in the array 'at'. An edge j -> i exists if some input of 'at[i]' is
+ * connected to an output of 'at[j]'; its weight is the number of connected bits. Connections to automata outside the
+ * array are skipped.
+ *
+ * Returns false and sets errno to ENOMEM if a memory allocation error occurs.
+ */
+bool build_graph(automata_graph_t* g, moore_t* const at[], size_t const num) {
+    memset(g, 0, sizeof(automata_graph_t));
+    g->num = num;
+
+    automata_index_t index;
+    if (!build_index(&index, at, num)) {
+        return false;
+    }
+
+    size_t* mark = (size_t*)calloc(num, sizeof(size_t));     // 'i + 1' if 'j' is already a source of 'i'
+    size_t* position = (size_t*)malloc(num * sizeof(size_t)); // where 'j' is stored on the list of sources of 'i'
+    g->source_offsets = (size_t*)calloc(num + 1, sizeof(size_t));
+    g->target_offsets = (size_t*)calloc(num + 1, sizeof(size_t));
+    if (!mark || !position || !g->source_offsets || !g->target_offsets) {
+        goto out_of_memory;
+    }
+
+    // counting the distinct sources of every automaton
+    for (size_t i = 0; i < num; i++) {
+        for (size_t bit = 0; bit < at[i]->input_signals_num; bit++) {
+            incoming_t const* const connection = &at[i]->incoming_connections[bit];
+            if (!connection->source_aut) continue;
+
+            size_t const j = find_index(&index, connection->source_aut);
+            if (j == NOT_FOUND || mark[j] == i + 1) continue;
+
+            mark[j] = i + 1;
+            g->source_offsets[i + 1]++;
+            g->target_offsets[j + 1]++;
+        }
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        g->source_offsets[i + 1] += g->source_offsets[i];
+        g->target_offsets[i + 1] += g->target_offsets[i];
+    }
+
+    size_t const edges = g->source_offsets[num];
+    g->source_list = (size_t*)malloc((edges + 1) * sizeof(size_t));
+    g->source_weights = (size_t*)calloc(edges + 1, sizeof(size_t));
+    g->target_list = (size_t*)malloc((edges + 1) * sizeof(size_t));
+    g->target_weights = (size_t*)calloc(edges + 1, sizeof(size_t));
+    if (!g->source_list || !g->source_weights || !g->target_list || !g->target_weights) {
+        goto out_of_memory;
+    }
+
+    // filling the lists of sources
+    memset(mark, 0, num * sizeof(size_t));
+    for (size_t i = 0; i < num; i++) {
+        size_t end = g->source_offsets[i];
+
+        for (size_t bit = 0; bit < at[i]->input_signals_num; bit++) {
+            incoming_t const* const connection = &at[i]->incoming_connections[bit];
+            if (!connection->source_aut) continue;
+
+            size_t const j = find_index(&index, connection->source_aut);
+            if (j == NOT_FOUND) continue;
+
+            if (mark[j] != i + 1) {
+                mark[j] = i + 1;
+                position[j] = end;
+                g->source_list[end++] = j;
+            }
+            g->source_weights[position[j]]++;
+        }
+    }
+
+    // the lists of targets are the transposition of the lists of sources
+    memcpy(position, g->target_offsets, num * sizeof(size_t));
+    for (size_t i = 0; i < num; i++) {
+        for (size_t e = g->source_offsets[i]; e < g->source_offsets[i + 1]; e++) {
+            size_t const j = g->source_list[e];
+            g->target_list[position[j]] = i;
+            g->target_weights[position[j]] = g->source_weights[e];
+            position[j]++;
+        }
+    }
+
+    free(mark);
+    free(position);
+    free_index(&index);
+    return true;
+
+out_of_memory:
+    free(mark);
+    free(position);
+    free_index(&index);
+    free_graph(g);
+    errno = ENOMEM;
+    return false;
+}
+
+void free_graph(automata_graph_t* g) {
+    free(g->source_offsets);
+    free(g->source_list);
+    free(g->source_weights);
+    free(g->target_offsets);
+    free(g->target_list);
+    free(g->target_weights);
+    memset(g, 0, sizeof(automata_graph_t));
+}
+
+/*
+ * Levelizes an acyclic graph: every automaton is placed after all of its sources, level by level. Self-loops are
+ * ignored. Returns the number of placed automata, which is smaller than the number of vertices if the graph has
+ * a cycle.
+ */
+static size_t levelize(automata_graph_t const* g, size_t* order, size_t* in_degree) {
+    size_t const num = g->num;
+
+    for (size_t i = 0; i < num; i++) {
+        in_degree[i] = 0;
+        for (size_t e = g->source_offsets[i]; e < g->source_offsets[i + 1]; e++) {
+            if (g->source_list[e] != i) in_degree[i]++;
+        }
+    }
+
+    size_t placed = 0;
+    for (size_t i = 0; i < num; i++) {
+        if (in_degree[i] == 0) order[placed++] = i;
+    }
+
+    // 'order' works as a queue, so automata are placed level by level
+    for (size_t head = 0; head < placed; head++) {
+        size_t const u = order[head];
+        for (size_t e = g->target_offsets[u]; e < g->target_offsets[u + 1]; e++) {
+            size_t const v = g->target_list[e];
+            if (v != u && --in_degree[v] == 0) order[placed++] = v;
+        }
+    }
+
+    return placed;
+}
+
+static int compare_keys(void const* x, void const* y) {
+    uint64_t const a = *(uint64_t const*)x;
+    uint64_t const b = *(uint64_t const*)y;
+    return (a > b) - (a < b);
+}
+
+/*
+ * Orders the graph with the reverse Cuthill-McKee algorithm, treating the edges as undirected. Every connected part
+ * of the graph is traversed breadth-first from its vertex of the smallest degree, visiting neighbours in the order of
+ * increasing degree. The resulting order is reversed.
+ */
+static bool reverse_cuthill_mckee(automata_graph_t const* g, size_t* order) {
+    size_t const num = g->num;
+
+    // keys hold the degree in the upper half and the vertex in the lower half, so sorting them orders by degree
+    uint64_t* keys = (uint64_t*)malloc(num * sizeof(uint64_t));
+    bool* visited = (bool*)calloc(num, sizeof(bool));
+    if (!keys || !visited) {
+        free(keys);
+        free(visited);
+        errno = ENOMEM;
+        return false;
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        uint64_t const degree = g->source_offsets[i + 1] - g->source_offsets[i] +
+                                g->target_offsets[i + 1] - g->target_offsets[i];
+        keys[i] = (degree << 32) | i;
+    }
+
+    uint64_t* starts = (uint64_t*)malloc(num * sizeof(uint64_t));
+    uint64_t* neighbours = (uint64_t*)malloc(num * sizeof(uint64_t));
+    if (!starts || !neighbours) {
+        free(keys);
+        free(visited);
+        free(starts);
+        free(neighbours);
+        errno = ENOMEM;
+        return false;
+    }
+    memcpy(starts, keys, num * sizeof(uint64_t));
+    qsort(starts, num, sizeof(uint64_t), compare_keys);
+
+    size_t placed = 0;
+    for (size_t k = 0; k < num; k++) {
+        size_t const start = (size_t)(starts[k] & 0xFFFFFFFFULL);
+        if (visited[start]) continue;
+
+        visited[start] = true;
+        order[placed++] = start;
+
+        for (size_t head = placed - 1; head < placed; head++) {
+            size_t const u = order[head];
+            size_t added = 0;
+
+            for (size_t e = g->source_offsets[u]; e < g->source_offsets[u + 1]; e++) {
+                size_t const v = g->source_list[e];
+                if (!visited[v]) {
+                    visited[v] = true;
+                    neighbours[added++] = keys[v];
+                }
+            }
+            for (size_t e = g->target_offsets[u]; e < g->target_offsets[u + 1]; e++) {
+                size_t const v = g->target_list[e];
+                if (!visited[v]) {
+                    visited[v] = true;
+                    neighbours[added++] = keys[v];
+                }
+            }
+
+            // the neighbours are visited in the order of increasing degree
+            qsort(neighbours, added, sizeof(uint64_t), compare_keys);
+            for (size_t i = 0; i < added; i++) {
+                order[placed++] = (size_t)(neighbours[i] & 0xFFFFFFFFULL);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < num / 2; i++) {
+        size_t const tmp = order[i];
+        order[i] = order[num - 1 - i];
+        order[num - 1 - i] = tmp;
+    }
+
+    free(keys);
+    free(visited);
+    free(starts);
+    free(neighbours);
+    return true;
+}
+
+/*
+ * Computes the order of the vertices of the graph: 'order[k]' is the vertex placed at position 'k'. Acyclic graphs are
+ * levelized, other graphs are ordered with the reverse Cuthill-McKee algorithm.
+ *
+ * Returns false and sets errno to ENOMEM if a memory allocation error occurs.
+ */
+bool compute_order(automata_graph_t const* g, size_t* order) {
+    size_t* in_degree = (size_t*)malloc((g->num + 1) * sizeof(size_t));
+    if (!in_degree) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    size_t const placed = levelize(g, order, in_degree);
+    free(in_degree);
+
+    if (placed == g->num) {
+        return true;
+    }
+
+    return reverse_cuthill_mckee(g, order);
+}
+
+/*
+ * Splits the vertices of the graph into 'parts' parts of nearly equal size, trying to minimize the number of connected
+ * bits between different parts. The vertices are first ordered with compute_order and the order is cut into contiguous
+ * blocks, then every vertex is moved to the neighbouring part it shares the most bits with, as long as this reduces
+ * the cut and keeps the parts balanced. 'part_of[i]' receives the part of the vertex 'i'.
+ *
+ * Returns false and sets errno to ENOMEM if a memory allocation error occurs.
+ */
+bool partition_graph(automata_graph_t const* g, size_t const parts, size_t* part_of) {
+    size_t const num = g->num;
+
+    size_t* order = (size_t*)malloc(num * sizeof(size_t));
+    size_t* sizes = (size_t*)calloc(parts, sizeof(size_t));
+    size_t* shared = (size_t*)calloc(parts, sizeof(size_t)); // bits shared with every part by the current vertex
+    if (!order || !sizes || !shared) {
+        free(order);
+        free(sizes);
+        free(shared);
+        errno = ENOMEM;
+        return false;
+    }
+
+    if (!compute_order(g, order)) {
+        free(order);
+        free(sizes);
+        free(shared);
+        return false;
+    }
+
+    for (size_t k = 0; k < num; k++) {
+        part_of[order[k]] = k * parts / num;
+        sizes[k * parts / num]++;
+    }
+
+    size_t const max_size = (num + parts - 1) / parts + (num / parts) / 20 + 1;
+
+    for (size_t pass = 0; pass < 2; pass++) {
+        for (size_t v = 0; v < num; v++) {
+            size_t const own = part_of[v];
+            if (sizes[own] == 1) continue;
+
+            for (size_t e = g->source_offsets[v]; e < g->source_offsets[v + 1]; e++) {
+                if (g->source_list[e] != v) shared[part_of[g->source_list[e]]] += g->source_weights[e];
+            }
+            for (size_t e = g->target_offsets[v]; e < g->target_offsets[v + 1]; e++) {
+                if (g->target_list[e] != v) shared[part_of[g->target_list[e]]] += g->target_weights[e];
+            }
+
+            size_t best = own;
+            for (size_t e = g->source_offsets[v]; e < g->source_offsets[v + 1]; e++) {
+                size_t const part = part_of[g->source_list[e]];
+                if (shared[part] > shared[best] && sizes[part] < max_size) best = part;
+            }
+            for (size_t e = g->target_offsets[v]; e < g->target_offsets[v + 1]; e++) {
+                size_t const part = part_of[g->target_list[e]];
+                if (shared[part] > shared[best] && sizes[part] < max_size) best = part;
+            }
+
+            // clearing only the entries that were touched
+            for (size_t e = g->source_offsets[v]; e < g->source_offsets[v + 1]; e++) {
+                shared[part_of[g->source_list[e]]] = 0;
+            }
+            for (size_t e = g->target_offsets[v]; e < g->target_offsets[v + 1]; e++) {
+                shared[part_of[g->target_list[e]]] = 0;
+            }
+            shared[own] = 0;
+
+            if (best != own) {
+                sizes[own]--;
+                sizes[best]++;
+                part_of[v] = best;
+            }
+        }
+    }
+
+    free(order);
+    free(sizes);
+    free(shared);
+    return true;
+}
+
+/*
+ * The function reorders the array 'at[]' so that automata connected to each other are close to each other. If the
+ * connections between the automata of the array form no cycle, every automaton is placed after the automata it reads
+ * from. Otherwise, the array is ordered to reduce the distance between connected automata (reverse Cuthill-McKee).
+ * The set of automata in the array does not change, so the result of ma_step on the array stays the same.
+ *
+ * It returns 0, or -1 if any pointer is NULL, 'num' is 0, or a memory allocation error occurred, setting errno to
+ * EINVAL or ENOMEM, respectively.
+ */
+int ma_order(moore_t* at[], size_t num) {
+    if (!at || num == 0 || null_in_the_array(at, num)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t* order = (size_t*)malloc(num * sizeof(size_t));
+    moore_t** copy = (moore_t**)malloc(num * sizeof(moore_t*));
+    if (!order || !copy) {
+        free(order);
+        free(copy);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    automata_graph_t g;
+    if (!build_graph(&g, at, num) || !compute_order(&g, order)) {
+        free_graph(&g);
+        free(order);
+        free(copy);
+        return -1;
+    }
+
+    memcpy(copy, at, num * sizeof(moore_t*));
+    for (size_t k = 0; k < num; k++) {
+        at[k] = copy[order[k]];
+    }
+
+    free_graph(&g);
+    free(order);
+    free(copy);
+    return 0;
+}
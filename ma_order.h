@@ -0,0 +1,9 @@
+#ifndef MA_ORDER_H
+#define MA_ORDER_H
+
+#include <stddef.h>
+#include "ma.h"
+
+int ma_order(moore_t *at[], size_t num);
+
+#endif //MA_ORDER_H
@@ -0,0 +1,244 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Packed global output buffer. The outputs of a network of automata are moved into one contiguous block of shared
+ * memory, one after another in the order of the array, so a host can read all of them with one linear scan. The memory
+ * is a memfd, so another process can map it read-only through the file descriptor; it starts with a header and the
+ * offset table (see ma_output.h), so the reader needs nothing else. The values are written there by ma_step directly,
+ * without any copying.
+ *
+ * While an automaton is a member of the buffer, its own output buffer is kept aside. Deleting the automaton, or
+ * deleting the buffer, moves the output back to it.
+ **/
+
+#define _GNU_SOURCE
+
+#include "ma.h"
+#include "ma_additional.h"
+#include "ma_output.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define FILL_THE_BLOCK 63
+#define BITS_PER_BLOCK 64
+#define NOT_FOUND ((size_t)-1)
+#define DATA_ALIGNMENT 64
+
+typedef struct ma_output_buffer {
+    size_t num;
+    moore_t** at;     // members, NULL after the automaton was deleted
+    uint64_t** owned; // own output buffers of the members, used again when they leave
+    automata_index_t index;
+
+    int fd;
+    void* memory;
+    size_t memory_size;
+    uint64_t* data;
+    uint64_t const* offsets;
+} ma_output_buffer_t;
+
+static void free_buffer(ma_output_buffer_t* b) {
+    if (b->memory) munmap(b->memory, b->memory_size);
+    if (b->fd >= 0) close(b->fd);
+    free_index(&b->index);
+    free(b->at);
+    free(b->owned);
+    free(b);
+}
+
+/*
+ * Moves the output of the automaton 'a' from its output buffer back to its own buffer. Called when the automaton is
+ * deleted and for all members when the buffer is deleted.
+ */
+void detach_output(moore_t* a) {
+    ma_output_buffer_t* b = a->output_buffer;
+    size_t const i = find_index(&b->index, a);
+    size_t const blocks = (a->output_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+
+    memcpy(b->owned[i], a->output, blocks * sizeof(uint64_t));
+    a->output = b->owned[i];
+    a->output_buffer = NULL;
+    b->at[i] = NULL;
+}
+
+/*
+ * Returns the own output buffer of the automaton, which is not the one it writes to while it is a member of an output
+ * buffer.
+ */
+uint64_t* owned_output(moore_t const* a) {
+    return a->output_buffer ? a->output_buffer->owned[find_index(&a->output_buffer->index, a)] : a->output;
+}
+
+/*
+ * Replaces the own output buffer of the automaton with 'output', which already holds its values. Used by code moving
+ * the buffers of automata around, so that members of an output buffer stay there.
+ */
+void replace_owned_output(moore_t* a, uint64_t* output) {
+    if (a->output_buffer) {
+        a->output_buffer->owned[find_index(&a->output_buffer->index, a)] = output;
+    }
+    else {
+        a->output = output;
+    }
+}
+
+/*
+ * The function moves the outputs of the automata 'at' into a new packed output buffer, in the order of the array. The
+ * automata keep working as before, their outputs are only read from the buffer.
+ *
+ * It returns a pointer to the buffer, or NULL if 'at' is NULL, 'num' is 0, any automaton is NULL, occurs twice or is
+ * already a member of another output buffer, setting errno to EINVAL, or if a memory allocation error occurred,
+ * setting errno to ENOMEM, or if the shared memory could not be created, setting errno as memfd_create or mmap did.
+ */
+ma_output_buffer_t* ma_output_buffer_create(moore_t* at[], size_t num) {
+    if (!at || num == 0 || null_in_the_array(at, num)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ma_output_buffer_t* b = (ma_output_buffer_t*)calloc(1, sizeof(ma_output_buffer_t));
+    if (!b) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    b->fd = -1;
+    b->num = num;
+
+    b->at = (moore_t**)malloc(num * sizeof(moore_t*));
+    b->owned = (uint64_t**)malloc(num * sizeof(uint64_t*));
+    if (!b->at || !b->owned) {
+        free_buffer(b);
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (!build_index(&b->index, at, num)) {
+        free_buffer(b);
+        return NULL;
+    }
+
+    size_t blocks = 0;
+    for (size_t i = 0; i < num; i++) {
+        if (find_index(&b->index, at[i]) != i || at[i]->output_buffer) {
+            free_buffer(b);
+            errno = EINVAL;
+            return NULL;
+        }
+        blocks += (at[i]->output_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+    }
+
+    size_t const table_end = sizeof(ma_output_header_t) + num * sizeof(uint64_t);
+    size_t const data_offset = (table_end + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+    b->memory_size = data_offset + blocks * sizeof(uint64_t);
+
+    b->fd = memfd_create("ma_output", MFD_CLOEXEC);
+    if (b->fd < 0 || ftruncate(b->fd, (off_t)b->memory_size) != 0) {
+        int const error = errno;
+        free_buffer(b);
+        errno = error;
+        return NULL;
+    }
+
+    b->memory = mmap(NULL, b->memory_size, PROT_READ | PROT_WRITE, MAP_SHARED, b->fd, 0);
+    if (b->memory == MAP_FAILED) {
+        int const error = errno;
+        b->memory = NULL;
+        free_buffer(b);
+        errno = error;
+        return NULL;
+    }
+
+    ma_output_header_t* header = (ma_output_header_t*)b->memory;
+    uint64_t* offsets = (uint64_t*)(header + 1);
+    b->data = (uint64_t*)((char*)b->memory + data_offset);
+    b->offsets = offsets;
+
+    size_t offset = 0;
+    for (size_t i = 0; i < num; i++) {
+        moore_t* a = at[i];
+        size_t const output_blocks = (a->output_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+
+        offsets[i] = offset;
+        memcpy(b->data + offset, a->output, output_blocks * sizeof(uint64_t));
+
+        b->at[i] = a;
+        b->owned[i] = a->output;
+        a->output = b->data + offset;
+        a->output_buffer = b;
+        offset += output_blocks;
+    }
+
+    header->num = num;
+    header->blocks = blocks;
+    header->data_offset = data_offset;
+    header->magic = MA_OUTPUT_MAGIC;
+
+    return b;
+}
+
+/*
+ * The function deletes the output buffer, moving the outputs of its remaining members back to their own buffers.
+ * Processes which mapped the memory keep their mappings. It does nothing if called with a NULL pointer.
+ */
+void ma_output_buffer_delete(ma_output_buffer_t* b) {
+    if (b) {
+        for (size_t i = 0; i < b->num; i++) {
+            if (b->at[i]) detach_output(b->at[i]);
+        }
+        free_buffer(b);
+    }
+}
+
+/*
+ * Returns the packed outputs, or NULL if the pointer is NULL, setting errno to EINVAL. The output of the 'i'-th
+ * automaton starts at the block 'ma_output_buffer_offsets(b)[i]'.
+ */
+uint64_t const* ma_output_buffer_data(ma_output_buffer_t const* b) {
+    if (!b) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return b->data;
+}
+
+/*
+ * Returns the offsets of the outputs of the automata in blocks, in the order of the array the buffer was created from,
+ * or NULL if the pointer is NULL, setting errno to EINVAL. The offsets do not change while the buffer exists.
+ */
+uint64_t const* ma_output_buffer_offsets(ma_output_buffer_t const* b) {
+    if (!b) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return b->offsets;
+}
+
+/*
+ * Returns the number of blocks of all outputs, or 0 if the pointer is NULL, setting errno to EINVAL.
+ */
+size_t ma_output_buffer_blocks(ma_output_buffer_t const* b) {
+    if (!b) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return (size_t)((ma_output_header_t const*)b->memory)->blocks;
+}
+
+/*
+ * Returns the file descriptor of the memory of the buffer, which other processes can map read-only, or -1 if the
+ * pointer is NULL, setting errno to EINVAL. The descriptor is closed when the buffer is deleted.
+ */
+int ma_output_buffer_fd(ma_output_buffer_t const* b) {
+    if (!b) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return b->fd;
+}
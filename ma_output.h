@@ -0,0 +1,28 @@
+#ifndef MA_OUTPUT_H
+#define MA_OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ma.h"
+
+#define MA_OUTPUT_MAGIC 0x54555054554F414DULL // "MAOUTPUT" in little endian
+
+// Beginning of the memory of an output buffer, which can be mapped by other processes through the file descriptor.
+// It is followed by 'num' offsets (uint64_t) of the outputs of the automata in blocks, counted from 'data_offset'.
+typedef struct ma_output_header {
+    uint64_t magic;
+    uint64_t num;
+    uint64_t blocks;      // blocks of all outputs
+    uint64_t data_offset; // in bytes from the beginning of the memory, a multiple of 64
+} ma_output_header_t;
+
+typedef struct ma_output_buffer ma_output_buffer_t;
+
+ma_output_buffer_t * ma_output_buffer_create(moore_t *at[], size_t num);
+void ma_output_buffer_delete(ma_output_buffer_t *b);
+uint64_t const * ma_output_buffer_data(ma_output_buffer_t const *b);
+uint64_t const * ma_output_buffer_offsets(ma_output_buffer_t const *b);
+size_t ma_output_buffer_blocks(ma_output_buffer_t const *b);
+int ma_output_buffer_fd(ma_output_buffer_t const *b);
+
+#endif //MA_OUTPUT_H
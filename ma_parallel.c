@@ -0,0 +1,560 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Parallel step engine. The connection graph of the stepped automata is split into shards with few connections between
+ * them, and every shard is stepped by its own thread. Shards are spread over the NUMA nodes of the machine, each thread
+ * is pinned to the processors of its node and moves the buffers of its automata, so that they are first touched (and
+ * therefore allocated) on that node.
+ *
+ * Outputs read across shards are copied once per step into a mirror buffer owned by the reading shard, so during the
+ * gather phase a thread reads only node-local memory. Every step consists of the exchange phase, which fills the
+ * mirrors, and the gather and compute phases, separated by barriers, which keeps the semantics of ma_step.
+ **/
+
+#define _GNU_SOURCE
+
+#include "ma.h"
+#include "ma_additional.h"
+#include "ma_parallel.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define FILL_THE_BLOCK 63
+#define BITS_PER_BLOCK 64
+#define MAX_NODES 64
+#define NOT_FOUND ((size_t)-1)
+
+// A single connected input bit, copied during the gather phase.
+typedef struct gather_entry {
+    uint64_t* input_block;
+    uint64_t const* source_block;
+    unsigned bit;
+    unsigned source_bit;
+} gather_entry_t;
+
+typedef struct shard {
+    struct ma_parallel* engine;
+    size_t id;
+    pthread_t thread;
+
+    moore_t** automata;
+    size_t size;
+
+    gather_entry_t* gather;
+    size_t gather_size;
+
+    size_t* remote;        // positions of the automata of other shards read by this shard, sorted
+    size_t* remote_offset; // offsets of their copies in the mirror
+    size_t remote_size;
+    uint64_t* mirror;
+
+    uint64_t* next_state;
+    bool failed;
+} shard_t;
+
+typedef struct ma_parallel {
+    moore_t** at;
+    size_t num;
+    automata_index_t index;
+    size_t* part_of;
+
+    shard_t* shards;
+    size_t shards_num;
+    size_t cut;
+
+    barrier_t control; // the caller and all threads
+    barrier_t phase;   // all threads
+
+    size_t steps;
+    bool stop;
+
+    size_t nodes_num;
+    cpu_set_t node_cpus[MAX_NODES];
+} ma_parallel_t;
+
+void barrier_init(barrier_t* b, size_t const count) {
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->released, NULL);
+    b->count = count;
+    b->waiting = 0;
+    b->generation = 0;
+}
+
+void barrier_destroy(barrier_t* b) {
+    pthread_mutex_destroy(&b->lock);
+    pthread_cond_destroy(&b->released);
+}
+
+static void barrier_release(barrier_t* b) {
+    b->waiting = 0;
+    b->generation++;
+    pthread_cond_broadcast(&b->released);
+}
+
+void barrier_wait(barrier_t* b) {
+    pthread_mutex_lock(&b->lock);
+
+    size_t const generation = b->generation;
+    if (++b->waiting >= b->count) {
+        barrier_release(b);
+    }
+    else {
+        while (generation == b->generation) {
+            pthread_cond_wait(&b->released, &b->lock);
+        }
+    }
+
+    pthread_mutex_unlock(&b->lock);
+}
+
+void barrier_resize(barrier_t* b, size_t const count) {
+    pthread_mutex_lock(&b->lock);
+
+    b->count = count;
+    if (b->waiting > 0 && b->waiting >= b->count) {
+        barrier_release(b);
+    }
+
+    pthread_mutex_unlock(&b->lock);
+}
+
+/*
+ * Reads the processors of every NUMA node from sysfs. Returns the number of nodes found, 0 if the information is not
+ * available.
+ */
+static size_t read_numa_nodes(cpu_set_t* nodes) {
+    size_t count = 0;
+
+    for (int node = 0; node < MAX_NODES; node++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+
+        FILE* file = fopen(path, "r");
+        if (!file) continue; // node numbers do not have to be contiguous
+
+        char line[1024];
+        CPU_ZERO(&nodes[count]);
+
+        if (fgets(line, sizeof(line), file)) {
+            char* current = line;
+            while (*current >= '0' && *current <= '9') {
+                long const first = strtol(current, &current, 10);
+                long last = first;
+                if (*current == '-') last = strtol(current + 1, &current, 10);
+
+                for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+                    CPU_SET((int)cpu, &nodes[count]);
+                }
+                if (*current == ',') current++;
+            }
+        }
+
+        fclose(file);
+        if (CPU_COUNT(&nodes[count]) > 0) count++;
+    }
+
+    return count;
+}
+
+/*
+ * Moves the buffers of the automaton to memory allocated by the calling thread. Automata of pools are left in place,
+ * their buffers belong to the pool.
+ */
+static bool relocate_buffers(moore_t* a) {
+    if (a->pool) {
+        return true;
+    }
+
+    size_t const state_blocks = (a->state_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+    size_t const output_blocks = (a->output_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+    size_t const input_blocks = (a->input_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+
+    uint64_t* state = (uint64_t*)malloc(2 * state_blocks * sizeof(uint64_t)); // with the buffer for the next state
+    uint64_t* output = (uint64_t*)malloc(output_blocks * sizeof(uint64_t));
+    uint64_t* input = input_blocks != 0 ? (uint64_t*)malloc(2 * input_blocks * sizeof(uint64_t)) : NULL; // with the mask
+    if (!state || !output || (input_blocks != 0 && !input)) {
+        free(state);
+        free(output);
+        free(input);
+        return false;
+    }
+
+    memcpy(state, a->state, state_blocks * sizeof(uint64_t));
+    memcpy(output, a->output, output_blocks * sizeof(uint64_t));
+    if (input) memcpy(input, a->input, 2 * input_blocks * sizeof(uint64_t));
+
+    free(a->state);
+    free(owned_output(a));
+    free(a->input);
+    a->state = state;
+    a->next_state = state + state_blocks;
+    replace_owned_output(a, output); // members of an output buffer keep writing there
+    a->input = input;
+    a->connected = input ? input + input_blocks : NULL;
+
+    return true;
+}
+
+static int compare_positions(void const* x, void const* y) {
+    size_t const a = *(size_t const*)x;
+    size_t const b = *(size_t const*)y;
+    return (a > b) - (a < b);
+}
+
+/*
+ * Moves the buffers of the automata of the shard and prepares its mirror. Returns false if a memory allocation error
+ * occurs.
+ */
+static bool prepare_shard(shard_t* sh) {
+    ma_parallel_t const* e = sh->engine;
+    size_t state_blocks = 1;
+
+    for (size_t k = 0; k < sh->size; k++) {
+        moore_t* a = sh->automata[k];
+        if (!relocate_buffers(a)) return false;
+
+        size_t const blocks = (a->state_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+        if (blocks > state_blocks) state_blocks = blocks;
+
+        for (size_t bit = 0; bit < a->input_signals_num; bit++) {
+            if (a->incoming_connections[bit].source_aut) sh->gather_size++;
+        }
+    }
+
+    sh->next_state = (uint64_t*)calloc(state_blocks, sizeof(uint64_t));
+    sh->gather = (gather_entry_t*)malloc((sh->gather_size + 1) * sizeof(gather_entry_t));
+    sh->remote = (size_t*)malloc((sh->gather_size + 1) * sizeof(size_t));
+    if (!sh->next_state || !sh->gather || !sh->remote) return false;
+
+    // collecting the automata of other shards read by this shard
+    for (size_t k = 0; k < sh->size; k++) {
+        moore_t const* a = sh->automata[k];
+        for (size_t bit = 0; bit < a->input_signals_num; bit++) {
+            incoming_t const* connection = &a->incoming_connections[bit];
+            if (!connection->source_aut) continue;
+
+            size_t const j = find_index(&e->index, connection->source_aut);
+            if (j != NOT_FOUND && e->part_of[j] != sh->id) sh->remote[sh->remote_size++] = j;
+        }
+    }
+
+    qsort(sh->remote, sh->remote_size, sizeof(size_t), compare_positions);
+    size_t unique = 0;
+    for (size_t r = 0; r < sh->remote_size; r++) {
+        if (unique == 0 || sh->remote[unique - 1] != sh->remote[r]) sh->remote[unique++] = sh->remote[r];
+    }
+    sh->remote_size = unique;
+
+    sh->remote_offset = (size_t*)malloc((unique + 1) * sizeof(size_t));
+    if (!sh->remote_offset) return false;
+
+    size_t mirror_blocks = 0;
+    for (size_t r = 0; r < unique; r++) {
+        sh->remote_offset[r] = mirror_blocks;
+        mirror_blocks += (e->at[sh->remote[r]]->output_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+    }
+
+    sh->mirror = (uint64_t*)calloc(mirror_blocks + 1, sizeof(uint64_t));
+    return sh->mirror != NULL;
+}
+
+/*
+ * Fills the gather entries of the shard. It has to be called after all shards moved their buffers, because the entries
+ * point into the outputs of the automata.
+ */
+static void build_gather(shard_t* sh) {
+    ma_parallel_t const* e = sh->engine;
+    size_t entry = 0;
+
+    for (size_t k = 0; k < sh->size; k++) {
+        moore_t* a = sh->automata[k];
+        for (size_t bit = 0; bit < a->input_signals_num; bit++) {
+            incoming_t const* connection = &a->incoming_connections[bit];
+            if (!connection->source_aut) continue;
+
+            moore_t const* source = connection->source_aut;
+            size_t const source_block = connection->source_bit / BITS_PER_BLOCK;
+            size_t const j = find_index(&e->index, source);
+
+            gather_entry_t* g = &sh->gather[entry++];
+            g->input_block = &a->input[bit / BITS_PER_BLOCK];
+            g->bit = (unsigned)(bit % BITS_PER_BLOCK);
+            g->source_bit = (unsigned)(connection->source_bit % BITS_PER_BLOCK);
+
+            if (j != NOT_FOUND && e->part_of[j] != sh->id) {
+                size_t const* found = (size_t const*)bsearch(&j, sh->remote, sh->remote_size, sizeof(size_t),
+                                                             compare_positions);
+                g->source_block = sh->mirror + sh->remote_offset[found - sh->remote] + source_block;
+            }
+            else {
+                g->source_block = &source->output[source_block];
+            }
+        }
+    }
+}
+
+static void step_shard(shard_t* sh) {
+    ma_parallel_t* e = sh->engine;
+
+    // exchange: copying the outputs of other shards into the mirror
+    for (size_t r = 0; r < sh->remote_size; r++) {
+        moore_t const* source = e->at[sh->remote[r]];
+        size_t const blocks = (source->output_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+        memcpy(sh->mirror + sh->remote_offset[r], source->output, blocks * sizeof(uint64_t));
+    }
+
+    barrier_wait(&e->phase);
+
+    // gather
+    for (size_t k = 0; k < sh->gather_size; k++) {
+        gather_entry_t const* g = &sh->gather[k];
+        uint64_t const value = (*g->source_block >> g->source_bit) & 1;
+        *g->input_block = (*g->input_block & ~(1ULL << g->bit)) | (value << g->bit);
+    }
+
+    // compute
+    for (size_t k = 0; k < sh->size; k++) {
+        apply_transition(sh->automata[k], sh->next_state);
+    }
+
+    barrier_wait(&e->phase);
+}
+
+static void* shard_main(void* arg) {
+    shard_t* sh = (shard_t*)arg;
+    ma_parallel_t* e = sh->engine;
+
+    barrier_wait(&e->control); // all threads were started
+    if (e->stop) return NULL;
+
+    if (e->nodes_num > 1) {
+        size_t const node = sh->id * e->nodes_num / e->shards_num;
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &e->node_cpus[node]);
+    }
+
+    sh->failed = !prepare_shard(sh);
+    barrier_wait(&e->phase);
+    if (!sh->failed) build_gather(sh);
+    barrier_wait(&e->control); // setup finished
+
+    for (;;) {
+        barrier_wait(&e->control); // a command was given
+        if (e->stop) break;
+
+        for (size_t s = 0; s < e->steps; s++) {
+            step_shard(sh);
+        }
+
+        barrier_wait(&e->control); // the steps were done
+    }
+
+    return NULL;
+}
+
+static void free_engine(ma_parallel_t* e) {
+    if (e->shards) {
+        for (size_t i = 0; i < e->shards_num; i++) {
+            free(e->shards[i].automata);
+            free(e->shards[i].gather);
+            free(e->shards[i].remote);
+            free(e->shards[i].remote_offset);
+            free(e->shards[i].mirror);
+            free(e->shards[i].next_state);
+        }
+    }
+
+    free(e->shards);
+    free(e->part_of);
+    free(e->at);
+    free_index(&e->index);
+    free(e);
+}
+
+/*
+ * Stops the first 'started' threads of the engine and frees it. Threads are waiting on the control barrier.
+ */
+static void stop_engine(ma_parallel_t* e, size_t const started) {
+    e->stop = true;
+    barrier_resize(&e->control, started + 1);
+    barrier_wait(&e->control);
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(e->shards[i].thread, NULL);
+    }
+
+    barrier_destroy(&e->control);
+    barrier_destroy(&e->phase);
+    free_engine(e);
+}
+
+/*
+ * Splits the automata between the shards and counts the connected bits between different shards.
+ */
+static bool assign_shards(ma_parallel_t* e) {
+    automata_graph_t g;
+    if (!build_graph(&g, e->at, e->num) || !partition_graph(&g, e->shards_num, e->part_of)) {
+        free_graph(&g);
+        return false;
+    }
+
+    for (size_t i = 0; i < e->num; i++) {
+        for (size_t k = g.source_offsets[i]; k < g.source_offsets[i + 1]; k++) {
+            if (e->part_of[g.source_list[k]] != e->part_of[i]) e->cut += g.source_weights[k];
+        }
+    }
+    free_graph(&g);
+
+    for (size_t i = 0; i < e->num; i++) {
+        e->shards[e->part_of[i]].size++;
+    }
+
+    for (size_t s = 0; s < e->shards_num; s++) {
+        e->shards[s].engine = e;
+        e->shards[s].id = s;
+        e->shards[s].automata = (moore_t**)malloc(e->shards[s].size * sizeof(moore_t*));
+        if (!e->shards[s].automata) {
+            errno = ENOMEM;
+            return false;
+        }
+        e->shards[s].size = 0;
+    }
+
+    for (size_t i = 0; i < e->num; i++) {
+        shard_t* sh = &e->shards[e->part_of[i]];
+        sh->automata[sh->size++] = e->at[i];
+    }
+
+    return true;
+}
+
+/*
+ * The function creates a parallel step engine for the automata from the array 'at[]', stepped by 'threads' threads
+ * (the number of online processors if 'threads' is 0, at most one thread per automaton). The automata are split into
+ * shards with few connections between them, spread over the NUMA nodes. The buffers of the automata are moved to
+ * memory of the nodes, so pointers returned earlier by ma_get_output become invalid.
+ *
+ * The engine works on a snapshot of the connections. The automata must not be connected, disconnected or deleted while
+ * the engine exists.
+ *
+ * It returns a pointer to the engine, or NULL if any pointer is NULL, 'num' is 0 or an automaton occurs twice, a
+ * memory allocation error occurred or a thread could not be started, setting errno to EINVAL, ENOMEM or EAGAIN,
+ * respectively.
+ */
+ma_parallel_t* ma_parallel_create(moore_t* at[], size_t num, size_t threads) {
+    if (!at || num == 0 || null_in_the_array(at, num)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (threads == 0) {
+        long const online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (size_t)online : 1;
+    }
+    if (threads > num) threads = num;
+
+    ma_parallel_t* e = (ma_parallel_t*)calloc(1, sizeof(ma_parallel_t));
+    if (!e) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    e->num = num;
+    e->shards_num = threads;
+    e->at = (moore_t**)malloc(num * sizeof(moore_t*));
+    e->part_of = (size_t*)malloc(num * sizeof(size_t));
+    e->shards = (shard_t*)calloc(threads, sizeof(shard_t));
+    if (!e->at || !e->part_of || !e->shards) {
+        free_engine(e);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memcpy(e->at, at, num * sizeof(moore_t*));
+    bool ok = build_index(&e->index, e->at, num);
+
+    // the shards would relocate the buffers of a repeated automaton at the same time
+    for (size_t i = 0; ok && i < num; i++) {
+        if (find_index(&e->index, e->at[i]) != i) {
+            ok = false;
+            errno = EINVAL;
+        }
+    }
+
+    if (!ok || !assign_shards(e)) {
+        free_engine(e);
+        return NULL;
+    }
+
+    e->nodes_num = read_numa_nodes(e->node_cpus);
+    barrier_init(&e->control, threads + 1);
+    barrier_init(&e->phase, threads);
+
+    for (size_t s = 0; s < threads; s++) {
+        if (pthread_create(&e->shards[s].thread, NULL, shard_main, &e->shards[s]) != 0) {
+            stop_engine(e, s);
+            errno = EAGAIN;
+            return NULL;
+        }
+    }
+
+    barrier_wait(&e->control); // all threads were started
+    barrier_wait(&e->control); // setup finished
+
+    for (size_t s = 0; s < threads; s++) {
+        if (e->shards[s].failed) {
+            stop_engine(e, threads);
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+
+    return e;
+}
+
+/*
+ * The function performs 'steps' computation steps of all automata of the engine. The result is the same as calling
+ * ma_step 'steps' times on the array the engine was created with.
+ *
+ * It returns 0, or -1 if the pointer is NULL or 'steps' is 0, setting errno to EINVAL.
+ */
+int ma_parallel_step(ma_parallel_t* e, size_t steps) {
+    if (!e || steps == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    e->steps = steps;
+    barrier_wait(&e->control); // giving the command
+    barrier_wait(&e->control); // waiting for the steps to be done
+
+    return 0;
+}
+
+/*
+ * Returns the number of connected bits between automata of different shards, or 0 if the pointer is NULL, setting
+ * errno to EINVAL.
+ */
+size_t ma_parallel_cut(ma_parallel_t const* e) {
+    if (!e) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return e->cut;
+}
+
+/*
+ * The function stops the threads of the engine and frees it. The automata stay valid. It does nothing if called with
+ * a NULL pointer.
+ */
+void ma_parallel_delete(ma_parallel_t* e) {
+    if (e) {
+        stop_engine(e, e->shards_num);
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef MA_PARALLEL_H
+#define MA_PARALLEL_H
+
+#include <stddef.h>
+#include "ma.h"
+
+typedef struct ma_parallel ma_parallel_t;
+
+ma_parallel_t * ma_parallel_create(moore_t *at[], size_t num, size_t threads);
+int ma_parallel_step(ma_parallel_t *e, size_t steps);
+size_t ma_parallel_cut(ma_parallel_t const *e);
+void ma_parallel_delete(ma_parallel_t *e);
+
+#endif //MA_PARALLEL_H
@@ -0,0 +1,370 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Hardware performance counters of ma_step, read through perf_event_open. While sampling is on, every call of ma_step
+ * made by the thread which started sampling reads the counters before gathering the inputs, after gathering and after
+ * computing the new states, and records the counts of both phases. The other threads step without sampling, because
+ * the counters only count the thread which opened them. Calls timed by ma_profile are not sampled, since its timers
+ * would be counted too.
+ *
+ * The events are opened as one group, so a single read returns all of them. Events which the CPU or the kernel does
+ * not support are left out. If the kernel multiplexes the group, the counts are scaled by the ratio of the time the
+ * group was enabled to the time it was running. While sampling is off, the only cost is one atomic load per call of
+ * ma_step.
+ *
+ * The owner of the sampling is published before the flag turning it on, so other threads may step while sampling is
+ * started or stopped. The counters themselves are only read by the owner, which must not be stepping while sampling
+ * is stopped or restarted by another thread.
+ **/
+
+#define _GNU_SOURCE
+
+#include "ma_additional.h"
+#include "ma_perf.h"
+
+#include <linux/perf_event.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define FILL_THE_BLOCK 63
+#define BITS_PER_BLOCK 64
+
+#define CACHE_READ_MISSES(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+// Values read from the group at one moment.
+typedef struct snapshot {
+    uint64_t enabled;
+    uint64_t running;
+    uint64_t values[MA_PERF_EVENT_COUNT];
+} snapshot_t;
+
+static struct {
+    uint32_t type;
+    uint64_t config;
+    char const* name;
+} const events[MA_PERF_EVENT_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_L1D), "l1d_misses"},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_LL), "llc_misses"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch_misses"},
+};
+
+static char const* const phase_names[MA_PERF_PHASE_COUNT] = {"gather", "compute"};
+
+atomic_bool perf_sampling;
+
+static int leader = -1;
+static int fds[MA_PERF_EVENT_COUNT] = {-1, -1, -1, -1, -1};
+static size_t positions[MA_PERF_EVENT_COUNT]; // position of the value of the event in the group read
+static size_t opened;
+static bool available[MA_PERF_EVENT_COUNT]; // kept after the counters are closed
+static _Thread_local char thread_token; // its address identifies the thread which started sampling
+static atomic_uintptr_t owner; // token of the sampling thread, published before 'perf_sampling' is set
+
+static snapshot_t before_gather;
+static snapshot_t after_gather;
+
+static ma_perf_sample_t* samples;
+static size_t max_samples;
+static size_t sampled_steps;
+static uint64_t totals[MA_PERF_PHASE_COUNT][MA_PERF_EVENT_COUNT];
+
+static int open_event(ma_perf_event_t const event, int const group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+
+    attr.size = sizeof(attr);
+    attr.type = events[event].type;
+    attr.config = events[event].config;
+    attr.disabled = group == -1; // the group is enabled once all events are opened
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+static void close_events(void) {
+    for (size_t event = 0; event < MA_PERF_EVENT_COUNT; event++) {
+        if (fds[event] >= 0) close(fds[event]);
+        fds[event] = -1;
+    }
+    leader = -1;
+    opened = 0;
+}
+
+static bool read_snapshot(snapshot_t* s) {
+    uint64_t buffer[3 + MA_PERF_EVENT_COUNT];
+    ssize_t const size = (ssize_t)((3 + opened) * sizeof(uint64_t));
+
+    if (read(leader, buffer, (size_t)size) != size || buffer[0] != opened) return false;
+
+    s->enabled = buffer[1];
+    s->running = buffer[2];
+    for (size_t event = 0; event < MA_PERF_EVENT_COUNT; event++) {
+        s->values[event] = fds[event] >= 0 ? buffer[3 + positions[event]] : 0;
+    }
+
+    return true;
+}
+
+static void difference(snapshot_t const* from, snapshot_t const* to, uint64_t counts[MA_PERF_EVENT_COUNT]) {
+    uint64_t const enabled = to->enabled - from->enabled;
+    uint64_t const running = to->running - from->running;
+
+    for (size_t event = 0; event < MA_PERF_EVENT_COUNT; event++) {
+        uint64_t count = to->values[event] - from->values[event];
+        if (running != 0 && running < enabled) { // the group was multiplexed
+            count = (uint64_t)((double)count * (double)enabled / (double)running + 0.5);
+        }
+        counts[event] = count;
+    }
+}
+
+/*
+ * Called by ma_step while sampling is on, before gathering the inputs. Returns true if the call is sampled, i.e. it
+ * was made by the thread which started sampling and the counters were read.
+ */
+bool perf_begin(void) {
+    return atomic_load_explicit(&owner, memory_order_acquire) == (uintptr_t)&thread_token &&
+           read_snapshot(&before_gather);
+}
+
+/*
+ * Called by a sampled ma_step after gathering the inputs.
+ */
+void perf_gathered(void) {
+    if (!read_snapshot(&after_gather)) after_gather = before_gather;
+}
+
+/*
+ * Called by a sampled ma_step after computing the new states. Records the counts of both phases.
+ */
+void perf_end(void) {
+    snapshot_t after_compute;
+    if (!read_snapshot(&after_compute)) return;
+
+    ma_perf_sample_t sample;
+    difference(&before_gather, &after_gather, sample.counts[MA_PERF_GATHER]);
+    difference(&after_gather, &after_compute, sample.counts[MA_PERF_COMPUTE]);
+
+    for (size_t phase = 0; phase < MA_PERF_PHASE_COUNT; phase++) {
+        for (size_t event = 0; event < MA_PERF_EVENT_COUNT; event++) {
+            totals[phase][event] += sample.counts[phase][event];
+        }
+    }
+    if (max_samples > 0) samples[sampled_steps % max_samples] = sample;
+    sampled_steps++;
+}
+
+/*
+ * The function opens the hardware counters for the calling thread and turns sampling of its calls of ma_step on,
+ * discarding the results of the previous sampling. The counts of the last 'max_samples' calls are kept separately,
+ * the others only count towards the totals.
+ *
+ * It returns 0, or -1 if none of the events could be opened, setting errno as perf_event_open did (e.g. EACCES when
+ * perf_event_paranoid forbids it, or ENOENT when the CPU has no counters), or if a memory allocation error occurred,
+ * setting errno to ENOMEM.
+ */
+int ma_perf_start(size_t max_samples_num) {
+    ma_perf_release();
+
+    if (max_samples_num > 0) {
+        samples = (ma_perf_sample_t*)calloc(max_samples_num, sizeof(ma_perf_sample_t));
+        if (!samples) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    int error = 0;
+    for (size_t event = 0; event < MA_PERF_EVENT_COUNT; event++) {
+        int const fd = open_event((ma_perf_event_t)event, leader);
+        if (fd < 0) {
+            if (!error) error = errno;
+            continue;
+        }
+
+        if (leader < 0) leader = fd;
+        fds[event] = fd;
+        available[event] = true;
+        positions[event] = opened++;
+    }
+
+    if (leader < 0) {
+        free(samples);
+        samples = NULL;
+        errno = error;
+        return -1;
+    }
+
+    max_samples = max_samples_num;
+    sampled_steps = 0;
+    memset(totals, 0, sizeof(totals));
+    atomic_store_explicit(&owner, (uintptr_t)&thread_token, memory_order_release);
+
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    atomic_store_explicit(&perf_sampling, true, memory_order_release);
+
+    return 0;
+}
+
+/*
+ * The function turns sampling off and closes the counters. The results can still be read.
+ */
+void ma_perf_stop(void) {
+    atomic_store(&perf_sampling, false);
+    atomic_store_explicit(&owner, 0, memory_order_release);
+    if (leader >= 0) ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    close_events();
+}
+
+/*
+ * The function turns sampling off and frees the memory holding the results.
+ */
+void ma_perf_release(void) {
+    ma_perf_stop();
+    memset(available, 0, sizeof(available));
+    free(samples);
+    samples = NULL;
+    max_samples = 0;
+    sampled_steps = 0;
+    memset(totals, 0, sizeof(totals));
+}
+
+/*
+ * The function writes the totals of the current or the last sampling to 'perf'. It should be called by the thread
+ * which started sampling, or after sampling was stopped.
+ *
+ * It returns 0, or -1 if the pointer is NULL, setting errno to EINVAL.
+ */
+int ma_perf_get(ma_perf_t* perf) {
+    if (!perf) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (size_t event = 0; event < MA_PERF_EVENT_COUNT; event++) {
+        perf->available[event] = available[event];
+    }
+    perf->steps = sampled_steps;
+    perf->samples = sampled_steps < max_samples ? sampled_steps : max_samples;
+    memcpy(perf->totals, totals, sizeof(totals));
+
+    return 0;
+}
+
+/*
+ * The function copies the counts of at most 'num' of the last sampled calls of ma_step to 'dest', the oldest first.
+ *
+ * It returns the number of copied samples, or 0 if 'dest' is NULL and 'num' is not 0, setting errno to EINVAL.
+ */
+size_t ma_perf_samples(ma_perf_sample_t* dest, size_t num) {
+    if (!dest && num != 0) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    size_t const kept = sampled_steps < max_samples ? sampled_steps : max_samples;
+    size_t const copied = num < kept ? num : kept;
+
+    for (size_t i = 0; i < copied; i++) {
+        dest[i] = samples[(sampled_steps - copied + i) % max_samples];
+    }
+
+    return copied;
+}
+
+static void print_counts(FILE* out, uint64_t const counts[MA_PERF_EVENT_COUNT], bool const counted[]) {
+    bool first = true;
+
+    fprintf(out, "{");
+    for (size_t event = 0; event < MA_PERF_EVENT_COUNT; event++) {
+        if (!counted[event]) continue;
+        fprintf(out, "%s\"%s\": %llu", first ? "" : ", ", events[event].name, (unsigned long long)counts[event]);
+        first = false;
+    }
+    fprintf(out, "}");
+}
+
+/*
+ * The function prints the results of the current or the last sampling to 'out' as a JSON object: the totals and the
+ * means per step of both phases, and the kept samples.
+ *
+ * It returns 0, or -1 if the pointer is NULL, setting errno to EINVAL, or if writing failed, setting errno to EIO.
+ */
+int ma_perf_dump(FILE* out) {
+    if (!out) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ma_perf_t p;
+    ma_perf_get(&p);
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"steps\": %zu,\n", p.steps);
+
+    fprintf(out, "  \"totals\": {");
+    for (size_t phase = 0; phase < MA_PERF_PHASE_COUNT; phase++) {
+        fprintf(out, "%s\"%s\": ", phase ? ", " : "", phase_names[phase]);
+        print_counts(out, p.totals[phase], p.available);
+    }
+    fprintf(out, "},\n");
+
+    fprintf(out, "  \"per_step\": {");
+    for (size_t phase = 0; phase < MA_PERF_PHASE_COUNT; phase++) {
+        bool first = true;
+
+        fprintf(out, "%s\"%s\": {", phase ? ", " : "", phase_names[phase]);
+        for (size_t event = 0; event < MA_PERF_EVENT_COUNT; event++) {
+            if (!p.available[event]) continue;
+            fprintf(out, "%s\"%s\": %.1f", first ? "" : ", ", events[event].name,
+                    p.steps ? (double)p.totals[phase][event] / (double)p.steps : 0.0);
+            first = false;
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "},\n");
+
+    fprintf(out, "  \"samples\": [");
+    for (size_t i = 0; i < p.samples; i++) {
+        ma_perf_sample_t const* s = &samples[(sampled_steps - p.samples + i) % max_samples];
+
+        fprintf(out, "%s\n    {", i ? "," : "");
+        for (size_t phase = 0; phase < MA_PERF_PHASE_COUNT; phase++) {
+            fprintf(out, "%s\"%s\": ", phase ? ", " : "", phase_names[phase]);
+            print_counts(out, s->counts[phase], p.available);
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "%s]\n}\n", p.samples ? "\n  " : "");
+
+    if (ferror(out)) {
+        errno = EIO;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the name of the event or NULL if 'event' is out of range, setting errno to EINVAL.
+ */
+char const* ma_perf_event_name(ma_perf_event_t event) {
+    if ((unsigned)event >= MA_PERF_EVENT_COUNT) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return events[event].name;
+}
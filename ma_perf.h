@@ -0,0 +1,46 @@
+#ifndef MA_PERF_H
+#define MA_PERF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Hardware events counted by ma_perf.
+typedef enum ma_perf_event {
+    MA_PERF_CYCLES,
+    MA_PERF_INSTRUCTIONS,
+    MA_PERF_L1D_MISSES,
+    MA_PERF_LLC_MISSES,
+    MA_PERF_BRANCH_MISSES,
+    MA_PERF_EVENT_COUNT
+} ma_perf_event_t;
+
+// Phases of ma_step sampled separately.
+typedef enum ma_perf_phase {
+    MA_PERF_GATHER,  // reading the inputs of all automata
+    MA_PERF_COMPUTE, // computing the new states and outputs of all automata
+    MA_PERF_PHASE_COUNT
+} ma_perf_phase_t;
+
+// Counts of a single call of ma_step.
+typedef struct ma_perf_sample {
+    uint64_t counts[MA_PERF_PHASE_COUNT][MA_PERF_EVENT_COUNT];
+} ma_perf_sample_t;
+
+typedef struct ma_perf {
+    bool available[MA_PERF_EVENT_COUNT]; // events the kernel and the CPU let us count
+    size_t steps;                        // sampled calls of ma_step
+    size_t samples;                      // calls whose counts are still kept
+    uint64_t totals[MA_PERF_PHASE_COUNT][MA_PERF_EVENT_COUNT];
+} ma_perf_t;
+
+int ma_perf_start(size_t max_samples);
+void ma_perf_stop(void);
+void ma_perf_release(void);
+int ma_perf_get(ma_perf_t *perf);
+size_t ma_perf_samples(ma_perf_sample_t *samples, size_t num);
+int ma_perf_dump(FILE *out);
+char const * ma_perf_event_name(ma_perf_event_t event);
+
+#endif //MA_PERF_H
@@ -0,0 +1,321 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Pipelined runner. Three stages run at the same time: the producer thread prepares the inputs of the next cycles,
+ * the calling thread sets them and steps the automata, and the consumer thread drains the outputs of the previous
+ * cycles. The stages are connected by two single-producer single-consumer rings of 'depth' slots, so the stepping
+ * thread only waits when the producer falls behind or the consumer cannot keep up.
+ *
+ * The rings hand whole slots over with a release store of the head or the tail index, so a slot is never copied or
+ * locked. A stage which finds its ring empty or full spins for a while and then yields the processor.
+ **/
+
+#define _GNU_SOURCE
+
+#include "ma.h"
+#include "ma_additional.h"
+#include "ma_pipeline.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILL_THE_BLOCK 63
+#define BITS_PER_BLOCK 64
+#define SPINS_BEFORE_YIELD 64
+#define CACHE_LINE 64
+
+// Ring of 'depth' slots of 'slot_blocks' blocks. The writer owns the slots from 'head' to 'tail + depth - 1', the
+// reader the slots from 'tail' to 'head - 1'. The indices only grow.
+typedef struct ring {
+    uint64_t* slots;
+    size_t slot_blocks;
+    size_t depth;
+    _Alignas(CACHE_LINE) atomic_size_t head;
+    _Alignas(CACHE_LINE) atomic_size_t tail;
+    _Alignas(CACHE_LINE) atomic_bool closed; // the writer will not write any more slots
+} ring_t;
+
+typedef struct ma_pipeline {
+    moore_t** at;
+    size_t num;
+    moore_t** with_input; // automata which have inputs, in the order of the array
+    size_t with_input_num;
+
+    ma_produce_t produce;
+    ma_consume_t consume;
+    void* context;
+
+    ring_t inputs;
+    ring_t outputs;
+    atomic_bool failed;
+
+    uint64_t first_cycle; // cycle of the first slot of the current run
+    uint64_t cycles;      // cycles stepped by all runs
+    uint64_t limit;       // cycles requested by the current run
+} ma_pipeline_t;
+
+static bool init_ring(ring_t* r, size_t const depth, size_t const slot_blocks) {
+    r->depth = depth;
+    r->slot_blocks = slot_blocks;
+    r->slots = (uint64_t*)calloc(depth * (slot_blocks ? slot_blocks : 1), sizeof(uint64_t));
+    return r->slots != NULL;
+}
+
+static void reset_ring(ring_t* r) {
+    atomic_store(&r->head, 0);
+    atomic_store(&r->tail, 0);
+    atomic_store(&r->closed, false);
+}
+
+static uint64_t* ring_slot(ring_t const* r, size_t const index) {
+    return r->slots + (index % r->depth) * r->slot_blocks;
+}
+
+static void pause_stage(unsigned* spins) {
+    if (++*spins < SPINS_BEFORE_YIELD) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+    else {
+        sched_yield();
+    }
+}
+
+/*
+ * Waits for a free slot of the ring and returns its index, or SIZE_MAX if the pipeline failed.
+ */
+static size_t wait_for_space(ma_pipeline_t* p, ring_t* r) {
+    size_t const head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    unsigned spins = 0;
+
+    while (head - atomic_load_explicit(&r->tail, memory_order_acquire) >= r->depth) {
+        if (atomic_load_explicit(&p->failed, memory_order_relaxed)) return SIZE_MAX;
+        pause_stage(&spins);
+    }
+
+    return head;
+}
+
+/*
+ * Waits for a filled slot of the ring and returns its index, or SIZE_MAX if the ring was closed and drained or the
+ * pipeline failed.
+ */
+static size_t wait_for_data(ma_pipeline_t* p, ring_t* r) {
+    size_t const tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    unsigned spins = 0;
+
+    while (atomic_load_explicit(&r->head, memory_order_acquire) == tail) {
+        if (atomic_load_explicit(&p->failed, memory_order_relaxed)) return SIZE_MAX;
+        if (atomic_load_explicit(&r->closed, memory_order_acquire) &&
+            atomic_load_explicit(&r->head, memory_order_acquire) == tail) {
+            return SIZE_MAX;
+        }
+        pause_stage(&spins);
+    }
+
+    return tail;
+}
+
+static void* producer_main(void* arg) {
+    ma_pipeline_t* p = (ma_pipeline_t*)arg;
+    ring_t* r = &p->inputs;
+
+    for (uint64_t k = 0; k < p->limit; k++) {
+        size_t const index = wait_for_space(p, r);
+        if (index == SIZE_MAX) break;
+
+        int const result = p->produce(p->context, p->first_cycle + k, ring_slot(r, index), r->slot_blocks);
+        if (result != 0) {
+            if (result < 0) atomic_store(&p->failed, true);
+            break;
+        }
+
+        atomic_store_explicit(&r->head, index + 1, memory_order_release);
+    }
+
+    atomic_store_explicit(&r->closed, true, memory_order_release);
+    return NULL;
+}
+
+static void* consumer_main(void* arg) {
+    ma_pipeline_t* p = (ma_pipeline_t*)arg;
+    ring_t* r = &p->outputs;
+
+    for (;;) {
+        size_t const index = wait_for_data(p, r);
+        if (index == SIZE_MAX) break;
+
+        if (p->consume(p->context, p->first_cycle + index, ring_slot(r, index), r->slot_blocks) != 0) {
+            atomic_store(&p->failed, true);
+            break;
+        }
+
+        atomic_store_explicit(&r->tail, index + 1, memory_order_release);
+    }
+
+    return NULL;
+}
+
+static void pack_outputs(ma_pipeline_t const* p, uint64_t* slot) {
+    for (size_t i = 0; i < p->num; i++) {
+        moore_t const* a = p->at[i];
+        size_t const blocks = (a->output_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+
+        memcpy(slot, a->output, blocks * sizeof(uint64_t));
+        slot += blocks;
+    }
+}
+
+/*
+ * The function creates a pipelined runner for the automata from the array 'at[]'. In every cycle, 'produce' writes
+ * the inputs, the automata make one step and 'consume' receives the outputs, with up to 'depth' cycles prepared ahead
+ * and waiting to be consumed. Both callbacks get 'context'; 'produce' is called by the producer thread and 'consume'
+ * by the consumer thread, each for the cycles in increasing order.
+ *
+ * It returns a pointer to the runner, or NULL if any pointer but 'context' is NULL or 'num' or 'depth' is 0, setting
+ * errno to EINVAL, or if a memory allocation error occurred, setting errno to ENOMEM.
+ */
+ma_pipeline_t* ma_pipeline_create(moore_t* at[], size_t num, size_t depth, ma_produce_t produce, ma_consume_t consume,
+                                  void* context) {
+    if (!at || num == 0 || depth == 0 || !produce || !consume || null_in_the_array(at, num)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ma_pipeline_t* p = (ma_pipeline_t*)aligned_alloc(CACHE_LINE, (sizeof(ma_pipeline_t) + CACHE_LINE - 1) /
+                                                                 CACHE_LINE * CACHE_LINE);
+    if (!p) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(p, 0, sizeof(ma_pipeline_t));
+
+    p->num = num;
+    p->produce = produce;
+    p->consume = consume;
+    p->context = context;
+    p->at = (moore_t**)malloc(num * sizeof(moore_t*));
+    p->with_input = (moore_t**)malloc(num * sizeof(moore_t*));
+
+    size_t input_blocks = 0;
+    size_t output_blocks = 0;
+    if (p->at && p->with_input) {
+        memcpy(p->at, at, num * sizeof(moore_t*));
+        for (size_t i = 0; i < num; i++) {
+            if (at[i]->input_signals_num != 0) {
+                p->with_input[p->with_input_num++] = at[i];
+                input_blocks += (at[i]->input_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+            }
+            output_blocks += (at[i]->output_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+        }
+    }
+
+    if (!p->at || !p->with_input || !init_ring(&p->inputs, depth, input_blocks) ||
+        !init_ring(&p->outputs, depth, output_blocks)) {
+        ma_pipeline_delete(p);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    return p;
+}
+
+/*
+ * The function runs at most 'cycles' cycles, fewer if 'produce' returns 1 earlier. The calling thread steps the
+ * automata, the producer and consumer threads are started for the run and joined before the function returns, after
+ * all outputs were consumed.
+ *
+ * It returns 0, or -1 if the pointer is NULL or 'cycles' is 0, setting errno to EINVAL, if a thread could not be
+ * started, setting errno to EAGAIN, or if a callback returned -1, setting errno to ECANCELED. In the last case, the
+ * automata keep the state of the last stepped cycle.
+ */
+int ma_pipeline_run(ma_pipeline_t* p, uint64_t cycles) {
+    if (!p || cycles == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    reset_ring(&p->inputs);
+    reset_ring(&p->outputs);
+    atomic_store(&p->failed, false);
+    p->first_cycle = p->cycles;
+    p->limit = cycles;
+
+    pthread_t producer;
+    pthread_t consumer;
+    if (pthread_create(&producer, NULL, producer_main, p) != 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (pthread_create(&consumer, NULL, consumer_main, p) != 0) {
+        atomic_store(&p->failed, true);
+        pthread_join(producer, NULL);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    ring_t* in = &p->inputs;
+    ring_t* out = &p->outputs;
+
+    for (;;) {
+        size_t const index = wait_for_data(p, in);
+        if (index == SIZE_MAX) break;
+
+        uint64_t const* inputs = ring_slot(in, index);
+        for (size_t i = 0; i < p->with_input_num; i++) {
+            merge_input(p->with_input[i], inputs);
+            inputs += (p->with_input[i]->input_signals_num + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+        }
+        atomic_store_explicit(&in->tail, index + 1, memory_order_release);
+
+        ma_step(p->at, p->num);
+        p->cycles++;
+
+        size_t const slot = wait_for_space(p, out);
+        if (slot == SIZE_MAX) break;
+
+        pack_outputs(p, ring_slot(out, slot));
+        atomic_store_explicit(&out->head, slot + 1, memory_order_release);
+    }
+
+    atomic_store_explicit(&out->closed, true, memory_order_release);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    if (atomic_load(&p->failed)) {
+        errno = ECANCELED;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the number of cycles stepped by all runs, or 0 if the pointer is NULL, setting errno to EINVAL.
+ */
+uint64_t ma_pipeline_cycles(ma_pipeline_t const* p) {
+    if (!p) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return p->cycles;
+}
+
+/*
+ * The function frees the runner. The automata stay valid. It does nothing if called with a NULL pointer.
+ */
+void ma_pipeline_delete(ma_pipeline_t* p) {
+    if (p) {
+        free(p->at);
+        free(p->with_input);
+        free(p->inputs.slots);
+        free(p->outputs.slots);
+        free(p);
+    }
+}
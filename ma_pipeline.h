@@ -0,0 +1,24 @@
+#ifndef MA_PIPELINE_H
+#define MA_PIPELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ma.h"
+
+// Writes the inputs of the cycle 'cycle' to 'inputs': the inputs of the automata which have any, one after another,
+// each taking as many blocks as the automaton has input signals. Returns 0, 1 if there are no more cycles, or -1 on
+// error.
+typedef int (*ma_produce_t)(void *context, uint64_t cycle, uint64_t *inputs, size_t blocks);
+
+// Receives the outputs of all automata after the cycle 'cycle', one after another. Returns 0, or -1 on error.
+typedef int (*ma_consume_t)(void *context, uint64_t cycle, uint64_t const *outputs, size_t blocks);
+
+typedef struct ma_pipeline ma_pipeline_t;
+
+ma_pipeline_t * ma_pipeline_create(moore_t *at[], size_t num, size_t depth, ma_produce_t produce,
+                                   ma_consume_t consume, void *context);
+int ma_pipeline_run(ma_pipeline_t *p, uint64_t cycles);
+uint64_t ma_pipeline_cycles(ma_pipeline_t const *p);
+void ma_pipeline_delete(ma_pipeline_t *p);
+
+#endif //MA_PIPELINE_H
@@ -0,0 +1,321 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Pool of homogeneous Moore automata. All automata of a pool have the same number of input, output and state signals
+ * and the same transition and output functions. Their states, inputs and outputs are stored in contiguous arrays, one
+ * slot after another, so stepping the whole pool streams linearly through memory.
+ *
+ * Every automaton of the pool is represented by a regular moore_t handle, which can be used with ma_connect,
+ * ma_disconnect, ma_set_input, ma_set_state, ma_get_output and ma_step like any other automaton.
+ **/
+
+#include "ma.h"
+#include "ma_additional.h"
+#include "ma_pool.h"
+
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#define FILL_THE_BLOCK 63
+#define BITS_PER_BLOCK 64
+
+typedef struct ma_pool {
+    size_t size;
+
+    size_t input_blocks;
+    size_t output_blocks;
+    size_t state_blocks;
+
+    moore_t* automata; // handles of the automata of the pool
+
+    uint64_t* states;  // 'size' slots of 'state_blocks' blocks each
+    uint64_t* inputs;  // 'size' slots of 2 * 'input_blocks' blocks each, the input followed by its connected mask
+    uint64_t* outputs; // 'size' slots of 'output_blocks' blocks each
+
+    incoming_t* incoming_connections; // 'size' slots of 'n' connections each
+    outgoing_t** outgoing_connections; // 'size' slots of 'm' pointers each
+
+    uint64_t* next_states; // 'size' slots of 'state_blocks' blocks each, the buffers for the new states
+
+    size_t* order; // 'order[slot]' is the automaton stored in the slot, NULL if automaton 'i' is stored in slot 'i'
+} ma_pool_t;
+
+static void free_pool(ma_pool_t* p) {
+    free(p->automata);
+    free(p->states);
+    free(p->inputs);
+    free(p->outputs);
+    free(p->incoming_connections);
+    free(p->outgoing_connections);
+    free(p->next_states);
+    free(p->order);
+    free(p);
+}
+
+static moore_t* automaton_in_slot(ma_pool_t* p, size_t const slot) {
+    return p->order ? &p->automata[p->order[slot]] : &p->automata[slot];
+}
+
+/*
+ * Allocates the pool and its arrays and points the handles at their slots. The states, inputs and outputs are set to
+ * zero.
+ *
+ * Returns NULL and sets errno to EINVAL if 'k', 'm' or 's' is 0, or 't' or 'y' is NULL, or to ENOMEM if a memory
+ * allocation error occurs.
+ */
+static ma_pool_t* allocate_pool(size_t const k, size_t const n, size_t const m, size_t const s,
+                                transition_function_t const t, output_function_t const y) {
+    if (k == 0 || m == 0 || s == 0 || !t || !y) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ma_pool_t* p = (ma_pool_t*)calloc(1, sizeof(ma_pool_t));
+    if (!p) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    p->size = k;
+    p->input_blocks = (n + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+    p->output_blocks = (m + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+    p->state_blocks = (s + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+
+    p->automata = (moore_t*)calloc(k, sizeof(moore_t));
+    p->states = (uint64_t*)calloc(k, p->state_blocks * sizeof(uint64_t));
+    p->outputs = (uint64_t*)calloc(k, p->output_blocks * sizeof(uint64_t));
+    p->outgoing_connections = (outgoing_t**)calloc(k, m * sizeof(outgoing_t*));
+    p->next_states = (uint64_t*)calloc(k, p->state_blocks * sizeof(uint64_t));
+
+    if (n != 0) {
+        p->inputs = (uint64_t*)calloc(k, 2 * p->input_blocks * sizeof(uint64_t));
+        p->incoming_connections = (incoming_t*)calloc(k, n * sizeof(incoming_t));
+    }
+
+    if (!p->automata || !p->states || !p->outputs || !p->outgoing_connections || !p->next_states ||
+        (n != 0 && (!p->inputs || !p->incoming_connections))) {
+        free_pool(p);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < k; i++) {
+        moore_t* a = &p->automata[i];
+
+        initialize_automaton(a, n, m, s, t, y);
+        a->pool = p;
+        a->next_state = p->next_states + i * p->state_blocks; // own buffer, automata may be stepped concurrently
+        a->state = p->states + i * p->state_blocks;
+        a->output = p->outputs + i * p->output_blocks;
+        a->outgoing_connections = p->outgoing_connections + i * m;
+        a->input = n != 0 ? p->inputs + 2 * i * p->input_blocks : NULL;
+        a->connected = n != 0 ? a->input + p->input_blocks : NULL;
+        a->incoming_connections = n != 0 ? p->incoming_connections + i * n : NULL;
+    }
+
+    return p;
+}
+
+/*
+ * The function creates a pool of 'k' Moore automata, each with 'n' input signals, 'm' output signals, 's' internal
+ * state bits, the transition function 't' and the output function 'y'. The initial state of every automaton is 'q'.
+ *
+ * It returns a pointer to the pool, or NULL if any of the parameters 'k', 'm' or 's' is 0, 't', 'y' or 'q' is NULL,
+ * or a memory allocation error occurred. In such cases, it sets errno to EINVAL or ENOMEM, respectively.
+ */
+ma_pool_t* ma_pool_create_full(size_t k, size_t n, size_t m, size_t s, transition_function_t t,
+                               output_function_t y, uint64_t const* q) {
+    if (!q) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ma_pool_t* p = allocate_pool(k, n, m, s, t, y);
+    if (!p) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < k; i++) {
+        ma_set_state(&p->automata[i], q);
+    }
+
+    return p;
+}
+
+/*
+ * The function creates a pool of 'k' simple Moore automata, each with 'n' input signals, 'm' output signals, 'm'
+ * internal state bits, the transition function 't' and the identity function as the output function. Initially, the
+ * states and outputs of all automata are set to zero.
+ *
+ * It returns a pointer to the pool, or NULL if 'k' or 'm' is 0, 't' is NULL, or a memory allocation error occurred.
+ * In such cases, it sets errno to EINVAL or ENOMEM, respectively.
+ */
+ma_pool_t* ma_pool_create_simple(size_t k, size_t n, size_t m, transition_function_t t) {
+    return allocate_pool(k, n, m, m, t, identity_function);
+}
+
+/*
+ * The function deletes the pool together with all its automata, first clearing their connections. Handles obtained
+ * from ma_pool_get become invalid. It does nothing if called with a NULL pointer.
+ */
+void ma_pool_delete(ma_pool_t* p) {
+    if (p) {
+        for (size_t i = 0; i < p->size; i++) {
+            profile_forget(&p->automata[i]);
+            if (p->automata[i].output_buffer) detach_output(&p->automata[i]);
+            clear_the_connections(&p->automata[i]);
+            leave_component(&p->automata[i]);
+            forget_linear(&p->automata[i]);
+        }
+        free_pool(p);
+    }
+}
+
+/*
+ * Returns the number of automata in the pool or 0 if the pointer is NULL, setting errno to EINVAL.
+ */
+size_t ma_pool_size(ma_pool_t const* p) {
+    if (!p) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return p->size;
+}
+
+/*
+ * Returns the handle of the 'i'-th automaton of the pool, or NULL if the pointer is NULL or 'i' is out of range,
+ * setting errno to EINVAL. The handle stays valid until the pool is deleted.
+ */
+moore_t* ma_pool_get(ma_pool_t* p, size_t i) {
+    if (!p || i >= p->size) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return &p->automata[i];
+}
+
+/*
+ * The function performs one computation step of all automata of the pool, with the same synchronous semantics as
+ * ma_step called with all handles of the pool. Inputs connected to automata outside the pool read their current
+ * outputs. The new states are computed slot by slot in the buffers of the automata, so the step does not allocate
+ * memory.
+ *
+ * It returns 0, or -1 if the pointer is NULL, setting errno to EINVAL.
+ */
+int ma_pool_step(ma_pool_t* p) {
+    if (!p) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (p->inputs) {
+        for (size_t slot = 0; slot < p->size; slot++) {
+            get_input(automaton_in_slot(p, slot));
+        }
+    }
+
+    for (size_t slot = 0; slot < p->size; slot++) {
+        calculate_new_state(automaton_in_slot(p, slot));
+    }
+
+    return 0;
+}
+
+/*
+ * The function relocates the buffers of the automata of the pool, so that the slots follow the order computed by
+ * ma_order for the connections inside the pool: producers are stored next to their consumers. The handles, the
+ * connections and the values of states, inputs and outputs do not change, ma_pool_step visits the slots in the new
+ * order.
+ *
+ * It returns 0, or -1 if the pointer is NULL or a memory allocation error occurred, setting errno to EINVAL or ENOMEM,
+ * respectively. On error, the pool is left unchanged.
+ */
+int ma_pool_reorder(ma_pool_t* p) {
+    if (!p) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t const k = p->size;
+    size_t const n = p->automata[0].input_signals_num;
+    size_t const m = p->automata[0].output_signals_num;
+
+    moore_t** handles = (moore_t**)malloc(k * sizeof(moore_t*));
+    size_t* order = (size_t*)malloc(k * sizeof(size_t));
+    uint64_t* states = (uint64_t*)malloc(k * p->state_blocks * sizeof(uint64_t));
+    uint64_t* outputs = (uint64_t*)malloc(k * p->output_blocks * sizeof(uint64_t));
+    outgoing_t** outgoing = (outgoing_t**)malloc(k * m * sizeof(outgoing_t*));
+    uint64_t* inputs = n != 0 ? (uint64_t*)malloc(2 * k * p->input_blocks * sizeof(uint64_t)) : NULL;
+    incoming_t* incoming = n != 0 ? (incoming_t*)malloc(k * n * sizeof(incoming_t)) : NULL;
+
+    automata_graph_t g = {0};
+    bool ok = handles && order && states && outputs && outgoing && (n == 0 || (inputs && incoming));
+    if (ok) {
+        for (size_t i = 0; i < k; i++) {
+            handles[i] = &p->automata[i];
+        }
+        ok = build_graph(&g, handles, k) && compute_order(&g, order);
+    }
+    else {
+        errno = ENOMEM;
+    }
+
+    if (!ok) {
+        free_graph(&g);
+        free(handles);
+        free(order);
+        free(states);
+        free(outputs);
+        free(outgoing);
+        free(inputs);
+        free(incoming);
+        return -1;
+    }
+
+    for (size_t slot = 0; slot < k; slot++) {
+        moore_t* a = &p->automata[order[slot]];
+
+        uint64_t* state = states + slot * p->state_blocks;
+        uint64_t* output = outputs + slot * p->output_blocks;
+        outgoing_t** outgoing_slot = outgoing + slot * m;
+
+        memcpy(state, a->state, p->state_blocks * sizeof(uint64_t));
+        memcpy(output, a->output, p->output_blocks * sizeof(uint64_t));
+        memcpy(outgoing_slot, a->outgoing_connections, m * sizeof(outgoing_t*));
+        a->state = state;
+        replace_owned_output(a, output); // members of an output buffer keep writing there
+        a->outgoing_connections = outgoing_slot;
+
+        if (n != 0) {
+            uint64_t* input = inputs + 2 * slot * p->input_blocks;
+            incoming_t* incoming_slot = incoming + slot * n;
+
+            memcpy(input, a->input, 2 * p->input_blocks * sizeof(uint64_t));
+            memcpy(incoming_slot, a->incoming_connections, n * sizeof(incoming_t));
+            a->input = input;
+            a->connected = input + p->input_blocks;
+            a->incoming_connections = incoming_slot;
+        }
+    }
+
+    free(p->states);
+    free(p->outputs);
+    free(p->outgoing_connections);
+    free(p->inputs);
+    free(p->incoming_connections);
+    free(p->order);
+
+    p->states = states;
+    p->outputs = outputs;
+    p->outgoing_connections = outgoing;
+    p->inputs = inputs;
+    p->incoming_connections = incoming;
+    p->order = order;
+
+    free_graph(&g);
+    free(handles);
+    return 0;
+}
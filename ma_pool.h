@@ -0,0 +1,19 @@
+#ifndef MA_POOL_H
+#define MA_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ma.h"
+
+typedef struct ma_pool ma_pool_t;
+
+ma_pool_t * ma_pool_create_full(size_t k, size_t n, size_t m, size_t s, transition_function_t t,
+                                output_function_t y, uint64_t const *q);
+ma_pool_t * ma_pool_create_simple(size_t k, size_t n, size_t m, transition_function_t t);
+void ma_pool_delete(ma_pool_t *p);
+size_t ma_pool_size(ma_pool_t const *p);
+moore_t * ma_pool_get(ma_pool_t *p, size_t i);
+int ma_pool_step(ma_pool_t *p);
+int ma_pool_reorder(ma_pool_t *p);
+
+#endif //MA_POOL_H
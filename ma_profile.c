@@ -0,0 +1,498 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Profiling of ma_step. While profiling is on, ma_step times every phase of stepping every automaton (gathering the
+ * inputs, the transition function, the output function and masking), accumulates the times per phase and per
+ * automaton, and records the latency of the whole call in a log-linear histogram with 16 sub-buckets per power of two
+ * (at most about 6% of error, as in HdrHistogram). While profiling is off, the only cost is one relaxed atomic load
+ * per call of ma_step.
+ *
+ * Time is measured with the TSC on x86 and with clock_gettime elsewhere. Ticks are converted to nanoseconds when the
+ * results are read, using the ratio of ticks to nanoseconds elapsed since ma_profile_start.
+ *
+ * The counters are updated with relaxed atomics, so ma_step may be called concurrently for disjoint arrays of
+ * automata. ma_profile_start and ma_profile_release must not be called while any ma_step is running.
+ **/
+
+#define _GNU_SOURCE
+
+#include "ma_additional.h"
+#include "ma_profile.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+#define FILL_THE_BLOCK 63
+#define BITS_PER_BLOCK 64
+
+#define SUB_BUCKET_BITS 4
+#define SUB_BUCKETS (1u << SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKETS ((64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS)
+
+// Keys of the table of automata which are not addresses of automata.
+#define EMPTY_KEY ((uintptr_t)0)
+#define DELETED_KEY ((uintptr_t)1)
+
+// Counters of a single automaton. Deleted automata leave their entries marked with DELETED_KEY, so that an automaton
+// allocated later at the same address does not inherit them.
+typedef struct automaton_entry {
+    atomic_uintptr_t key;
+    atomic_size_t steps;
+    atomic_uint_fast64_t ticks[MA_PHASE_COUNT];
+} automaton_entry_t;
+
+static char const* const phase_names[MA_PHASE_COUNT] = {"gather", "transition", "output", "mask"};
+
+atomic_bool profiling;
+
+static automaton_entry_t* entries;
+static size_t capacity; // a power of two
+static size_t max_entries;
+static atomic_size_t used_entries;
+
+static atomic_size_t profiled_steps;
+static atomic_size_t automaton_steps;
+static atomic_size_t untracked_steps;
+static atomic_uint_fast64_t phase_ticks[MA_PHASE_COUNT];
+static atomic_uint_fast64_t step_total_ticks;
+static atomic_uint_fast64_t step_min_ticks;
+static atomic_uint_fast64_t step_max_ticks;
+static atomic_uint_fast64_t histogram[HISTOGRAM_BUCKETS];
+
+static uint64_t start_ticks;
+static uint64_t start_ns;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t ticks(void) {
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return now_ns();
+#endif
+}
+
+static double ns_per_tick(void) {
+#ifdef HAVE_TSC
+    uint64_t const elapsed_ticks = ticks() - start_ticks;
+    uint64_t const elapsed_ns = now_ns() - start_ns;
+    return elapsed_ticks ? (double)elapsed_ns / (double)elapsed_ticks : 1.0;
+#else
+    return 1.0;
+#endif
+}
+
+static uint64_t to_ns(uint64_t const t, double const ratio) {
+    return (uint64_t)((double)t * ratio + 0.5);
+}
+
+static size_t hash_key(uintptr_t const key) {
+    uint64_t h = (uint64_t)key * 0x9E3779B97F4A7C15u;
+    return (size_t)(h ^ (h >> 32));
+}
+
+/*
+ * Finds the entry of the automaton 'a', adding it if 'insert' is set. Returns NULL if the automaton has no entry and
+ * it was not added, because 'insert' is not set or the table is full.
+ */
+static automaton_entry_t* find_entry(moore_t const* a, bool const insert) {
+    if (!entries) return NULL;
+
+    uintptr_t const key = (uintptr_t)a;
+    size_t const mask = capacity - 1;
+    size_t i = hash_key(key) & mask;
+
+    for (size_t probe = 0; probe < capacity; probe++, i = (i + 1) & mask) {
+        uintptr_t current = atomic_load_explicit(&entries[i].key, memory_order_acquire);
+
+        if (current == key) return &entries[i];
+        if (current != EMPTY_KEY) continue;
+        if (!insert) return NULL;
+
+        if (atomic_fetch_add_explicit(&used_entries, 1, memory_order_relaxed) >= max_entries) {
+            atomic_fetch_sub_explicit(&used_entries, 1, memory_order_relaxed);
+            return NULL;
+        }
+
+        if (atomic_compare_exchange_strong_explicit(&entries[i].key, &current, key, memory_order_acq_rel,
+                                                    memory_order_acquire)) {
+            return &entries[i];
+        }
+
+        atomic_fetch_sub_explicit(&used_entries, 1, memory_order_relaxed); // another thread took the slot
+        if (current == key) return &entries[i];
+    }
+
+    return NULL;
+}
+
+static size_t bucket_of(uint64_t const value) {
+    if (value < SUB_BUCKETS) return (size_t)value;
+
+    size_t const exponent = 63 - (size_t)__builtin_clzll(value);
+    size_t const shift = exponent - SUB_BUCKET_BITS;
+    return (shift + 1) * SUB_BUCKETS + (size_t)((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+// The highest value counted in the bucket.
+static uint64_t bucket_limit(size_t const bucket) {
+    if (bucket < SUB_BUCKETS) return bucket;
+
+    size_t const shift = bucket / SUB_BUCKETS - 1;
+    uint64_t const lowest = (uint64_t)(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+    return lowest + (((uint64_t)1 << shift) - 1);
+}
+
+static void add_ticks(atomic_uint_fast64_t* counter, uint64_t const value) {
+    atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+static void record_latency(uint64_t const latency) {
+    add_ticks(&histogram[bucket_of(latency)], 1);
+    add_ticks(&step_total_ticks, latency);
+
+    uint_fast64_t current = atomic_load_explicit(&step_min_ticks, memory_order_relaxed);
+    while (latency < current && !atomic_compare_exchange_weak_explicit(&step_min_ticks, &current, latency,
+                                                                       memory_order_relaxed, memory_order_relaxed)) {
+    }
+
+    current = atomic_load_explicit(&step_max_ticks, memory_order_relaxed);
+    while (latency > current && !atomic_compare_exchange_weak_explicit(&step_max_ticks, &current, latency,
+                                                                       memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+/*
+ * Does the work of calculate_new_state phase by phase, writing the ticks spent in every phase but gathering to
+ * 'elapsed'.
+ */
+static void timed_transition(moore_t* a, uint64_t elapsed[MA_PHASE_COUNT]) {
+    uint64_t const t0 = ticks();
+    compute_next_state(a, a->next_state);
+
+    uint64_t const t1 = ticks();
+    store_next_state(a, a->next_state);
+
+    uint64_t const t2 = ticks();
+    compute_output(a);
+
+    uint64_t const t3 = ticks();
+    mask_output(a);
+
+    uint64_t const t4 = ticks();
+    elapsed[MA_PHASE_TRANSITION] = t1 - t0;
+    elapsed[MA_PHASE_OUTPUT] = t3 - t2;
+    elapsed[MA_PHASE_MASK] = (t2 - t1) + (t4 - t3);
+}
+
+/*
+ * Does the work of ma_step while profiling is on. The array has already been checked.
+ */
+void profile_step(moore_t* at[], size_t const num) {
+    uint64_t const step_start = ticks();
+    uint64_t totals[MA_PHASE_COUNT] = {0};
+    size_t untracked = 0;
+
+    for (size_t i = 0; i < num; i++) {
+        uint64_t const t0 = ticks();
+        get_input(at[i]);
+        uint64_t const elapsed = ticks() - t0;
+
+        totals[MA_PHASE_GATHER] += elapsed;
+        automaton_entry_t* e = find_entry(at[i], true);
+        if (e) {
+            add_ticks(&e->ticks[MA_PHASE_GATHER], elapsed);
+        } else {
+            untracked++;
+        }
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        uint64_t elapsed[MA_PHASE_COUNT];
+        timed_transition(at[i], elapsed);
+
+        automaton_entry_t* e = find_entry(at[i], false);
+        for (size_t phase = MA_PHASE_TRANSITION; phase < MA_PHASE_COUNT; phase++) {
+            totals[phase] += elapsed[phase];
+            if (e) add_ticks(&e->ticks[phase], elapsed[phase]);
+        }
+        if (e) atomic_fetch_add_explicit(&e->steps, 1, memory_order_relaxed);
+    }
+
+    for (size_t phase = 0; phase < MA_PHASE_COUNT; phase++) {
+        add_ticks(&phase_ticks[phase], totals[phase]);
+    }
+    atomic_fetch_add_explicit(&profiled_steps, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&automaton_steps, num, memory_order_relaxed);
+    if (untracked) atomic_fetch_add_explicit(&untracked_steps, untracked, memory_order_relaxed);
+
+    record_latency(ticks() - step_start);
+}
+
+/*
+ * Drops the counters of the automaton 'a', which is being deleted.
+ */
+void profile_forget(moore_t const* a) {
+    automaton_entry_t* e = find_entry(a, false);
+    if (e) atomic_store_explicit(&e->key, DELETED_KEY, memory_order_release);
+}
+
+static void clear_counters(void) {
+    atomic_store(&profiled_steps, 0);
+    atomic_store(&automaton_steps, 0);
+    atomic_store(&untracked_steps, 0);
+    for (size_t phase = 0; phase < MA_PHASE_COUNT; phase++) {
+        atomic_store(&phase_ticks[phase], 0);
+    }
+    atomic_store(&step_total_ticks, 0);
+    atomic_store(&step_min_ticks, UINT64_MAX);
+    atomic_store(&step_max_ticks, 0);
+    for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        atomic_store(&histogram[bucket], 0);
+    }
+}
+
+/*
+ * The function turns profiling of ma_step on, discarding the results of the previous profiling. The time of at most
+ * 'max_automata' automata is recorded separately, the time of the others only counts towards the totals.
+ *
+ * It returns 0, or -1 if a memory allocation error occurred, setting errno to ENOMEM.
+ */
+int ma_profile_start(size_t max_automata) {
+    if (max_automata > SIZE_MAX / 4 / sizeof(automaton_entry_t)) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    size_t new_capacity = 1;
+    while (new_capacity < 2 * max_automata) new_capacity <<= 1;
+
+    automaton_entry_t* new_entries = NULL;
+    if (max_automata > 0) {
+        new_entries = (automaton_entry_t*)calloc(new_capacity, sizeof(automaton_entry_t));
+        if (!new_entries) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    atomic_store(&profiling, false);
+    free(entries);
+    entries = new_entries;
+    capacity = new_capacity;
+    max_entries = max_automata;
+    atomic_store(&used_entries, 0);
+    clear_counters();
+
+    start_ticks = ticks();
+    start_ns = now_ns();
+    atomic_store(&profiling, true);
+
+    return 0;
+}
+
+/*
+ * The function turns profiling off. The results can still be read.
+ */
+void ma_profile_stop(void) {
+    atomic_store(&profiling, false);
+}
+
+/*
+ * The function turns profiling off and frees the memory holding the results of the automata.
+ */
+void ma_profile_release(void) {
+    atomic_store(&profiling, false);
+    free(entries);
+    entries = NULL;
+    capacity = 0;
+    max_entries = 0;
+    atomic_store(&used_entries, 0);
+}
+
+/*
+ * The function writes the totals of the current or the last profiling to 'profile'.
+ *
+ * It returns 0, or -1 if the pointer is NULL, setting errno to EINVAL.
+ */
+int ma_profile_get(ma_profile_t* profile) {
+    if (!profile) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    double const ratio = ns_per_tick();
+
+    profile->steps = atomic_load(&profiled_steps);
+    profile->automaton_steps = atomic_load(&automaton_steps);
+    for (size_t phase = 0; phase < MA_PHASE_COUNT; phase++) {
+        profile->phase_ns[phase] = to_ns(atomic_load(&phase_ticks[phase]), ratio);
+    }
+    profile->step_total_ns = to_ns(atomic_load(&step_total_ticks), ratio);
+    profile->step_min_ns = profile->steps ? to_ns(atomic_load(&step_min_ticks), ratio) : 0;
+    profile->step_max_ns = to_ns(atomic_load(&step_max_ticks), ratio);
+    profile->untracked_automata = atomic_load(&untracked_steps);
+
+    return 0;
+}
+
+/*
+ * The function writes the results of the automaton 'a' to 'profile'.
+ *
+ * It returns 0, or -1 if any pointer is NULL, setting errno to EINVAL, or if the automaton was not recorded separately,
+ * setting errno to ENOENT.
+ */
+int ma_profile_get_automaton(moore_t const* a, ma_profile_automaton_t* profile) {
+    if (!a || !profile) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    automaton_entry_t* e = find_entry(a, false);
+    if (!e) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    double const ratio = ns_per_tick();
+
+    profile->steps = atomic_load(&e->steps);
+    for (size_t phase = 0; phase < MA_PHASE_COUNT; phase++) {
+        profile->phase_ns[phase] = to_ns(atomic_load(&e->ticks[phase]), ratio);
+    }
+
+    return 0;
+}
+
+static uint64_t percentile_ticks(double const percentile) {
+    uint64_t total = 0;
+    for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        total += atomic_load_explicit(&histogram[bucket], memory_order_relaxed);
+    }
+    if (total == 0) return 0;
+
+    uint64_t target = (uint64_t)(percentile / 100.0 * (double)total + 0.5);
+    if (target == 0) target = 1;
+
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        seen += atomic_load_explicit(&histogram[bucket], memory_order_relaxed);
+        if (seen >= target) {
+            uint64_t const max = atomic_load_explicit(&step_max_ticks, memory_order_relaxed);
+            uint64_t const limit = bucket_limit(bucket);
+            return limit < max ? limit : max;
+        }
+    }
+
+    return atomic_load_explicit(&step_max_ticks, memory_order_relaxed);
+}
+
+/*
+ * Returns the latency of ma_step in nanoseconds, which 'percentile' percent of the profiled calls did not exceed, or 0
+ * if no call was profiled. If 'percentile' is not between 0 and 100, it returns 0 and sets errno to EINVAL.
+ */
+uint64_t ma_profile_percentile(double percentile) {
+    if (!(percentile >= 0.0 && percentile <= 100.0)) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return to_ns(percentile_ticks(percentile), ns_per_tick());
+}
+
+/*
+ * The function prints the results of the current or the last profiling to 'out' as a JSON object: the totals, the
+ * percentiles and the non-empty buckets of the latency histogram, and the results of every recorded automaton.
+ *
+ * It returns 0, or -1 if the pointer is NULL, setting errno to EINVAL, or if writing failed, setting errno to EIO.
+ */
+int ma_profile_dump(FILE* out) {
+    if (!out) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ma_profile_t p;
+    ma_profile_get(&p);
+    double const ratio = ns_per_tick();
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"steps\": %zu,\n", p.steps);
+    fprintf(out, "  \"automaton_steps\": %zu,\n", p.automaton_steps);
+    fprintf(out, "  \"untracked_automaton_steps\": %zu,\n", p.untracked_automata);
+    fprintf(out, "  \"step_ns\": {\"total\": %llu, \"min\": %llu, \"max\": %llu, \"mean\": %.1f, \"p50\": %llu, "
+                 "\"p90\": %llu, \"p99\": %llu, \"p99.9\": %llu},\n",
+            (unsigned long long)p.step_total_ns, (unsigned long long)p.step_min_ns,
+            (unsigned long long)p.step_max_ns, p.steps ? (double)p.step_total_ns / (double)p.steps : 0.0,
+            (unsigned long long)to_ns(percentile_ticks(50.0), ratio),
+            (unsigned long long)to_ns(percentile_ticks(90.0), ratio),
+            (unsigned long long)to_ns(percentile_ticks(99.0), ratio),
+            (unsigned long long)to_ns(percentile_ticks(99.9), ratio));
+
+    fprintf(out, "  \"phase_ns\": {");
+    for (size_t phase = 0; phase < MA_PHASE_COUNT; phase++) {
+        fprintf(out, "\"%s\": %llu%s", phase_names[phase], (unsigned long long)p.phase_ns[phase],
+                phase + 1 < MA_PHASE_COUNT ? ", " : "},\n");
+    }
+
+    // buckets as pairs of the highest latency counted in the bucket and the number of calls
+    fprintf(out, "  \"histogram\": [");
+    bool first = true;
+    for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        uint64_t const count = atomic_load(&histogram[bucket]);
+        if (count == 0) continue;
+
+        fprintf(out, "%s[%llu, %llu]", first ? "" : ", ", (unsigned long long)to_ns(bucket_limit(bucket), ratio),
+                (unsigned long long)count);
+        first = false;
+    }
+    fprintf(out, "],\n");
+
+    fprintf(out, "  \"automata\": [");
+    first = true;
+    for (size_t i = 0; entries && i < capacity; i++) {
+        uintptr_t const key = atomic_load(&entries[i].key);
+        if (key == EMPTY_KEY || key == DELETED_KEY) continue;
+
+        fprintf(out, "%s\n    {\"automaton\": \"%p\", \"steps\": %zu", first ? "" : ",", (void*)key,
+                atomic_load(&entries[i].steps));
+        for (size_t phase = 0; phase < MA_PHASE_COUNT; phase++) {
+            fprintf(out, ", \"%s_ns\": %llu", phase_names[phase],
+                    (unsigned long long)to_ns(atomic_load(&entries[i].ticks[phase]), ratio));
+        }
+        fprintf(out, "}");
+        first = false;
+    }
+    fprintf(out, "%s]\n}\n", first ? "" : "\n  ");
+
+    if (ferror(out)) {
+        errno = EIO;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the name of the phase or NULL if 'phase' is out of range, setting errno to EINVAL.
+ */
+char const* ma_profile_phase_name(ma_phase_t phase) {
+    if ((unsigned)phase >= MA_PHASE_COUNT) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return phase_names[phase];
+}
@@ -0,0 +1,42 @@
+#ifndef MA_PROFILE_H
+#define MA_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "ma.h"
+
+// Phases of stepping an automaton, timed separately.
+typedef enum ma_phase {
+    MA_PHASE_GATHER,     // reading the inputs from the connected outputs
+    MA_PHASE_TRANSITION, // the transition function
+    MA_PHASE_OUTPUT,     // the output function
+    MA_PHASE_MASK,       // storing the new state and masking the unused bits of the state and the output
+    MA_PHASE_COUNT
+} ma_phase_t;
+
+typedef struct ma_profile {
+    size_t steps;                      // profiled calls of ma_step
+    size_t automaton_steps;            // automata stepped by these calls
+    uint64_t phase_ns[MA_PHASE_COUNT];
+    uint64_t step_total_ns;            // latency of ma_step
+    uint64_t step_min_ns;
+    uint64_t step_max_ns;
+    size_t untracked_automata;         // automata stepped after the table of automata was full
+} ma_profile_t;
+
+typedef struct ma_profile_automaton {
+    size_t steps;
+    uint64_t phase_ns[MA_PHASE_COUNT];
+} ma_profile_automaton_t;
+
+int ma_profile_start(size_t max_automata);
+void ma_profile_stop(void);
+void ma_profile_release(void);
+int ma_profile_get(ma_profile_t *profile);
+int ma_profile_get_automaton(moore_t const *a, ma_profile_automaton_t *profile);
+uint64_t ma_profile_percentile(double percentile);
+int ma_profile_dump(FILE *out);
+char const * ma_profile_phase_name(ma_phase_t phase);
+
+#endif //MA_PROFILE_H
@@ -0,0 +1,405 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Stepping a network of automata in several local processes. The automata are split into partitions with few
+ * connections between them and every partition is stepped by its own child process. Outputs read across partitions
+ * (boundary outputs) are exchanged through a double buffer in shared memory, and the processes meet on a futex-based
+ * barrier after every step.
+ *
+ * Step 'k' reads boundary outputs from buffer 'k % 2' and publishes the new ones to the other buffer, so one barrier
+ * per step is enough and the result is the same as calling ma_step on the whole array. A callback crashing in a child
+ * does not affect the caller: the other processes are stopped and the automata keep the values they had before.
+ **/
+
+#define _GNU_SOURCE
+
+#include "ma.h"
+#include "ma_additional.h"
+#include "ma_shm.h"
+
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FILL_THE_BLOCK 63
+#define BITS_PER_BLOCK 64
+#define NOT_FOUND ((size_t)-1)
+
+// Beginning of the shared memory region, followed by the boundary buffers and the results.
+typedef struct shared_header {
+    atomic_uint arrived;
+    atomic_uint generation;
+    atomic_uint aborted;
+} shared_header_t;
+
+// Layout of the run, computed by the caller before the processes are started.
+typedef struct shm_run {
+    moore_t** at;
+    size_t num;
+    size_t processes;
+    size_t* part_of;
+    size_t* members;        // positions of the automata grouped by partition
+    size_t* members_offset; // members of the partition 'p' are 'members[members_offset[p]]' .. before 'p + 1'
+    size_t* boundary;       // positions of the automata with boundary outputs
+    size_t boundary_num;
+
+    size_t* boundary_offset; // offset of the output of the automaton in a boundary buffer, NOT_FOUND if not needed
+    size_t boundary_blocks;  // size of one boundary buffer
+    size_t* result_offset;   // offset of the state, output and input of the automaton in the results
+    size_t result_blocks;
+
+    shared_header_t* header;
+    uint64_t* buffers[2];
+    uint64_t* results;
+    size_t shared_size;
+
+    uint64_t* next_state;
+} shm_run_t;
+
+static size_t blocks_of(size_t const signals) {
+    return (signals + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+}
+
+static long futex(atomic_uint* address, int const op, unsigned const value, struct timespec const* timeout) {
+    return syscall(SYS_futex, (unsigned*)address, op, value, timeout, NULL, 0);
+}
+
+/*
+ * Waits until all processes reach the barrier. Returns false if the run was aborted in the meantime.
+ */
+static bool futex_barrier(shared_header_t* h, unsigned const total) {
+    unsigned const generation = atomic_load(&h->generation);
+
+    if (atomic_fetch_add(&h->arrived, 1) + 1 == total) {
+        atomic_store(&h->arrived, 0);
+        atomic_fetch_add(&h->generation, 1);
+        futex(&h->generation, FUTEX_WAKE, (unsigned)total, NULL);
+        return !atomic_load(&h->aborted);
+    }
+
+    struct timespec const timeout = {0, 100 * 1000 * 1000};
+    while (atomic_load(&h->generation) == generation) {
+        if (atomic_load(&h->aborted)) return false;
+        futex(&h->generation, FUTEX_WAIT, generation, &timeout);
+    }
+
+    return !atomic_load(&h->aborted);
+}
+
+/*
+ * Copies the boundary outputs published by other partitions into the local copies of their automata.
+ */
+static void pull_boundary(shm_run_t const* r, size_t const me, uint64_t const* buffer) {
+    for (size_t k = 0; k < r->boundary_num; k++) {
+        size_t const j = r->boundary[k];
+        if (r->part_of[j] != me) {
+            memcpy(r->at[j]->output, buffer + r->boundary_offset[j],
+                   blocks_of(r->at[j]->output_signals_num) * sizeof(uint64_t));
+        }
+    }
+}
+
+static void publish_boundary(shm_run_t const* r, size_t const me, uint64_t* buffer) {
+    for (size_t k = 0; k < r->boundary_num; k++) {
+        size_t const j = r->boundary[k];
+        if (r->part_of[j] == me) {
+            memcpy(buffer + r->boundary_offset[j], r->at[j]->output,
+                   blocks_of(r->at[j]->output_signals_num) * sizeof(uint64_t));
+        }
+    }
+}
+
+/*
+ * Body of a child process stepping the partition 'me'. It does not allocate memory, because the caller may have other
+ * threads, and it never returns.
+ */
+static void run_partition(shm_run_t* r, size_t const me, size_t const steps) {
+    size_t const first = r->members_offset[me];
+    size_t const last = r->members_offset[me + 1];
+
+    for (size_t s = 0; s < steps; s++) {
+        pull_boundary(r, me, r->buffers[s % 2]);
+
+        for (size_t k = first; k < last; k++) {
+            get_input(r->at[r->members[k]]);
+        }
+
+        for (size_t k = first; k < last; k++) {
+            apply_transition(r->at[r->members[k]], r->next_state);
+        }
+
+        publish_boundary(r, me, r->buffers[(s + 1) % 2]);
+
+        if (!futex_barrier(r->header, (unsigned)r->processes)) _exit(EXIT_FAILURE);
+    }
+
+    for (size_t k = first; k < last; k++) {
+        size_t const i = r->members[k];
+        moore_t const* a = r->at[i];
+        uint64_t* result = r->results + r->result_offset[i];
+        size_t const state_blocks = blocks_of(a->state_signals_num);
+        size_t const output_blocks = blocks_of(a->output_signals_num);
+
+        memcpy(result, a->state, state_blocks * sizeof(uint64_t));
+        memcpy(result + state_blocks, a->output, output_blocks * sizeof(uint64_t));
+        if (a->input) {
+            memcpy(result + state_blocks + output_blocks, a->input,
+                   blocks_of(a->input_signals_num) * sizeof(uint64_t));
+        }
+    }
+
+    _exit(EXIT_SUCCESS);
+}
+
+static void free_run(shm_run_t* r) {
+    if (r->header) munmap(r->header, r->shared_size);
+    free(r->part_of);
+    free(r->members);
+    free(r->members_offset);
+    free(r->boundary);
+    free(r->boundary_offset);
+    free(r->result_offset);
+    free(r->next_state);
+}
+
+/*
+ * Checks that no automaton occurs twice, splits the automata into partitions, finds the boundary outputs and maps the
+ * shared memory region.
+ */
+static bool prepare_run(shm_run_t* r) {
+    automata_graph_t g;
+    automata_index_t index;
+    size_t const num = r->num;
+
+    // every child writes back its own copy of a repeated automaton, so the result would depend on the timing
+    if (!build_index(&index, r->at, num)) return false;
+    for (size_t i = 0; i < num; i++) {
+        if (find_index(&index, r->at[i]) != i) {
+            free_index(&index);
+            errno = EINVAL;
+            return false;
+        }
+    }
+    free_index(&index);
+
+    r->part_of = (size_t*)malloc(num * sizeof(size_t));
+    r->members = (size_t*)malloc(num * sizeof(size_t));
+    r->members_offset = (size_t*)calloc(r->processes + 1, sizeof(size_t));
+    r->boundary = (size_t*)malloc(num * sizeof(size_t));
+    r->boundary_offset = (size_t*)malloc(num * sizeof(size_t));
+    r->result_offset = (size_t*)malloc(num * sizeof(size_t));
+    if (!r->part_of || !r->members || !r->members_offset || !r->boundary || !r->boundary_offset || !r->result_offset) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    if (!build_graph(&g, r->at, num)) return false;
+    if (!partition_graph(&g, r->processes, r->part_of)) {
+        free_graph(&g);
+        return false;
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        r->members_offset[r->part_of[i] + 1]++;
+    }
+    for (size_t p = 0; p < r->processes; p++) {
+        r->members_offset[p + 1] += r->members_offset[p];
+    }
+    for (size_t i = 0; i < num; i++) {
+        r->members[r->members_offset[r->part_of[i]]++] = i;
+    }
+    for (size_t p = r->processes; p > 0; p--) { // filling moved every offset to the beginning of the next partition
+        r->members_offset[p] = r->members_offset[p - 1];
+    }
+    r->members_offset[0] = 0;
+
+    size_t state_blocks = 1;
+    for (size_t i = 0; i < num; i++) {
+        moore_t const* a = r->at[i];
+
+        r->boundary_offset[i] = NOT_FOUND;
+        for (size_t k = g.target_offsets[i]; k < g.target_offsets[i + 1]; k++) {
+            if (r->part_of[g.target_list[k]] != r->part_of[i]) {
+                r->boundary[r->boundary_num++] = i;
+                r->boundary_offset[i] = r->boundary_blocks;
+                r->boundary_blocks += blocks_of(a->output_signals_num);
+                break;
+            }
+        }
+
+        r->result_offset[i] = r->result_blocks;
+        r->result_blocks += blocks_of(a->state_signals_num) + blocks_of(a->output_signals_num) +
+                            blocks_of(a->input_signals_num);
+        if (blocks_of(a->state_signals_num) > state_blocks) state_blocks = blocks_of(a->state_signals_num);
+    }
+    free_graph(&g);
+
+    r->next_state = (uint64_t*)calloc(state_blocks, sizeof(uint64_t));
+    if (!r->next_state) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    size_t const header_blocks = blocks_of(sizeof(shared_header_t) * 8);
+    r->shared_size = (header_blocks + 2 * r->boundary_blocks + r->result_blocks) * sizeof(uint64_t);
+
+    void* shared = mmap(NULL, r->shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    r->header = (shared_header_t*)shared;
+    r->buffers[0] = (uint64_t*)shared + header_blocks;
+    r->buffers[1] = r->buffers[0] + r->boundary_blocks;
+    r->results = r->buffers[1] + r->boundary_blocks;
+
+    atomic_init(&r->header->arrived, 0);
+    atomic_init(&r->header->generation, 0);
+    atomic_init(&r->header->aborted, 0);
+
+    for (size_t i = 0; i < num; i++) {
+        if (r->boundary_offset[i] != NOT_FOUND) {
+            memcpy(r->buffers[0] + r->boundary_offset[i], r->at[i]->output,
+                   blocks_of(r->at[i]->output_signals_num) * sizeof(uint64_t));
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Copies the states, outputs and inputs computed by the child processes back into the automata.
+ */
+static void collect_results(shm_run_t const* r) {
+    for (size_t i = 0; i < r->num; i++) {
+        moore_t* a = r->at[i];
+        uint64_t const* result = r->results + r->result_offset[i];
+        size_t const state_blocks = blocks_of(a->state_signals_num);
+        size_t const output_blocks = blocks_of(a->output_signals_num);
+
+        memcpy(a->state, result, state_blocks * sizeof(uint64_t));
+        memcpy(a->output, result + state_blocks, output_blocks * sizeof(uint64_t));
+        if (a->input) {
+            memcpy(a->input, result + state_blocks + output_blocks,
+                   blocks_of(a->input_signals_num) * sizeof(uint64_t));
+        }
+    }
+}
+
+/*
+ * Aborts the run: wakes the processes waiting on the barrier, kills the remaining ones and waits for them.
+ */
+static void abort_run(shm_run_t* r, pid_t const* children, size_t const started, bool* finished) {
+    atomic_store(&r->header->aborted, 1);
+    futex(&r->header->generation, FUTEX_WAKE, (unsigned)r->processes, NULL);
+
+    for (size_t p = 0; p < started; p++) {
+        if (!finished[p]) {
+            kill(children[p], SIGKILL);
+            waitpid(children[p], NULL, 0);
+        }
+    }
+}
+
+/*
+ * The function performs 'steps' computation steps of the automata from the array 'at[]' in 'processes' child
+ * processes, each stepping a part of the network. The result is the same as calling ma_step 'steps' times on the
+ * array. Automata outside the array connected to the inputs of the array keep their outputs during the run.
+ *
+ * It returns 0 if the steps were done. It returns -1 and sets errno to EINVAL if any pointer is NULL, 'num', 'steps'
+ * or 'processes' is 0 or an automaton occurs twice, to ENOMEM if a memory allocation error occurred, to EAGAIN if a process could not be started
+ * or to ECHILD if a child process failed, e.g. a callback crashed. In such cases, the automata are left unchanged.
+ */
+int ma_shm_step(moore_t* at[], size_t num, size_t processes, size_t steps) {
+    if (!at || num == 0 || processes == 0 || steps == 0 || null_in_the_array(at, num)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (processes > num) processes = num;
+
+    shm_run_t r;
+    memset(&r, 0, sizeof(r));
+    r.at = at;
+    r.num = num;
+    r.processes = processes;
+
+    pid_t* children = (pid_t*)calloc(processes, sizeof(pid_t));
+    bool* finished = (bool*)calloc(processes, sizeof(bool));
+    if (!children || !finished || !prepare_run(&r)) {
+        if (!children || !finished) errno = ENOMEM;
+        free(children);
+        free(finished);
+        free_run(&r);
+        return -1;
+    }
+
+    for (size_t p = 0; p < processes; p++) {
+        pid_t const pid = fork();
+        if (pid == 0) {
+            run_partition(&r, p, steps);
+        }
+        if (pid < 0) {
+            abort_run(&r, children, p, finished);
+            free(children);
+            free(finished);
+            free_run(&r);
+            errno = EAGAIN;
+            return -1;
+        }
+        children[p] = pid;
+    }
+
+    // polling all children, so that a crash of any of them is noticed while the others wait on the barrier
+    bool failed = false;
+    size_t waited = 0;
+    long pause = 50 * 1000;
+    while (waited < processes && !failed) {
+        bool progress = false;
+
+        for (size_t p = 0; p < processes && !failed; p++) {
+            if (finished[p]) continue;
+
+            int status;
+            pid_t const pid = waitpid(children[p], &status, WNOHANG);
+            if (pid == 0) continue;
+
+            finished[p] = true;
+            waited++;
+            progress = true;
+            if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) failed = true;
+        }
+
+        if (!progress && waited < processes) {
+            struct timespec const delay = {0, pause};
+            nanosleep(&delay, NULL);
+            if (pause < 1000 * 1000) pause *= 2;
+        }
+    }
+
+    if (failed) {
+        abort_run(&r, children, processes, finished);
+    }
+    else {
+        collect_results(&r);
+    }
+
+    free(children);
+    free(finished);
+    free_run(&r);
+
+    if (failed) {
+        errno = ECHILD;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,9 @@
+#ifndef MA_SHM_H
+#define MA_SHM_H
+
+#include <stddef.h>
+#include "ma.h"
+
+int ma_shm_step(moore_t *at[], size_t num, size_t processes, size_t steps);
+
+#endif //MA_SHM_H
@@ -0,0 +1,176 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Word-level kernels on bit sequences: masked copy, masked merge and XOR difference. The merge and difference kernels
+ * have AVX2 and AVX-512 versions besides the scalar one, selected once when the library is loaded
+ * according to the CPU. The selection can be narrowed with the MA_SIMD environment variable set to "scalar" or "avx2".
+ * The copy is left to memcpy, which glibc already dispatches to the widest vector instructions, and only the last
+ * block is masked.
+ *
+ * Sequences shorter than SIMD_MIN_WORDS blocks are always processed by the scalar code, since most automata have only
+ * a few signals and the indirect call would cost more than it saves.
+ **/
+
+#define _GNU_SOURCE
+
+#include "ma_additional.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+#define FILL_THE_BLOCK 63
+#define BITS_PER_BLOCK 64
+#define SIMD_MIN_WORDS 8
+
+typedef struct kernels {
+    void (*merge)(uint64_t*, uint64_t const*, uint64_t const*, size_t);
+    size_t (*xor_diff)(uint64_t*, uint64_t const*, uint64_t const*, size_t);
+} kernels_t;
+
+static void merge_scalar(uint64_t* dest, uint64_t const* src, uint64_t const* keep, size_t const words) {
+    for (size_t w = 0; w < words; w++) {
+        dest[w] = (dest[w] & keep[w]) | (src[w] & ~keep[w]);
+    }
+}
+
+static size_t xor_diff_scalar(uint64_t* diff, uint64_t const* a, uint64_t const* b, size_t const words) {
+    size_t changed = 0;
+
+    for (size_t w = 0; w < words; w++) {
+        diff[w] = a[w] ^ b[w];
+        changed += diff[w] != 0;
+    }
+
+    return changed;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("avx2")))
+static void merge_avx2(uint64_t* dest, uint64_t const* src, uint64_t const* keep, size_t const words) {
+    size_t w = 0;
+
+    for (; w + 4 <= words; w += 4) {
+        __m256i const d = _mm256_loadu_si256((__m256i const*)(dest + w));
+        __m256i const s = _mm256_loadu_si256((__m256i const*)(src + w));
+        __m256i const k = _mm256_loadu_si256((__m256i const*)(keep + w));
+        _mm256_storeu_si256((__m256i*)(dest + w), _mm256_or_si256(_mm256_and_si256(d, k), _mm256_andnot_si256(k, s)));
+    }
+
+    merge_scalar(dest + w, src + w, keep + w, words - w);
+}
+
+__attribute__((target("avx2")))
+static size_t xor_diff_avx2(uint64_t* diff, uint64_t const* a, uint64_t const* b, size_t const words) {
+    __m256i const zero = _mm256_setzero_si256();
+    size_t changed = 0;
+    size_t w = 0;
+
+    for (; w + 4 <= words; w += 4) {
+        __m256i const x = _mm256_xor_si256(_mm256_loadu_si256((__m256i const*)(a + w)),
+                                           _mm256_loadu_si256((__m256i const*)(b + w)));
+        _mm256_storeu_si256((__m256i*)(diff + w), x);
+
+        int const unchanged = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(x, zero)));
+        changed += 4 - (size_t)__builtin_popcount((unsigned)unchanged);
+    }
+
+    return changed + xor_diff_scalar(diff + w, a + w, b + w, words - w);
+}
+
+// Selects the bits of 'd' where 'k' is set and the bits of 's' elsewhere in one instruction.
+__attribute__((target("avx512f")))
+static void merge_avx512(uint64_t* dest, uint64_t const* src, uint64_t const* keep, size_t const words) {
+    size_t w = 0;
+
+    for (; w + 8 <= words; w += 8) {
+        __m512i const d = _mm512_loadu_si512(dest + w);
+        __m512i const s = _mm512_loadu_si512(src + w);
+        __m512i const k = _mm512_loadu_si512(keep + w);
+        _mm512_storeu_si512(dest + w, _mm512_ternarylogic_epi64(k, d, s, 0xCA));
+    }
+
+    merge_scalar(dest + w, src + w, keep + w, words - w);
+}
+
+__attribute__((target("avx512f")))
+static size_t xor_diff_avx512(uint64_t* diff, uint64_t const* a, uint64_t const* b, size_t const words) {
+    size_t changed = 0;
+    size_t w = 0;
+
+    for (; w + 8 <= words; w += 8) {
+        __m512i const x = _mm512_xor_si512(_mm512_loadu_si512(a + w), _mm512_loadu_si512(b + w));
+        _mm512_storeu_si512(diff + w, x);
+        changed += (size_t)__builtin_popcount((unsigned)_mm512_test_epi64_mask(x, x));
+    }
+
+    return changed + xor_diff_scalar(diff + w, a + w, b + w, words - w);
+}
+
+#endif
+
+static kernels_t kernels = {merge_scalar, xor_diff_scalar};
+
+__attribute__((constructor))
+static void select_kernels(void) {
+#ifdef HAVE_X86_KERNELS
+    char const* limit = getenv("MA_SIMD");
+    bool const allow_avx2 = !limit || strcmp(limit, "scalar") != 0;
+    bool const allow_avx512 = allow_avx2 && (!limit || strcmp(limit, "avx2") != 0);
+
+    __builtin_cpu_init();
+
+    if (allow_avx2 && __builtin_cpu_supports("avx2")) {
+        kernels.merge = merge_avx2;
+        kernels.xor_diff = xor_diff_avx2;
+    }
+    if (allow_avx512 && __builtin_cpu_supports("avx512f")) {
+        kernels.merge = merge_avx512;
+        kernels.xor_diff = xor_diff_avx512;
+    }
+#endif
+}
+
+/*
+ * Copies the first 'bits' bits of 'src' to 'dest' and zeroes the unused bits of the last block of 'dest'.
+ */
+void masked_copy(uint64_t* dest, uint64_t const* src, size_t const bits) {
+    size_t const blocks = (bits + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+
+    if (blocks == 1) {
+        dest[0] = src[0];
+    }
+    else {
+        memcpy(dest, src, blocks * sizeof(uint64_t));
+    }
+
+    if (bits % BITS_PER_BLOCK != 0) {
+        dest[blocks - 1] &= create_bit_mask(bits % BITS_PER_BLOCK);
+    }
+}
+
+/*
+ * Sets 'dest[w] = (dest[w] & keep[w]) | (src[w] & ~keep[w])' for the first 'words' blocks, i.e. copies the bits of
+ * 'src' wherever 'keep' is not set.
+ */
+void masked_merge(uint64_t* dest, uint64_t const* src, uint64_t const* keep, size_t const words) {
+    if (words < SIMD_MIN_WORDS) {
+        merge_scalar(dest, src, keep, words);
+    }
+    else {
+        kernels.merge(dest, src, keep, words);
+    }
+}
+
+/*
+ * Writes 'a ^ b' to 'diff' for the first 'words' blocks and returns the number of non-zero blocks of 'diff'. 'diff'
+ * may be the same array as 'a' or 'b'.
+ */
+size_t xor_diff(uint64_t* diff, uint64_t const* a, uint64_t const* b, size_t const words) {
+    return words < SIMD_MIN_WORDS ? xor_diff_scalar(diff, a, b, words) : kernels.xor_diff(diff, a, b, words);
+}
@@ -0,0 +1,218 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Allocation statistics of the library. The library is linked with -Wl,--wrap for malloc, calloc, realloc,
+ * reallocarray, free, strdup and strndup (see the makefile). When it is built with MA_STATS defined (make STATS=1), this
+ * file provides the __wrap_ functions, which count the allocations, the allocated bytes and the frees, attributing them
+ * to the public function of ma.h being executed by the thread, and keep track of the live and peak live bytes.
+ *
+ * Without MA_STATS, nothing is counted, the wrappers have to be provided by the program, and ma_stats_get fails.
+ **/
+
+#define _GNU_SOURCE
+
+#include "ma.h"
+#include "ma_additional.h"
+#include "ma_stats.h"
+
+#include <errno.h>
+#include <malloc.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char const* const api_names[MA_API_COUNT] = {
+    "ma_create_full",
+    "ma_create_simple",
+    "ma_delete",
+    "ma_connect",
+    "ma_disconnect",
+    "ma_set_input",
+    "ma_set_state",
+    "ma_get_output",
+    "ma_get_output_num",
+    "ma_step",
+    "other",
+};
+
+#ifdef MA_STATS
+
+typedef struct api_counters {
+    atomic_size_t calls;
+    atomic_size_t allocations;
+    atomic_size_t allocated_bytes;
+    atomic_size_t frees;
+    atomic_size_t freed_bytes;
+} api_counters_t;
+
+static api_counters_t counters[MA_API_COUNT];
+static atomic_size_t live_bytes;
+static atomic_size_t peak_live_bytes;
+static _Thread_local ma_api_t current_api = MA_API_OTHER;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t num, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void* __real_reallocarray(void* ptr, size_t num, size_t size);
+void __real_free(void* ptr);
+char* __real_strdup(char const* s);
+char* __real_strndup(char const* s, size_t size);
+
+static void count_allocation(void const* ptr) {
+    if (!ptr) return;
+
+    size_t const size = malloc_usable_size((void*)ptr);
+    api_counters_t* c = &counters[current_api];
+    atomic_fetch_add_explicit(&c->allocations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->allocated_bytes, size, memory_order_relaxed);
+
+    size_t const live = atomic_fetch_add_explicit(&live_bytes, size, memory_order_relaxed) + size;
+    size_t peak = atomic_load_explicit(&peak_live_bytes, memory_order_relaxed);
+    while (live > peak &&
+           !atomic_compare_exchange_weak_explicit(&peak_live_bytes, &peak, live, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+}
+
+static void count_free(size_t const size) {
+    api_counters_t* c = &counters[current_api];
+    atomic_fetch_add_explicit(&c->frees, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->freed_bytes, size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&live_bytes, size, memory_order_relaxed);
+}
+
+void* __wrap_malloc(size_t size) {
+    void* ptr = __real_malloc(size);
+    count_allocation(ptr);
+    return ptr;
+}
+
+void* __wrap_calloc(size_t num, size_t size) {
+    void* ptr = __real_calloc(num, size);
+    count_allocation(ptr);
+    return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    size_t const old_size = ptr ? malloc_usable_size(ptr) : 0;
+    void* result = __real_realloc(ptr, size);
+
+    if (ptr && (result || size == 0)) count_free(old_size);
+    count_allocation(result);
+    return result;
+}
+
+void* __wrap_reallocarray(void* ptr, size_t num, size_t size) {
+    size_t const old_size = ptr ? malloc_usable_size(ptr) : 0;
+    void* result = __real_reallocarray(ptr, num, size);
+
+    if (ptr && (result || num == 0 || size == 0)) count_free(old_size);
+    count_allocation(result);
+    return result;
+}
+
+char* __wrap_strdup(char const* s) {
+    char* result = __real_strdup(s);
+    count_allocation(result);
+    return result;
+}
+
+char* __wrap_strndup(char const* s, size_t size) {
+    char* result = __real_strndup(s, size);
+    count_allocation(result);
+    return result;
+}
+
+void __wrap_free(void* ptr) {
+    if (ptr) count_free(malloc_usable_size(ptr));
+    __real_free(ptr);
+}
+
+/*
+ * Marks the beginning of a public function. Allocations are attributed to the outermost public function, so e.g.
+ * the call of ma_set_state inside ma_create_full is counted as a part of ma_create_full. Returns the previous function.
+ */
+ma_api_t stats_enter(ma_api_t const api) {
+    ma_api_t const previous = current_api;
+
+    if (previous == MA_API_OTHER) {
+        current_api = api;
+        atomic_fetch_add_explicit(&counters[api].calls, 1, memory_order_relaxed);
+    }
+
+    return previous;
+}
+
+void stats_leave(ma_api_t const* previous) {
+    current_api = *previous;
+}
+
+/*
+ * The function writes the allocation statistics gathered since the start of the program or the last ma_stats_reset
+ * to 'stats'.
+ *
+ * It returns 0, or -1 if the pointer is NULL, setting errno to EINVAL, or if the library was built without MA_STATS,
+ * setting errno to ENOTSUP.
+ */
+int ma_stats_get(ma_stats_t* stats) {
+    if (!stats) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (size_t api = 0; api < MA_API_COUNT; api++) {
+        stats->api[api].calls = atomic_load(&counters[api].calls);
+        stats->api[api].allocations = atomic_load(&counters[api].allocations);
+        stats->api[api].allocated_bytes = atomic_load(&counters[api].allocated_bytes);
+        stats->api[api].frees = atomic_load(&counters[api].frees);
+        stats->api[api].freed_bytes = atomic_load(&counters[api].freed_bytes);
+    }
+    stats->live_bytes = atomic_load(&live_bytes);
+    stats->peak_live_bytes = atomic_load(&peak_live_bytes);
+
+    return 0;
+}
+
+/*
+ * The function resets the counters of calls, allocations and frees. The peak live bytes are set to the current live
+ * bytes. It does nothing if the library was built without MA_STATS.
+ */
+void ma_stats_reset(void) {
+    for (size_t api = 0; api < MA_API_COUNT; api++) {
+        atomic_store(&counters[api].calls, 0);
+        atomic_store(&counters[api].allocations, 0);
+        atomic_store(&counters[api].allocated_bytes, 0);
+        atomic_store(&counters[api].frees, 0);
+        atomic_store(&counters[api].freed_bytes, 0);
+    }
+    atomic_store(&peak_live_bytes, atomic_load(&live_bytes));
+}
+
+#else
+
+int ma_stats_get(ma_stats_t* stats) {
+    if (!stats) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    errno = ENOTSUP;
+    return -1;
+}
+
+void ma_stats_reset(void) {
+}
+
+#endif
+
+/*
+ * Returns the name of the public function 'api' or NULL if 'api' is out of range, setting errno to EINVAL.
+ */
+char const* ma_stats_api_name(ma_api_t api) {
+    if ((unsigned)api >= MA_API_COUNT) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return api_names[api];
+}
@@ -0,0 +1,41 @@
+#ifndef MA_STATS_H
+#define MA_STATS_H
+
+#include <stddef.h>
+
+// Public functions of ma.h whose memory allocations are counted separately. Allocations made outside of them (pools,
+// engines, ...) are counted as MA_API_OTHER.
+typedef enum ma_api {
+    MA_API_CREATE_FULL,
+    MA_API_CREATE_SIMPLE,
+    MA_API_DELETE,
+    MA_API_CONNECT,
+    MA_API_DISCONNECT,
+    MA_API_SET_INPUT,
+    MA_API_SET_STATE,
+    MA_API_GET_OUTPUT,
+    MA_API_GET_OUTPUT_NUM,
+    MA_API_STEP,
+    MA_API_OTHER,
+    MA_API_COUNT
+} ma_api_t;
+
+typedef struct ma_api_stats {
+    size_t calls;
+    size_t allocations;
+    size_t allocated_bytes;
+    size_t frees;
+    size_t freed_bytes;
+} ma_api_stats_t;
+
+typedef struct ma_stats {
+    ma_api_stats_t api[MA_API_COUNT];
+    size_t live_bytes;
+    size_t peak_live_bytes;
+} ma_stats_t;
+
+int ma_stats_get(ma_stats_t *stats);
+void ma_stats_reset(void);
+char const * ma_stats_api_name(ma_api_t api);
+
+#endif //MA_STATS_H
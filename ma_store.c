@@ -0,0 +1,619 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Step engine with a double-buffered global signal store. The outputs of all stepped automata, and of the automata
+ * outside the array they read from, live in two packed buffers: the current one, holding the outputs of the previous
+ * step, and the next one. Every step is a single pass over the automata: each automaton reads its connected inputs
+ * straight from the current buffer, computes its new state and writes its output to the next buffer. The buffers are
+ * swapped at the end of the step, which keeps the semantics of ma_step without a separate gather phase.
+ *
+ * Connected inputs are compiled into runs of consecutive input bits fed by consecutive output bits of the store, so a
+ * whole run is copied with a few shifts instead of one bit at a time. The outputs are copied into the store when
+ * stepping starts and back to the automata when it ends.
+ *
+ * The compiled wiring can be replaced while the engine is stepped. Connection changes are staged in a pending batch,
+ * and publishing it compiles a new wiring and swaps the pointer to it. The stepping thread announces the wiring it
+ * uses in every step, which is how the publisher knows when the old one can be freed (a grace period, as in RCU).
+ **/
+
+#include "ma.h"
+#include "ma_additional.h"
+#include "ma_store.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILL_THE_BLOCK 63
+#define BITS_PER_BLOCK 64
+#define NOT_FOUND ((size_t)-1)
+#define NOT_CONNECTED ((size_t)-1)
+
+// Input bits 'bit' .. 'bit + length - 1' of an automaton are the bits 'source_bit' .. of the store.
+typedef struct gather_run {
+    size_t bit;
+    size_t source_bit;
+    size_t length;
+} gather_run_t;
+
+// Compiled connections of the automata, replaced as a whole when a rewiring is published.
+typedef struct wiring {
+    size_t* run_offsets; // the runs of 'at[i]' are 'runs[run_offsets[i]]' .. 'runs[run_offsets[i + 1] - 1]'
+    gather_run_t* runs;
+    uint64_t* connected; // connected inputs, the mask of 'at[i]' starts at the block 'mask_offset[i]'
+} wiring_t;
+
+// Staged change of the connections of the inputs 'in' .. 'in + num - 1' of 'at[target]', 'source' is NULL if they
+// are disconnected.
+typedef struct rewire {
+    size_t target;
+    size_t in;
+    moore_t* source;
+    size_t out;
+    size_t num;
+} rewire_t;
+
+typedef struct ma_store {
+    moore_t** at;
+    size_t num;
+    moore_t** external; // automata outside the array read by its automata
+    size_t external_num;
+    automata_index_t index;
+    automata_index_t external_index;
+
+    size_t* offset; // offsets of the outputs in the store, first of 'at', then of 'external'
+    size_t blocks;
+    uint64_t* buffers[2];
+    size_t current;
+
+    size_t* wire_offset; // the inputs of 'at[i]' start at 'wires[wire_offset[i]]'
+    size_t* mask_offset;
+    size_t* wires; // bit of the store every input is connected to, NOT_CONNECTED if none
+    _Atomic(wiring_t*) wiring;
+    _Atomic(wiring_t*) in_use; // wiring used by the step in progress, NULL between steps
+
+    pthread_mutex_t lock; // serializes staging and publishing
+    rewire_t* pending;
+    size_t pending_num;
+    size_t pending_capacity;
+} ma_store_t;
+
+static void free_wiring(wiring_t* w) {
+    if (w) {
+        free(w->run_offsets);
+        free(w->runs);
+        free(w->connected);
+        free(w);
+    }
+}
+
+static void free_store(ma_store_t* s) {
+    free(s->at);
+    free(s->external);
+    free_index(&s->index);
+    free_index(&s->external_index);
+    free(s->offset);
+    free(s->buffers[0]);
+    free(s->buffers[1]);
+    free(s->wire_offset);
+    free(s->mask_offset);
+    free(s->wires);
+    free_wiring(atomic_load(&s->wiring));
+    free(s->pending);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+static size_t blocks_of(size_t const bits) {
+    return (bits + FILL_THE_BLOCK) / BITS_PER_BLOCK;
+}
+
+// Reads 'length' (at most 64) bits of 'source' starting from the bit 'position'.
+static uint64_t read_bits(uint64_t const* source, size_t const position, size_t const length) {
+    size_t const block = position / BITS_PER_BLOCK;
+    size_t const offset = position % BITS_PER_BLOCK;
+
+    uint64_t value = source[block] >> offset;
+    if (offset + length > BITS_PER_BLOCK) value |= source[block + 1] << (BITS_PER_BLOCK - offset);
+
+    return length == BITS_PER_BLOCK ? value : value & create_bit_mask(length);
+}
+
+// Sets 'length' bits of 'dest' starting from the bit 'position', which have to be zero, to the bits of 'value'.
+static void write_bits(uint64_t* dest, size_t const position, size_t const length, uint64_t const value) {
+    size_t const block = position / BITS_PER_BLOCK;
+    size_t const offset = position % BITS_PER_BLOCK;
+
+    dest[block] |= value << offset;
+    if (offset + length > BITS_PER_BLOCK) dest[block + 1] |= value >> (BITS_PER_BLOCK - offset);
+}
+
+/*
+ * Returns the slot of the automaton in the store, or NOT_FOUND if its output is not there.
+ */
+static size_t slot_of(ma_store_t const* s, moore_t const* a) {
+    size_t const i = find_index(&s->index, a);
+    if (i != NOT_FOUND) return i;
+
+    size_t const j = find_index(&s->external_index, a);
+    return j != NOT_FOUND ? s->num + j : NOT_FOUND;
+}
+
+/*
+ * Finds the automata outside the array read by the automata of the array and assigns the offsets in the store.
+ * Returns false and sets errno to ENOMEM if a memory allocation error occurs.
+ */
+static bool assign_offsets(ma_store_t* s) {
+    size_t candidates = 0;
+    size_t inputs = 0;
+    size_t masks = 0;
+
+    s->wire_offset = (size_t*)malloc((s->num + 1) * sizeof(size_t));
+    s->mask_offset = (size_t*)malloc((s->num + 1) * sizeof(size_t));
+    if (!s->wire_offset || !s->mask_offset) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    for (size_t i = 0; i < s->num; i++) {
+        moore_t const* a = s->at[i];
+        s->wire_offset[i] = inputs;
+        s->mask_offset[i] = masks;
+        inputs += a->input_signals_num;
+        masks += blocks_of(a->input_signals_num);
+
+        for (size_t bit = 0; bit < a->input_signals_num; bit++) {
+            incoming_t const* connection = &a->incoming_connections[bit];
+            if (connection->source_aut && find_index(&s->index, connection->source_aut) == NOT_FOUND) {
+                candidates++;
+            }
+        }
+    }
+    s->wire_offset[s->num] = inputs;
+    s->mask_offset[s->num] = masks;
+
+    s->wires = (size_t*)malloc((inputs + 1) * sizeof(size_t));
+    s->external = (moore_t**)malloc((candidates + 1) * sizeof(moore_t*));
+    if (!s->wires || !s->external) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    for (size_t i = 0; i < s->num; i++) {
+        moore_t const* a = s->at[i];
+        for (size_t bit = 0; bit < a->input_signals_num; bit++) {
+            incoming_t const* connection = &a->incoming_connections[bit];
+            if (connection->source_aut && find_index(&s->index, connection->source_aut) == NOT_FOUND) {
+                s->external[s->external_num++] = connection->source_aut;
+            }
+        }
+    }
+
+    s->offset = (size_t*)malloc((s->num + s->external_num + 1) * sizeof(size_t));
+    if (!s->offset) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    for (size_t i = 0; i < s->num; i++) {
+        s->offset[i] = s->blocks;
+        s->blocks += blocks_of(s->at[i]->output_signals_num);
+    }
+
+    return true;
+}
+
+/*
+ * Fills the table of wires from the connections of the automata.
+ */
+static void read_wires(ma_store_t* s) {
+    for (size_t i = 0; i < s->num; i++) {
+        moore_t const* a = s->at[i];
+
+        for (size_t bit = 0; bit < a->input_signals_num; bit++) {
+            incoming_t const* connection = &a->incoming_connections[bit];
+            size_t* wire = &s->wires[s->wire_offset[i] + bit];
+
+            if (connection->source_aut) {
+                *wire = s->offset[slot_of(s, connection->source_aut)] * BITS_PER_BLOCK + connection->source_bit;
+            }
+            else {
+                *wire = NOT_CONNECTED;
+            }
+        }
+    }
+}
+
+/*
+ * Compiles the table of wires into runs and connected masks. Returns NULL and sets errno to ENOMEM if a memory
+ * allocation error occurs.
+ */
+static wiring_t* compile_wiring(ma_store_t const* s, size_t const* wires) {
+    size_t connected_bits = 0;
+    for (size_t k = 0; k < s->wire_offset[s->num]; k++) {
+        if (wires[k] != NOT_CONNECTED) connected_bits++;
+    }
+
+    wiring_t* w = (wiring_t*)calloc(1, sizeof(wiring_t));
+    if (w) {
+        w->run_offsets = (size_t*)malloc((s->num + 1) * sizeof(size_t));
+        w->runs = (gather_run_t*)malloc((connected_bits + 1) * sizeof(gather_run_t));
+        w->connected = (uint64_t*)calloc(s->mask_offset[s->num] + 1, sizeof(uint64_t));
+    }
+    if (!w || !w->run_offsets || !w->runs || !w->connected) {
+        free_wiring(w);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < s->num; i++) {
+        uint64_t* connected = w->connected + s->mask_offset[i];
+        w->run_offsets[i] = count;
+
+        for (size_t bit = 0; bit < s->at[i]->input_signals_num; bit++) {
+            size_t const source_bit = wires[s->wire_offset[i] + bit];
+            if (source_bit == NOT_CONNECTED) continue;
+
+            connected[bit / BITS_PER_BLOCK] |= 1ULL << (bit % BITS_PER_BLOCK);
+
+            gather_run_t* last = count > w->run_offsets[i] ? &w->runs[count - 1] : NULL;
+            if (last && last->bit + last->length == bit && last->source_bit + last->length == source_bit) {
+                last->length++;
+            }
+            else {
+                w->runs[count++] = (gather_run_t){bit, source_bit, 1};
+            }
+        }
+    }
+    w->run_offsets[s->num] = count;
+
+    return w;
+}
+
+/*
+ * The function creates a store engine for the automata from the array 'at[]'.
+ *
+ * The engine works on a snapshot of the connections, which can only be changed through ma_store_connect and
+ * ma_store_disconnect while the engine exists. The automata must not be deleted while the engine exists, and neither
+ * must the automata outside the array read by its automata; their outputs are read when ma_store_step is called.
+ *
+ * It returns a pointer to the engine, or NULL if any pointer is NULL, 'num' is 0, or an automaton occurs twice,
+ * setting errno to EINVAL, or if a memory allocation error occurred, setting errno to ENOMEM.
+ */
+ma_store_t* ma_store_create(moore_t* at[], size_t num) {
+    if (!at || num == 0 || null_in_the_array(at, num)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ma_store_t* s = (ma_store_t*)calloc(1, sizeof(ma_store_t));
+    if (!s) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+
+    s->num = num;
+    s->at = (moore_t**)malloc(num * sizeof(moore_t*));
+    if (!s->at) {
+        free_store(s);
+        errno = ENOMEM;
+        return NULL;
+    }
+    memcpy(s->at, at, num * sizeof(moore_t*));
+
+    bool ok = build_index(&s->index, s->at, num);
+
+    for (size_t i = 0; ok && i < num; i++) {
+        if (find_index(&s->index, s->at[i]) != i) {
+            ok = false;
+            errno = EINVAL;
+        }
+    }
+
+    ok = ok && assign_offsets(s) && build_index(&s->external_index, s->external, s->external_num);
+
+    if (ok) {
+        // duplicates among the external automata share the slot of the first occurrence
+        size_t unique = 0;
+        for (size_t j = 0; j < s->external_num; j++) {
+            if (find_index(&s->external_index, s->external[j]) == j) s->external[unique++] = s->external[j];
+        }
+        s->external_num = unique;
+        free_index(&s->external_index);
+        ok = build_index(&s->external_index, s->external, unique);
+
+        for (size_t j = 0; ok && j < unique; j++) {
+            s->offset[num + j] = s->blocks;
+            s->blocks += blocks_of(s->external[j]->output_signals_num);
+        }
+    }
+
+    if (ok) {
+        read_wires(s);
+        wiring_t* w = compile_wiring(s, s->wires);
+        atomic_init(&s->wiring, w);
+        ok = w != NULL;
+    }
+
+    if (ok) {
+        s->buffers[0] = (uint64_t*)calloc(s->blocks, sizeof(uint64_t));
+        s->buffers[1] = (uint64_t*)calloc(s->blocks, sizeof(uint64_t));
+        if (!s->buffers[0] || !s->buffers[1]) {
+            ok = false;
+            errno = ENOMEM;
+        }
+    }
+
+    if (!ok) {
+        free_store(s);
+        return NULL;
+    }
+
+    return s;
+}
+
+static void step_automaton(ma_store_t* s, wiring_t const* wiring, size_t const i, uint64_t const* current,
+                           uint64_t* next) {
+    moore_t* a = s->at[i];
+
+    if (a->input_signals_num != 0) {
+        size_t const input_blocks = blocks_of(a->input_signals_num);
+        uint64_t const* connected = wiring->connected + s->mask_offset[i];
+        for (size_t w = 0; w < input_blocks; w++) {
+            a->input[w] &= ~connected[w];
+        }
+
+        for (size_t r = wiring->run_offsets[i]; r < wiring->run_offsets[i + 1]; r++) {
+            gather_run_t const* run = &wiring->runs[r];
+            for (size_t done = 0; done < run->length; done += BITS_PER_BLOCK) {
+                size_t const length = run->length - done < BITS_PER_BLOCK ? run->length - done : BITS_PER_BLOCK;
+                write_bits(a->input, run->bit + done, length, read_bits(current, run->source_bit + done, length));
+            }
+        }
+    }
+
+    size_t const state_blocks = blocks_of(a->state_signals_num);
+    memset(a->next_state, 0, state_blocks * sizeof(uint64_t));
+    a->transition_function(a->next_state, a->input, a->state, a->input_signals_num, a->state_signals_num);
+    masked_copy(a->state, a->next_state, a->state_signals_num);
+
+    uint64_t* output = next + s->offset[i];
+    a->output_function(output, a->state, a->output_signals_num, a->state_signals_num);
+
+    if (a->output_signals_num % BITS_PER_BLOCK != 0) { // mask the last block if needed
+        output[blocks_of(a->output_signals_num) - 1] &= create_bit_mask(a->output_signals_num % BITS_PER_BLOCK);
+    }
+}
+
+/*
+ * Announces the wiring used by the step which begins, so a publisher does not free it. Never waits: if a new wiring
+ * is published in between, the announcement is simply repeated for it.
+ */
+static wiring_t const* enter_wiring(ma_store_t* s) {
+    wiring_t* w = atomic_load(&s->wiring);
+
+    for (;;) {
+        atomic_store(&s->in_use, w);
+        wiring_t* again = atomic_load(&s->wiring);
+        if (again == w) return w;
+        w = again;
+    }
+}
+
+static void leave_wiring(ma_store_t* s) {
+    atomic_store_explicit(&s->in_use, NULL, memory_order_release);
+}
+
+/*
+ * The function performs 'steps' computation steps of all automata of the engine. The result is the same as calling
+ * ma_step 'steps' times on the array the engine was created with. A rewiring published by another thread meanwhile
+ * takes effect from the next step, every step sees either the whole rewiring or nothing of it. Only one thread may
+ * step the engine at a time.
+ *
+ * It returns 0, or -1 if the pointer is NULL or 'steps' is 0, setting errno to EINVAL.
+ */
+int ma_store_step(ma_store_t* s, size_t steps) {
+    if (!s || steps == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (size_t i = 0; i < s->num; i++) {
+        moore_t const* a = s->at[i];
+        memcpy(s->buffers[s->current] + s->offset[i], a->output, blocks_of(a->output_signals_num) * sizeof(uint64_t));
+    }
+
+    // the outputs of the external automata do not change while stepping, so both buffers hold them
+    for (size_t j = 0; j < s->external_num; j++) {
+        moore_t const* a = s->external[j];
+        size_t const offset = s->offset[s->num + j];
+        memcpy(s->buffers[0] + offset, a->output, blocks_of(a->output_signals_num) * sizeof(uint64_t));
+        memcpy(s->buffers[1] + offset, a->output, blocks_of(a->output_signals_num) * sizeof(uint64_t));
+    }
+
+    for (size_t step = 0; step < steps; step++) {
+        uint64_t const* current = s->buffers[s->current];
+        uint64_t* next = s->buffers[1 - s->current];
+        wiring_t const* wiring = enter_wiring(s);
+
+        for (size_t i = 0; i < s->num; i++) {
+            step_automaton(s, wiring, i, current, next);
+        }
+
+        leave_wiring(s);
+        s->current = 1 - s->current;
+    }
+
+    for (size_t i = 0; i < s->num; i++) {
+        moore_t* a = s->at[i];
+        memcpy(a->output, s->buffers[s->current] + s->offset[i], blocks_of(a->output_signals_num) * sizeof(uint64_t));
+    }
+
+    return 0;
+}
+
+static int stage(ma_store_t* s, rewire_t const* change) {
+    pthread_mutex_lock(&s->lock);
+
+    if (s->pending_num == s->pending_capacity) {
+        size_t const capacity = s->pending_capacity ? 2 * s->pending_capacity : 16;
+        rewire_t* pending = (rewire_t*)realloc(s->pending, capacity * sizeof(rewire_t));
+        if (!pending) {
+            pthread_mutex_unlock(&s->lock);
+            errno = ENOMEM;
+            return -1;
+        }
+        s->pending = pending;
+        s->pending_capacity = capacity;
+    }
+
+    s->pending[s->pending_num++] = *change;
+    pthread_mutex_unlock(&s->lock);
+
+    return 0;
+}
+
+/*
+ * The function stages connecting the next 'num' inputs of the automaton 'a_in' to the outputs of the automaton
+ * 'a_out', starting from the signals numbered 'in' and 'out', like ma_connect. Nothing changes until ma_store_publish
+ * is called. 'a_in' has to be stepped by the engine and 'a_out' has to have its output in the store, that is to be
+ * stepped by the engine or read by its automata when it was created. It may be called while the engine is stepped.
+ *
+ * It returns 0, or -1 if any pointer is NULL, 'num' is 0, a range of signals is invalid or an automaton is not in the
+ * engine, setting errno to EINVAL, or if a memory allocation error occurred, setting errno to ENOMEM.
+ */
+int ma_store_connect(ma_store_t* s, moore_t* a_in, size_t in, moore_t* a_out, size_t out, size_t num) {
+    if (!s || !a_in || !a_out || num == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t const target = find_index(&s->index, a_in);
+    if (target == NOT_FOUND || slot_of(s, a_out) == NOT_FOUND || in + num > a_in->input_signals_num ||
+        out + num > a_out->output_signals_num) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return stage(s, &(rewire_t){target, in, a_out, out, num});
+}
+
+/*
+ * The function stages disconnecting the next 'num' inputs of the automaton 'a_in', starting from the input numbered
+ * 'in', like ma_disconnect. Nothing changes until ma_store_publish is called. It may be called while the engine is
+ * stepped.
+ *
+ * It returns 0, or -1 if any pointer is NULL, 'num' is 0, the range of inputs is invalid or 'a_in' is not stepped by
+ * the engine, setting errno to EINVAL, or if a memory allocation error occurred, setting errno to ENOMEM.
+ */
+int ma_store_disconnect(ma_store_t* s, moore_t* a_in, size_t in, size_t num) {
+    if (!s || !a_in || num == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t const target = find_index(&s->index, a_in);
+    if (target == NOT_FOUND || in + num > a_in->input_signals_num) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return stage(s, &(rewire_t){target, in, NULL, 0, num});
+}
+
+/*
+ * The function applies all staged changes at once. The new wiring is compiled aside and swapped in with a single
+ * atomic store, so the thread stepping the engine never waits and sees the changes from its next step on. The old
+ * wiring is freed when the step using it ends, which is the only wait of the function. The connections of the
+ * automata themselves are changed as well, so they match the engine after it is deleted.
+ *
+ * It returns 0, or -1 if the pointer is NULL, setting errno to EINVAL, or if a memory allocation error occurred,
+ * setting errno to ENOMEM. If the error occurred before the new wiring was published, the changes stay staged and
+ * nothing is changed; otherwise the engine uses the new wiring, but some connections of the automata may be missing.
+ */
+int ma_store_publish(ma_store_t* s) {
+    if (!s) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&s->lock);
+
+    if (s->pending_num == 0) {
+        pthread_mutex_unlock(&s->lock);
+        return 0;
+    }
+
+    size_t const inputs = s->wire_offset[s->num];
+    size_t* wires = (size_t*)malloc((inputs + 1) * sizeof(size_t));
+    if (!wires) {
+        pthread_mutex_unlock(&s->lock);
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(wires, s->wires, inputs * sizeof(size_t));
+
+    for (size_t k = 0; k < s->pending_num; k++) {
+        rewire_t const* change = &s->pending[k];
+        size_t* wire = wires + s->wire_offset[change->target] + change->in;
+        size_t const base = change->source ? s->offset[slot_of(s, change->source)] * BITS_PER_BLOCK + change->out : 0;
+
+        for (size_t bit = 0; bit < change->num; bit++) {
+            wire[bit] = change->source ? base + bit : NOT_CONNECTED;
+        }
+    }
+
+    wiring_t* wiring = compile_wiring(s, wires);
+    if (!wiring) {
+        free(wires);
+        pthread_mutex_unlock(&s->lock);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // the stepping thread reads only the compiled wiring, so the connections of the automata can change meanwhile
+    bool synced = true;
+    for (size_t k = 0; k < s->pending_num; k++) {
+        rewire_t const* change = &s->pending[k];
+        moore_t* a_in = s->at[change->target];
+
+        if (change->source) {
+            synced = ma_connect(a_in, change->in, change->source, change->out, change->num) == 0 && synced;
+        }
+        else {
+            ma_disconnect(a_in, change->in, change->num);
+        }
+    }
+
+    wiring_t* old = atomic_exchange(&s->wiring, wiring);
+    while (atomic_load(&s->in_use) == old) {
+        sched_yield();
+    }
+    free_wiring(old);
+
+    free(s->wires);
+    s->wires = wires;
+    s->pending_num = 0;
+    pthread_mutex_unlock(&s->lock);
+
+    if (!synced) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * The function frees the engine. Changes staged and not published are dropped. The automata stay valid. It does
+ * nothing if called with a NULL pointer.
+ */
+void ma_store_delete(ma_store_t* s) {
+    if (s) {
+        free_store(s);
+    }
+}
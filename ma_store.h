@@ -0,0 +1,16 @@
+#ifndef MA_STORE_H
+#define MA_STORE_H
+
+#include <stddef.h>
+#include "ma.h"
+
+typedef struct ma_store ma_store_t;
+
+ma_store_t * ma_store_create(moore_t *at[], size_t num);
+int ma_store_step(ma_store_t *s, size_t steps);
+int ma_store_connect(ma_store_t *s, moore_t *a_in, size_t in, moore_t *a_out, size_t out, size_t num);
+int ma_store_disconnect(ma_store_t *s, moore_t *a_in, size_t in, size_t num);
+int ma_store_publish(ma_store_t *s);
+void ma_store_delete(ma_store_t *s);
+
+#endif //MA_STORE_H
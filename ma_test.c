@@ -0,0 +1,219 @@
+/**
+ * HANNA KALISZUK "MOORE AUTOMATA"
+ *
+ * Stress test of ma_step_checked (ma_component.h). Two threads step counters, automata adding one to their state in
+ * every step, and the final outputs are compared with the number of successful steps:
+ *  - separate automata, one per thread, which never share a component and so must never get EBUSY,
+ *  - two handles of one pool, which share the arrays of the pool but not their slots,
+ *  - one connected pair stepped by both threads, where every step either succeeds or fails with EBUSY, so the counter
+ *    equals the number of successful steps only if no two steps overlapped.
+ *
+ * The program prints one line per case and returns a non-zero exit status if any case fails.
+ *
+ * Usage: ma_test [steps]
+ **/
+
+#define _GNU_SOURCE
+
+#include "ma.h"
+#include "ma_component.h"
+#include "ma_pool.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define THREADS 2
+#define DEFAULT_STEPS 20000
+
+#ifndef MA_STATS
+
+// The library is linked with -Wl,--wrap (see the makefile) and provides the wrappers itself only with MA_STATS.
+void* __wrap_malloc(size_t size) {
+    return malloc(size);
+}
+
+void* __wrap_calloc(size_t num, size_t size) {
+    return calloc(num, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    return realloc(ptr, size);
+}
+
+void* __wrap_reallocarray(void* ptr, size_t num, size_t size) {
+    return reallocarray(ptr, num, size);
+}
+
+char* __wrap_strdup(char const* s) {
+    return strdup(s);
+}
+
+char* __wrap_strndup(char const* s, size_t size) {
+    return strndup(s, size);
+}
+
+void __wrap_free(void* ptr) {
+    free(ptr);
+}
+
+#endif
+
+// Work of one thread: 'steps' calls of ma_step_checked on 'at'.
+typedef struct worker {
+    moore_t** at;
+    size_t num;
+    size_t steps;
+    size_t stepped; // successful calls
+    size_t busy;    // calls failed with EBUSY
+    size_t failed;  // calls failed with any other error
+} worker_t;
+
+static void increment(uint64_t* next_state, uint64_t const* input, uint64_t const* state, size_t n, size_t s) {
+    (void)input;
+    (void)n;
+    (void)s;
+    next_state[0] = state[0] + 1;
+}
+
+static void* run_worker(void* arg) {
+    worker_t* w = (worker_t*)arg;
+
+    for (size_t i = 0; i < w->steps; i++) {
+        if (ma_step_checked(w->at, w->num) == 0) {
+            w->stepped++;
+        }
+        else if (errno == EBUSY) {
+            w->busy++;
+        }
+        else {
+            w->failed++;
+        }
+    }
+
+    return NULL;
+}
+
+// Runs the workers in separate threads. Returns false if a thread could not be created or joined.
+static bool run_workers(worker_t workers[THREADS]) {
+    pthread_t threads[THREADS];
+    size_t started = 0;
+
+    while (started < THREADS && pthread_create(&threads[started], NULL, run_worker, &workers[started]) == 0) {
+        started++;
+    }
+
+    bool ok = started == THREADS;
+    for (size_t i = 0; i < started; i++) {
+        ok = pthread_join(threads[i], NULL) == 0 && ok;
+    }
+
+    return ok;
+}
+
+static bool report(char const* name, bool const ok) {
+    printf("%-20s %s\n", name, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Every thread steps its own automaton, all steps have to succeed.
+static bool check_own(char const* name, moore_t* a[THREADS], size_t const steps) {
+    worker_t workers[THREADS];
+
+    for (size_t i = 0; i < THREADS; i++) {
+        workers[i] = (worker_t){.at = &a[i], .num = 1, .steps = steps};
+    }
+
+    bool ok = run_workers(workers);
+    for (size_t i = 0; i < THREADS; i++) {
+        ok = ok && workers[i].stepped == steps && ma_get_output(a[i])[0] == steps;
+    }
+
+    return report(name, ok);
+}
+
+static bool test_separate(size_t const steps) {
+    moore_t* a[THREADS] = {NULL};
+    bool ok = true;
+
+    for (size_t i = 0; i < THREADS; i++) {
+        a[i] = ma_create_simple(0, 32, increment);
+        ok = ok && a[i];
+    }
+
+    ok = ok ? check_own("separate automata", a, steps) : report("separate automata", false);
+
+    for (size_t i = 0; i < THREADS; i++) {
+        ma_delete(a[i]);
+    }
+
+    return ok;
+}
+
+static bool test_pool(size_t const steps) {
+    ma_pool_t* p = ma_pool_create_simple(THREADS, 0, 32, increment);
+    if (!p) return report("pool handles", false);
+
+    moore_t* a[THREADS];
+    for (size_t i = 0; i < THREADS; i++) {
+        a[i] = ma_pool_get(p, i);
+    }
+
+    bool const ok = check_own("pool handles", a, steps);
+    ma_pool_delete(p);
+
+    return ok;
+}
+
+// Both threads step the same component: a counter whose input is connected to the output of another counter.
+static bool test_shared(size_t const steps) {
+    moore_t* source = ma_create_simple(0, 32, increment);
+    moore_t* target = ma_create_simple(1, 32, increment);
+    bool ok = source && target && ma_connect(target, 0, source, 0, 1) == 0;
+
+    if (ok) {
+        moore_t* at[2] = {source, target};
+        worker_t workers[THREADS];
+
+        for (size_t i = 0; i < THREADS; i++) {
+            workers[i] = (worker_t){.at = at, .num = 2, .steps = steps};
+        }
+
+        ok = run_workers(workers);
+
+        size_t stepped = 0;
+        for (size_t i = 0; i < THREADS; i++) {
+            ok = ok && workers[i].failed == 0 && workers[i].stepped + workers[i].busy == steps;
+            stepped += workers[i].stepped;
+        }
+        ok = ok && ma_get_output(source)[0] == stepped && ma_get_output(target)[0] == stepped;
+    }
+
+    ma_delete(target);
+    ma_delete(source);
+
+    return report("shared component", ok);
+}
+
+int main(int argc, char* argv[]) {
+    size_t steps = DEFAULT_STEPS;
+
+    if (argc > 1) {
+        char* end;
+        steps = strtoull(argv[1], &end, 10);
+        if (*end != '\0' || steps == 0 || steps > UINT32_MAX) {
+            fprintf(stderr, "usage: %s [steps]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    bool ok = test_separate(steps);
+    ok = test_pool(steps) && ok;
+    ok = test_shared(steps) && ok;
+
+    return ok ? 0 : 1;
+}